@@ -33,6 +33,8 @@ void ofApp::setup(){
 		StudyTouchTracker tracker; \
 		tracker.name = #klass; \
 		tracker.tracker = new klass(depthStream, irStream, *bgthread); \
+		tracker.channel = tracker.tracker->openChannel(); \
+		tracker.touchTime = 0; \
 		tracker.tracker->startThread(); \
 		touchTrackers.push_back(tracker); \
 	}
@@ -76,14 +78,20 @@ void ofApp::setupExperiment() {
 void ofApp::update(){
 	BaseApp::update();
 
-	for(auto &t : touchTrackers) {
-		vector<FingerTouch> newTouches;
-		if(t.tracker->update(newTouches)) {
+	/* Take every frame each tracker produced since the last app frame, not just the latest */
+	const bool taskRunning = !intermission && currentTask < tasks.size();
+	for(int i=0; i<touchTrackers.size(); i++) {
+		StudyTouchTracker &t = touchTrackers[i];
+		t.tracker->fps.tick();
+		t.channel->drain([&](const TouchFrame &frame) {
 			t.touches.clear();
-			for(FingerTouch &touch : newTouches) {
+			for(const FingerTouch &touch : frame.touches) {
 				t.touches[touch.id] = touch;
 			}
-		}
+			t.touchTime = StudyTask::GetTimestamp() - (ofGetElapsedTimeMicros() - frame.captureTime) / 1e6;
+			if(taskRunning)
+				tasks[currentTask]->onTouchFrame(i);
+		});
 	}
 
 	if(!intermission && currentTask < tasks.size()) {
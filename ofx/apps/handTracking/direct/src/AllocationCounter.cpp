@@ -0,0 +1,60 @@
+//
+//  AllocationCounter.cpp
+//  Counts heap allocations made on real-time threads.
+//
+//
+
+#include "AllocationCounter.h"
+#include "ThreadLocal.h"
+
+#include <cstdlib>
+#include <new>
+
+static THREAD_LOCAL AllocationCounter *currentCounter = NULL;
+
+void AllocationCounter::countAllocation() {
+	AllocationCounter *counter = currentCounter;
+	if(counter)
+		counter->count.fetch_add(1, std::memory_order_relaxed);
+}
+
+AllocationCounter::Scope::Scope(AllocationCounter &counter) : prev(currentCounter) {
+	currentCounter = &counter;
+}
+
+AllocationCounter::Scope::~Scope() {
+	currentCounter = prev;
+}
+
+AllocationCounter::Pause::Pause() : prev(currentCounter) {
+	currentCounter = NULL;
+}
+
+AllocationCounter::Pause::~Pause() {
+	currentCounter = prev;
+}
+
+#ifdef COUNT_ALLOCATIONS
+bool AllocationCounter::isEnabled() {
+	return true;
+}
+
+/* Replacement global allocation functions; array new/delete forward to these. */
+void *operator new(size_t size) {
+	AllocationCounter::countAllocation();
+	if(size == 0)
+		size = 1;
+	void *p = malloc(size);
+	if(!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) throw() {
+	free(p);
+}
+#else
+bool AllocationCounter::isEnabled() {
+	return false;
+}
+#endif
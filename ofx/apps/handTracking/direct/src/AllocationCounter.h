@@ -0,0 +1,50 @@
+//
+//  AllocationCounter.h
+//  Counts heap allocations made on real-time threads.
+//
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/* Counts calls to the global operator new made while a Scope for this counter is active on the
+   calling thread. Allocations made by other threads (e.g. the render thread) are not counted.
+   Counting replaces the process's global operator new, so it is only compiled in when COUNT_ALLOCATIONS
+   is defined (the Debug and CompareTestAllocs configurations); otherwise every count stays at zero. */
+class AllocationCounter {
+private:
+	std::atomic<uint64_t> count;
+
+	/* Forbid copying */
+	AllocationCounter &operator=(const AllocationCounter &);
+	AllocationCounter(const AllocationCounter &);
+
+public:
+	AllocationCounter() : count(0) {}
+
+	uint64_t getCount() const { return count.load(std::memory_order_relaxed); }
+
+	/* Whether this build counts allocations at all */
+	static bool isEnabled();
+
+	/* Called by operator new */
+	static void countAllocation();
+
+	class Scope {
+		AllocationCounter *prev;
+	public:
+		Scope(AllocationCounter &counter);
+		~Scope();
+	};
+
+	/* Suspends counting on this thread, for library calls which allocate their own scratch space on every
+	   call and offer no way to pass it in (OpenCV's Canny) */
+	class Pause {
+		AllocationCounter *prev;
+	public:
+		Pause();
+		~Pause();
+	};
+};
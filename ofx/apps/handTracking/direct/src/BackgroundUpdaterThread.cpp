@@ -33,6 +33,18 @@ static const float HEUR_HALO_THRESHOLD = 5; /* mm */
 
 static const int PIXELSKIP = 2; // 1/N pixels will be updated each frame; increase this to reduce CPU usage but increase latency
 
+/* Per-frame time budget for the governor, which skips the debug image and then raises PIXELSKIP when it is exceeded */
+static const float FRAME_BUDGET = 1000.0f / 30 / 2; /* ms: half a Kinect frame, leaving the rest for the trackers */
+
+/* Low-power mode: once the trackers have reported an empty table for a while, only every few frames are used */
+static const int IDLE_FRAMES = 90; // frames (3 s at 30 Hz)
+static const int IDLE_FRAME_SKIP = 4; // 1/N frames are used in low-power mode
+
+/* Changes in the stable mean or stdev smaller than these don't count towards the tile generations (see
+   getTileGeneration); a pixel becoming valid or invalid always does. */
+static const float TILE_CHANGE_THRESHOLD = 1; /* mm */
+static const float TILE_STDEV_CHANGE_FRACTION = 0.1f; /* of the old stdev, i.e. the z-scores move by 10% */
+
 static const float INVALID_MEAN = 0;
 static const float INVALID_STDEV = 1e6;
 
@@ -111,49 +123,123 @@ public:
 	}
 };
 
+const int BackgroundUpdaterThread::tileSize;
+
+/* Decide whether a new depth frame updates the background, and set up the pass if so */
+bool BackgroundUpdaterThread::beginPass(const uint16_t *depthpx) {
+	curDepthFrame++;
+	fps.update();
+
+	if(curFrame >= HIST_SIZE)
+		return false;
+
+	/* Trackers that don't report leave the count alone, so low-power mode needs at least one tracker seeing an empty table */
+	if(foregroundReported.exchange(false))
+		idleFrames = 0;
+	else if(idleReported.exchange(false))
+		idleFrames++;
+	lowPower = (curFrame < 0 && idleFrames >= IDLE_FRAMES);
+	if(lowPower && curDepthFrame % IDLE_FRAME_SKIP != 0)
+		return false;
+	updatedFrames++;
+
+	passMicros = 0;
+	if(curFrame >= 0)
+		curFrame++; // manual capture mode
+
+	pass.depthpx = depthpx;
+	/* Governor levels: 1 = no debug image, 2+ = double PIXELSKIP per level */
+	const int level = governor.getLevel();
+	pass.pixelSkip = PIXELSKIP << max(level - 1, 0);
+	pass.debugpx = (level == 0) ? (uint32_t *)backgroundStateDebug.getPixels() : NULL;
+	return true;
+}
+
+/* Update the background pixels of one tile from the pass's depth frame */
+void BackgroundUpdaterThread::updateTile(int tile) {
+	const uint64_t startTime = ofGetElapsedTimeMicros();
+	const uint16_t *depthpx = pass.depthpx;
+	uint32_t *debugpx = pass.debugpx;
+	float *means = bgmean.getPixels();
+	float *stdevs = bgstdev.getPixels();
+	const int x0 = (tile % getTileCols()) * tileSize, y0 = (tile / getTileCols()) * tileSize;
+	const int x1 = min(x0 + tileSize, width), y1 = min(y0 + tileSize, height);
+
+	bool changed = false;
+	for(int y=y0; y<y1; y++) {
+		for(int i=y*width+x0; i<y*width+x1; i++) {
+			bgpixels[i].update(depthpx[i]);
+			/* Update mean & stdev for a subset of pixels each frame to save CPU */
+			if((i+updatedFrames) % pass.pixelSkip == 0) {
+				const float oldMean = means[i], oldStdev = stdevs[i];
+				bool stable = bgpixels[i].update_stats(&means[i], &stdevs[i]);
+				if((means[i] == INVALID_MEAN) != (oldMean == INVALID_MEAN)
+					|| fabs(means[i] - oldMean) >= TILE_CHANGE_THRESHOLD
+					|| fabs(stdevs[i] - oldStdev) >= TILE_STDEV_CHANGE_FRACTION * oldStdev)
+					changed = true;
+				if(debugpx) {
+					// ABGR
+					debugpx[i] = ((stable ? 255 : 64) << 24) | (((int)(means[i]) & 0xff) << 8) | (((int)(stdevs[i] * 5) & 0xff));
+				}
+			}
+		}
+	}
+	if(changed)
+		tileGenerations[tile]++;
+	passMicros += ofGetElapsedTimeMicros() - startTime;
+}
+
+void BackgroundUpdaterThread::endPass() {
+	lastPassTime = passMicros / 1000.0f;
+	governor.update(lastPassTime);
+}
+
 void BackgroundUpdaterThread::threadedFunction() {
 	uint64_t lastDepthTimestamp = 0;
-	int curDepthFrame = 0;
 	fps.fps = 30; // estimated fps
 
 	while(isThreadRunning()) {
 		// Check if the depth frame is new
 		uint64_t curDepthTimestamp = depthStream.getFrameTimestamp();
-		if(lastDepthTimestamp == curDepthTimestamp) {
+		if(external || lastDepthTimestamp == curDepthTimestamp) {
 			ofSleepMillis(5);
 			continue;
 		}
-		lastDepthTimestamp = curDepthTimestamp;
-		curDepthFrame++;
-		fps.update();
 
-		if(curFrame >= HIST_SIZE)
-			continue;
-		if(curFrame >= 0)
-			curFrame++; // manual capture mode
+		ofScopedLock lock(passMutex);
+		if(external)
+			continue; // a tracker took over while we weren't holding the lock
+		lastDepthTimestamp = curDepthTimestamp;
 
 		// Update background pixels based on new depth data
-		auto &depthPixels = depthStream.getPixelsRef();
-		uint16_t *depthpx = depthPixels.getPixels();
-		uint32_t *debugpx = (uint32_t *)backgroundStateDebug.getPixels();
-		float *means = bgmean.getPixels();
-		float *stdevs = bgstdev.getPixels();
-		const int n = width * height;
-
-		for(int i=0; i<n; i++) {
-			bgpixels[i].update(depthpx[i]);
-			/* Update mean & stdev for a subset of pixels each frame to save CPU */
-			if((i+curDepthFrame) % PIXELSKIP == 0) {
-				bool stable = bgpixels[i].update_stats(&means[i], &stdevs[i]);
-				if(debugpx) {
-					// ABGR
-					debugpx[i] = ((stable ? 255 : 64) << 24) | (((int)(means[i]) & 0xff) << 8) | (((int)(stdevs[i] * 5) & 0xff));
-				}
-			}
+		if(!beginPass(depthStream.getPixelsRef().getPixels()))
+			continue;
+		const int numTiles = getTileCols() * getTileRows();
+		for(int t=0; t<numTiles; t++) {
+			updateTile(t);
 		}
+		endPass();
 	}
 }
 
+void BackgroundUpdaterThread::setExternalUpdate(bool external) {
+	ofScopedLock lock(passMutex);
+	this->external = external;
+}
+
+bool BackgroundUpdaterThread::beginExternalFrame(const uint16_t *depth) {
+	passMutex.lock();
+	if(external && beginPass(depth))
+		return true; // held until endExternalFrame
+	passMutex.unlock();
+	return false;
+}
+
+void BackgroundUpdaterThread::endExternalFrame() {
+	endPass();
+	passMutex.unlock();
+}
+
 /* update() and drawDebug() functions called from the main thread */
 void BackgroundUpdaterThread::drawDebug(float x, float y) {
 	if(!backgroundStateDebug.isAllocated()) {
@@ -161,7 +247,19 @@ void BackgroundUpdaterThread::drawDebug(float x, float y) {
 	}
 	backgroundStateDebug.reloadTexture();
 	backgroundStateDebug.draw(x, y);
-	drawText("Background", x, y, HAlign::left, VAlign::top);
+	string label = "Background";
+	if(lowPower)
+		label += " (low power)";
+	if(governor.getLevel() != 0)
+		label += " (degraded: " + governor.getLevelName() + ")";
+	drawText(label, x, y, HAlign::left, VAlign::top);
+}
+
+void BackgroundUpdaterThread::reportForeground(bool foreground) {
+	if(foreground)
+		foregroundReported = true;
+	else
+		idleReported = true;
 }
 
 void BackgroundUpdaterThread::update() {
@@ -169,10 +267,25 @@ void BackgroundUpdaterThread::update() {
 }
 
 BackgroundUpdaterThread::BackgroundUpdaterThread(ofxKinect2::DepthStream &depthStream)
-: width(depthStream.getWidth()), height(depthStream.getHeight()), depthStream(depthStream) {
+: width(depthStream.getWidth()), height(depthStream.getHeight()), depthStream(depthStream),
+  governor("BackgroundUpdaterThread", FRAME_BUDGET) {
+	governor.addLevel("no debug image");
+	governor.addLevel(ofVAArgsToString("stats for 1/%d pixels", PIXELSKIP * 2));
+	governor.addLevel(ofVAArgsToString("stats for 1/%d pixels", PIXELSKIP * 4));
 	bgpixels = new bgPixelState[width * height];
 	bgmean.allocate(width, height, OF_IMAGE_GRAYSCALE);
 	bgstdev.allocate(width, height, OF_IMAGE_GRAYSCALE);
+	tileGenerations = new std::atomic<int>[getTileCols() * getTileRows()];
+	for(int t=0; t<getTileCols() * getTileRows(); t++) {
+		tileGenerations[t] = 0;
+	}
+	foregroundReported = false;
+	idleReported = false;
+	lowPower = false;
+	external = false;
+	passMicros = 0;
+	lastPassTime = 0;
+	curDepthFrame = updatedFrames = idleFrames = 0;
 	curFrame = -1; //start off dynamic
 }
 
@@ -187,8 +300,21 @@ void BackgroundUpdaterThread::captureBackground() {
 	curFrame = 0;
 }
 
+void BackgroundUpdaterThread::copyModel(BackgroundUpdaterThread &other) {
+	ofScopedLock otherLock(other.passMutex);
+	ofScopedLock lock(passMutex);
+	copy(other.bgpixels, other.bgpixels + width * height, bgpixels);
+	bgmean = other.bgmean;
+	bgstdev = other.bgstdev;
+	for(int t=0; t<getTileCols() * getTileRows(); t++) {
+		tileGenerations[t] = other.tileGenerations[t].load();
+	}
+	curFrame = other.curFrame;
+}
+
 BackgroundUpdaterThread::~BackgroundUpdaterThread() {
 	stopThread();
 	waitForThread();
 	delete [] bgpixels;
+	delete [] tileGenerations;
 }
@@ -11,6 +11,9 @@
 #include "ofMain.h"
 #include "ofxKinect2.h"
 #include "FPSTracker.h"
+#include "FrameGovernor.h"
+
+#include <atomic>
 
 struct bgPixelState;
 
@@ -23,6 +26,33 @@ private:
 
 	int curFrame;
 
+	/* Idle detection, fed by the trackers (see reportForeground) */
+	std::atomic<bool> foregroundReported, idleReported;
+	std::atomic<bool> lowPower;
+
+	/* Update passes, one per depth frame used; run by this thread, or by a tracker in external mode. A pass holds
+	   passMutex from beginning to end, and whoever runs it checks external under the lock, so switching modes waits
+	   for the pass in flight and the two never update the model at once. */
+	ofMutex passMutex;
+	std::atomic<bool> external;
+	int curDepthFrame, updatedFrames, idleFrames;
+	struct UpdatePass {
+		const uint16_t *depthpx;
+		int pixelSkip; // pixels whose stats are updated: 1/N, phased by updatedFrames
+		uint32_t *debugpx; // NULL to skip the debug image
+	} pass;
+	/* Time spent in updateTile, summed over the threads running it, so that a fused pass is charged for its
+	   share of the tracker's pass only */
+	std::atomic<uint64_t> passMicros;
+	std::atomic<float> lastPassTime; // ms
+	bool beginPass(const uint16_t *depthpx);
+	void endPass();
+
+	/* Incremented whenever the stable mean or stdev of a pixel in the tile changes appreciably, or the pixel
+	   becomes valid or invalid. Bumped after the tile's pixels are written, so a reader which sees the new
+	   generation also sees the new model. */
+	std::atomic<int> *tileGenerations;
+
 	/* Debugging */
 	ofImage backgroundStateDebug;
 
@@ -33,6 +63,7 @@ protected:
 	void threadedFunction();
 public:
 	FPSTracker fps;
+	FrameGovernor governor;
 
 	/* Public methods */
 	BackgroundUpdaterThread(ofxKinect2::DepthStream &depthStream);
@@ -40,9 +71,38 @@ public:
 
 	void setDynamicUpdate(bool dynamic);
 	void captureBackground();
+	/* Take over another background's model (of the same size), e.g. to replay recorded frames against it
+	   without disturbing the live one */
+	void copyModel(BackgroundUpdaterThread &other);
 
 	void drawDebug(float x, float y);
 	void update();
+	/* Trackers report whether each frame had any foreground. While they keep reporting an empty table,
+	   the background drops to a lower update rate; it returns to full rate as soon as foreground is reported. */
+	void reportForeground(bool foreground);
+	bool isLowPower() const { return lowPower; }
+
+	/* External (fused) updates: instead of following the depth stream on its own thread, the background is
+	   updated by a tracker as part of its own tiled pass over each frame, so the frame is only streamed once.
+	   Only one tracker may drive the background. For each frame: beginExternalFrame(), which returns false if
+	   the frame doesn't update the background (or external updates are off); then updateTile() for every tile,
+	   from any threads, each tile once; then endExternalFrame(), on the thread that began the frame.
+	   setExternalUpdate() returns once the pass in flight, on either side, has finished. */
+	void setExternalUpdate(bool external);
+	bool isExternalUpdate() const { return external; }
+	bool beginExternalFrame(const uint16_t *depth);
+	void updateTile(int tile);
+	void endExternalFrame();
+	/* ms spent updating tiles in the last pass, summed over threads */
+	float getLastPassTime() const { return lastPassTime; }
+
 	const ofFloatPixels &getBackgroundMean() const { return bgmean; }
 	const ofFloatPixels &getBackgroundStdev() const { return bgstdev; }
+
+	/* Change counters for tileSize x tileSize tiles in row-major order, so that trackers can tell which parts of the
+	   background have changed since they last looked. Safe to read while the background is being updated. */
+	static const int tileSize = 16;
+	int getTileCols() const { return (width + tileSize - 1) / tileSize; }
+	int getTileRows() const { return (height + tileSize - 1) / tileSize; }
+	int getTileGeneration(int tile) const { return tileGenerations[tile]; }
 };
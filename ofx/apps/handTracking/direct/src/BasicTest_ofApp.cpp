@@ -13,6 +13,8 @@
 
 #include "IRDepthTouchTracker.h"
 
+static const uint64_t DISPLAY_LATENCY = 1000000 / 60; // us: from drawing a frame to the projector showing it
+
 //--------------------------------------------------------------
 void ofApp::setup(){
 	ofSetFrameRate(60);
@@ -20,6 +22,8 @@ void ofApp::setup(){
 	BaseApp::setup();
 
 	touchTracker = new IRDepthTouchTracker(depthStream, irStream, *bgthread);
+	touchChannel = touchTracker->openChannel();
+	showPredicted = true;
 	touchTracker->startThread();
 
 	setupDebug();
@@ -40,6 +44,9 @@ void ofApp::update(){
 	if(touchTracker->update(newTouches)) {
 		handleTouches(newTouches);
 	}
+	touchChannel->drain([&](const TouchFrame &frame) {
+		predictor.update(frame.touches, frame.captureTime);
+	});
 
 	updateDebug();
 }
@@ -99,19 +106,27 @@ void ofApp::drawProjector(){
 	/* In this function, draw points in real-world coordinates (metres) */
 	ofSetLineWidth(0.002);
 	
-	/* Reproject touches */
+	/* Reproject touches (yellow while a touch-down is imminent); the predicted tip is the small filled circle */
+	const uint64_t displayTime = ofGetElapsedTimeMicros() + DISPLAY_LATENCY;
 	for(auto &entry : touchMap) {
 		auto &touch = entry.second;
 		ofPoint worldPt = getBackgroundWorldPoint(touch.tip);
 		if(touch.touched) {
 			ofNoFill();
 			ofSetColor(0, 255, 0);
+		} else if(touch.imminent) {
+			ofNoFill();
+			ofSetColor(255, 255, 0);
 		} else {
 			ofNoFill();
 			ofSetColor(255, 0, 0);
 		}
 		ofCircle(worldPt, 0.010);
 		ofDrawBitmapString(ofVAArgsToString("%.2f\n%d", touch.touchZ, touch.id), worldPt);
+		if(showPredicted) {
+			ofFill();
+			ofCircle(getBackgroundWorldPoint(predictor.predict(touch, displayTime)), 0.004);
+		}
 	}
 }
 
@@ -177,6 +192,14 @@ void ofApp::teardown() {
 void ofApp::keyPressed(int key){
 	if(key == OF_KEY_ESC) {
 		teardown();
+	} else if(key == 'p') {
+		showPredicted = !showPredicted;
+	} else if(key == 'e') {
+		/* Offline check of the predictor on synthetic strokes; results go to the log */
+		evaluateTouchPrediction(50, predictor.getParams());
+	} else if(key == 'i') {
+		/* Offline check of touch-down anticipation on synthetic approaches; results go to the log */
+		evaluateSyntheticTouchAnticipation();
 	}
 }
 
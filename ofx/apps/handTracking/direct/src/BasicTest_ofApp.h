@@ -3,6 +3,8 @@
 #include "ofMain.h"
 #include "BaseApp.h"
 #include "Touch.h"
+#include "TouchChannel.h"
+#include "TouchPredictor.h"
 
 class ofApp : public BaseApp{
 
@@ -18,6 +20,12 @@ class ofApp : public BaseApp{
 
 		map<int, FingerTouch> touchMap;
 
+		/* Latency compensation: every touch frame feeds the predictor, which places the touches where they
+		   will be when the projector shows them */
+		TouchChannel *touchChannel;
+		TouchPredictor predictor;
+		bool showPredicted;
+
 		void drawProjector();
 		void drawDebug();
 
@@ -17,6 +17,35 @@
 #include "WilsonMaxTouchTracker.h"
 #include "WilsonStatTouchTracker.h"
 #include "OmniTouchSausageTracker.h"
+#include "WorldKitTouchTracker.h"
+#include "StatBlobTouchTracker.h"
+#include "HybridTouchTracker.h"
+#include "PipelineBenchmark.h"
+#include "PixelKernels.h"
+#include "TouchAssociator.h"
+
+/* Background depth splitting the hybrid tracker's zones: WorldKit nearer than this, IRDepth beyond */
+static const float HYBRID_SPLIT_DEPTH = 1200; // mm
+
+/* Runs benchmarkTouchPipelines off the UI thread. Its pipelines share the worker pool, so the live trackers
+   should be stopped first for the timings to mean anything. */
+class TouchPipelineBenchmarkThread : public ofThread {
+	ofxKinect2::DepthStream &depthStream;
+	ofxKinect2::IrStream &irStream;
+	BackgroundUpdaterThread &background;
+	std::atomic<bool> done;
+
+	void threadedFunction() {
+		benchmarkTouchPipelines(depthStream, irStream, background);
+		done = true;
+	}
+
+public:
+	TouchPipelineBenchmarkThread(ofxKinect2::DepthStream &depthStream, ofxKinect2::IrStream &irStream, BackgroundUpdaterThread &background)
+	: depthStream(depthStream), irStream(irStream), background(background), done(false) {}
+
+	bool isDone() const { return done; }
+};
 
 //--------------------------------------------------------------
 void ofApp::setup(){
@@ -38,8 +67,25 @@ void ofApp::setup(){
 	ADD_TRACKER(WilsonSingleTouchTracker, ofColor::red)
 	ADD_TRACKER(WilsonMaxTouchTracker, ofColor::orange)
 	ADD_TRACKER(WilsonStatTouchTracker, ofColor::yellow)
+	ADD_TRACKER(StatBlobTouchTracker, ofColor::gold)
 	ADD_TRACKER(OmniTouchSausageTracker, ofColor::cyan)
 #undef ADD_TRACKER
+
+	{
+		HybridTouchTracker *hybrid = new HybridTouchTracker(depthStream, irStream, *bgthread);
+		int far = hybrid->addTracker(new IRDepthTouchTracker(depthStream, irStream, *bgthread), "IRDepthTouchTracker");
+		int near = hybrid->addTracker(new WorldKitTouchTracker(depthStream, irStream, *bgthread), "WorldKitTouchTracker");
+		hybrid->setDepthZones(HYBRID_SPLIT_DEPTH, near, far);
+
+		TouchTrackerWrapper tracker;
+		tracker.color = ofColor::magenta;
+		tracker.name = "HybridTouchTracker";
+		tracker.tracker = hybrid;
+		tracker.tracker->startThread();
+		touchTrackers.push_back(tracker);
+	}
+	benchmark = NULL;
+	pipelineBenchmark = NULL;
 	setupDebug();
 }
 
@@ -66,6 +112,18 @@ void ofApp::update(){
 		}
 	}
 
+	if(benchmark)
+		benchmark->update();
+
+	if(pipelineBenchmark && pipelineBenchmark->isDone()) {
+		pipelineBenchmark->waitForThread();
+		delete pipelineBenchmark;
+		pipelineBenchmark = NULL;
+		for(auto &t : touchTrackers) {
+			t.tracker->startThread();
+		}
+	}
+
 	updateDebug();
 }
 
@@ -138,6 +196,13 @@ void ofApp::drawDebug(){
 			(i == debugShown) ? "[shown] " : "",i,
 			touchTrackers[i].name.c_str(), touchTrackers[i].tracker->fps.fps), DISPW, lh*(2+i));
 	}
+
+	if(benchmark)
+		benchmark->draw(0, dh*2);
+	if(pipelineBenchmark) {
+		setTextAlign(HAlign::left, VAlign::top);
+		drawText("Touch pipeline benchmark running; trackers paused", 0, dh*2);
+	}
 }
 
 void ofApp::draw(){
@@ -164,6 +229,11 @@ void ofApp::draw(){
 //--------------------------------------------------------------
 void ofApp::teardown() {
 	/* Destroy everything cleanly. */
+	delete benchmark;
+	if(pipelineBenchmark) {
+		pipelineBenchmark->waitForThread(false);
+		delete pipelineBenchmark;
+	}
 	for(auto &t : touchTrackers) {
 		delete t.tracker;
 	}
@@ -178,6 +248,37 @@ void ofApp::keyPressed(int key){
 		bgthread->captureBackground();
 	} else if(key >= '0' && key <= '9') {
 		debugShown = key - '0';
+	} else if(key == 'b' && !benchmark) {
+		benchmark = new PipelineBenchmark(depthStream, irStream, *bgthread);
+	} else if(key == 'c') {
+		/* Toggle the cheap-first cascade on the IRDepth tracker */
+		for(auto &t : touchTrackers) {
+			IRDepthTouchTracker *irDepth = dynamic_cast<IRDepthTouchTracker *>(t.tracker);
+			if(irDepth)
+				irDepth->setCascade(!irDepth->isCascade());
+		}
+	} else if(key == 'o') {
+		/* Toggle optimal matching of crowded touches on the IRDepth tracker */
+		for(auto &t : touchTrackers) {
+			IRDepthTouchTracker *irDepth = dynamic_cast<IRDepthTouchTracker *>(t.tracker);
+			if(irDepth)
+				irDepth->setOptimalAssociation(!irDepth->isOptimalAssociation());
+		}
+	} else if(key == 'a') {
+		/* Time touch association in crowded scenes; results go to the log */
+		benchmarkTouchAssociation();
+	} else if(key == 'k') {
+		/* Check the vectorized pixel kernels against the scalar ones; results go to the log */
+		testPixelKernels();
+	} else if(key == 't' && !pipelineBenchmark && !benchmark) {
+		/* Time the composed tracker stages against virtual dispatch between them; results go to the log.
+		   The trackers are restarted in update() once it is done. */
+		for(auto &t : touchTrackers) {
+			t.tracker->stopThread();
+			t.tracker->waitForThread();
+		}
+		pipelineBenchmark = new TouchPipelineBenchmarkThread(depthStream, irStream, *bgthread);
+		pipelineBenchmark->startThread();
 	}
 }
 
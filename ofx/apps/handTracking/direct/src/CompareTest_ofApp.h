@@ -36,4 +36,7 @@ class ofApp : public BaseApp{
 		uint64_t lastDepthTimestamp;
 		int curDepthFrame;
 		int debugShown;
+
+		class PipelineBenchmark *benchmark; // started with 'b'
+		class TouchPipelineBenchmarkThread *pipelineBenchmark; // started with 't'; the trackers are paused while it runs
 };
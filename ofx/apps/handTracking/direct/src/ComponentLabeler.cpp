@@ -0,0 +1,68 @@
+//
+//  ComponentLabeler.cpp
+//  Parallel connected-component labeling with per-component statistics.
+//
+//
+
+#include "ComponentLabeler.h"
+
+/* Rows per strip; enough strips to keep every worker busy, few enough that the joins stay cheap */
+static const int STRIP_ROWS = 32;
+
+ComponentLabeler::ComponentLabeler(int w, int h)
+: w(w), h(h), parent(w*h + 1), pool(WorkerPool::shared()) {
+	for(int y=0; y<h; y+=STRIP_ROWS) {
+		Strip strip;
+		strip.y0 = y;
+		strip.y1 = min(y + STRIP_ROWS, h);
+		strip.base = y*w; // a strip has fewer runs than pixels
+		strip.firstRowEnd = strip.lastRowBegin = 0;
+		strips.push_back(strip);
+	}
+}
+
+void ComponentLabeler::uniteRows(const ComponentRun *a, const ComponentRun *aEnd, const ComponentRun *b, const ComponentRun *bEnd, int reach) {
+	for(; a != aEnd; a++) {
+		while(b != bEnd && b->x1 + reach <= a->x0)
+			b++;
+		for(const ComponentRun *p=b; p != bEnd && p->x0 < a->x1 + reach; p++)
+			unite(a->label, p->label);
+	}
+}
+
+/* Merge the trees of runs touching across each strip border */
+void ComponentLabeler::joinStrips(Connectivity connectivity) {
+	const int reach = (connectivity == CONNECT_8) ? 1 : 0;
+	for(int s=1; s<strips.size(); s++) {
+		const vector<ComponentRun> &above = strips[s-1].runs, &below = strips[s].runs;
+		if(below.empty() || above.empty())
+			continue;
+		uniteRows(&below[0], &below[0] + strips[s].firstRowEnd,
+			&above[0] + strips[s-1].lastRowBegin, &above[0] + above.size(), reach);
+	}
+}
+
+/* Number the roots in order, and total each tree's statistics into its component. Parents always have smaller
+   labels than their children, so walking the labels in increasing order, each parent already holds its
+   component number when its children are reached: parent[] is overwritten with component labels in place. */
+void ComponentLabeler::resolveLabels() {
+	components.clear();
+
+	for(auto &strip : strips) {
+		for(int k=0; k<strip.stats.size(); k++) {
+			const uint32_t l = strip.base + k + 1;
+			if(parent[l] == l) {
+				components.push_back(strip.stats[k]);
+				parent[l] = components.size();
+			} else {
+				parent[l] = parent[parent[l]];
+				components[parent[l] - 1].merge(strip.stats[k]);
+			}
+		}
+	}
+
+	for(auto &strip : strips) {
+		for(auto &run : strip.runs)
+			run.label = parent[run.label];
+	}
+}
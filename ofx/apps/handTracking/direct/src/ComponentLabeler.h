@@ -0,0 +1,224 @@
+//
+//  ComponentLabeler.h
+//  Parallel connected-component labeling with per-component statistics.
+//
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "WorkerPool.h"
+
+#include <climits>
+
+/* Statistics gathered over one connected component */
+struct ComponentStats {
+	int count;
+	int sumX, sumY;
+	int peakCount; // pixels for which the classifier's peak() holds
+	int furthestValue; // largest distance() in the component
+	int furthestIndex; // first pixel, in raster order, with that distance
+	int furthestCount; // pixels with that distance
+	int firstIndex; // first pixel in raster order
+
+	ofVec2f centroid() const { return ofVec2f((float)sumX, (float)sumY) / count; }
+
+	void start(int i) {
+		count = sumX = sumY = peakCount = 0;
+		furthestValue = INT_MIN;
+		furthestIndex = firstIndex = i;
+		furthestCount = 0;
+	}
+	void merge(const ComponentStats &other) {
+		count += other.count;
+		sumX += other.sumX;
+		sumY += other.sumY;
+		peakCount += other.peakCount;
+		if(other.furthestValue > furthestValue) {
+			furthestValue = other.furthestValue;
+			furthestIndex = other.furthestIndex;
+			furthestCount = other.furthestCount;
+		} else if(other.furthestValue == furthestValue) {
+			furthestIndex = min(furthestIndex, other.furthestIndex);
+			furthestCount += other.furthestCount;
+		}
+		firstIndex = min(firstIndex, other.firstIndex);
+	}
+};
+
+/* Pixels [x0, x1) of row y, all in one component */
+struct ComponentRun {
+	int y, x0, x1;
+	uint32_t label;
+};
+
+/* Base for the pixel classifiers passed to ComponentLabeler::label(). Derive from it and define
+   bool foreground(int i) const; override peak() and distance() to collect those statistics. The calls are
+   resolved at compile time, so a classifier which doesn't override them pays nothing for them. */
+struct ComponentPixels {
+	bool peak(int i) const { return false; }
+	int distance(int i) const { return 0; }
+};
+
+/* Labels the connected foreground components of a w x h image. The image is cut into strips of rows which are
+   labeled in parallel: a scan finds the runs of foreground pixels in each row and links them to the runs they
+   touch in the row above, by union-find on provisional labels. The strips are then joined along their borders,
+   and a second pass gives every run its component's label.
+
+   Working on runs rather than pixels keeps the label data small for the sparse images the trackers produce:
+   the only full pass over the image is the one reading it. Components come out in raster order of their first
+   pixel, which is the order in which a flood fill scanning the image would find them, and their statistics
+   don't depend on how the image was split. Results are valid until the next call to label(). */
+class ComponentLabeler {
+public:
+	enum Connectivity {
+		CONNECT_4,
+		CONNECT_8
+	};
+
+private:
+	struct Strip {
+		int y0, y1;
+		uint32_t base; // provisional labels of this strip are base+1, base+2, ...
+		vector<ComponentStats> stats; // by provisional label - base - 1
+		vector<ComponentRun> runs; // in raster order
+		int firstRowEnd, lastRowBegin; // runs of rows y0 and y1-1
+	};
+
+	const int w, h;
+	vector<uint32_t> parent; // union-find forest over provisional labels; a root is its own parent
+	vector<Strip> strips;
+	vector<ComponentStats> components;
+	WorkerPool &pool; // strips are labeled on the shared pool
+
+	/* Roots are always the smallest label of their tree, i.e. the label of the tree's first run */
+	uint32_t find(uint32_t l) {
+		while(parent[l] != l) {
+			parent[l] = parent[parent[l]];
+			l = parent[l];
+		}
+		return l;
+	}
+	uint32_t unite(uint32_t a, uint32_t b) {
+		a = find(a);
+		b = find(b);
+		if(a < b) {
+			parent[b] = a;
+			return a;
+		} else {
+			parent[a] = b;
+			return b;
+		}
+	}
+	/* Unite every run in [a, aEnd) with the runs in [b, bEnd) of the row above it that it touches */
+	void uniteRows(const ComponentRun *a, const ComponentRun *aEnd, const ComponentRun *b, const ComponentRun *bEnd, int reach);
+
+	/* pixels is taken by value, so that the compiler can keep its members in registers */
+	template<bool Eight, typename Pixels>
+	void labelStrip(Strip &strip, Pixels pixels);
+	void joinStrips(Connectivity connectivity);
+	void resolveLabels();
+
+	/* Forbid copying */
+	ComponentLabeler &operator=(const ComponentLabeler &);
+	ComponentLabeler(const ComponentLabeler &);
+
+public:
+	ComponentLabeler(int w, int h);
+
+	/* Label the components of the pixels for which pixels.foreground(i) holds. Component k (from 0) gets
+	   label k+1 and statistics components[k]. */
+	template<typename Pixels>
+	const vector<ComponentStats> &label(Connectivity connectivity, const Pixels &pixels) {
+		pool.parallelFor(strips.size(), [&](int s) {
+			if(connectivity == CONNECT_8)
+				labelStrip<true>(strips[s], pixels);
+			else
+				labelStrip<false>(strips[s], pixels);
+		});
+		joinStrips(connectivity);
+		resolveLabels();
+		return components;
+	}
+
+	const vector<ComponentStats> &getComponents() const { return components; }
+
+	/* Call fn(const ComponentRun &) for every run of foreground pixels, in raster order */
+	template<typename F> void forEachRun(F fn) const {
+		for(const auto &strip : strips) {
+			for(const auto &run : strip.runs)
+				fn(run);
+		}
+	}
+};
+
+/* First pass over one strip: find the runs of each row, give each run the smallest root among the runs it
+   touches in the row above (merging their trees), or a new provisional label, and add up its statistics under
+   that label. */
+template<bool Eight, typename Pixels>
+void ComponentLabeler::labelStrip(Strip &strip, Pixels pixels) {
+	const int w = this->w;
+	const int reach = Eight ? 1 : 0; // how far past its ends a run touches the row above
+	vector<ComponentRun> &runs = strip.runs;
+	strip.stats.clear();
+	runs.clear();
+
+	int prevBegin = 0, prevEnd = 0; // runs of the row above
+	for(int y=strip.y0; y<strip.y1; y++) {
+		const int row = y*w;
+		const int rowBegin = runs.size();
+		int prev = prevBegin;
+		int x = 0;
+		while(1) {
+			while(x < w && !pixels.foreground(row + x))
+				x++;
+			if(x == w)
+				break;
+
+			ComponentRun run;
+			run.y = y;
+			run.x0 = x;
+			ComponentStats s;
+			s.start(row + x);
+			for(; x < w && pixels.foreground(row + x); x++) {
+				const int i = row + x;
+				s.count++;
+				s.sumX += x;
+				s.sumY += y;
+				if(pixels.peak(i))
+					s.peakCount++;
+				const int dist = pixels.distance(i);
+				if(dist > s.furthestValue) {
+					s.furthestValue = dist;
+					s.furthestIndex = i;
+					s.furthestCount = 1;
+				} else if(dist == s.furthestValue) {
+					s.furthestCount++;
+				}
+			}
+			run.x1 = x;
+
+			uint32_t l = 0;
+			while(prev < prevEnd && runs[prev].x1 + reach <= run.x0)
+				prev++;
+			for(int p=prev; p<prevEnd && runs[p].x0 < run.x1 + reach; p++)
+				l = l ? unite(l, runs[p].label) : find(runs[p].label);
+
+			if(l) {
+				strip.stats[l - strip.base - 1].merge(s);
+			} else {
+				l = strip.base + strip.stats.size() + 1;
+				parent[l] = l;
+				strip.stats.push_back(s);
+			}
+			run.label = l;
+			runs.push_back(run);
+		}
+
+		if(y == strip.y0)
+			strip.firstRowEnd = runs.size();
+		prevBegin = rowBegin;
+		prevEnd = runs.size();
+	}
+	strip.lastRowBegin = prevBegin;
+}
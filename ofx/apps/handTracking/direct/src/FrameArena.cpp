@@ -0,0 +1,105 @@
+//
+//  FrameArena.cpp
+//  Per-frame bump allocator for tracker scratch memory.
+//
+//
+
+#include "FrameArena.h"
+#include "ThreadLocal.h"
+
+#include <algorithm>
+#include <cstdint>
+
+static const size_t arena_align = 16;
+
+static THREAD_LOCAL FrameArena *currentArena = NULL;
+
+FrameArena::FrameArena(size_t blockSize)
+: curBlock(0), curOffset(0), blockSize(blockSize), bytesUsed(0), blockAllocations(0) {
+	addBlock(blockSize);
+}
+
+FrameArena::~FrameArena() {
+	for(auto &block : blocks) {
+		delete[] block.storage;
+	}
+}
+
+void FrameArena::addBlock(size_t minSize) {
+	Block block;
+	block.size = std::max(minSize, blockSize);
+	/* new char[] only promises alignment for the fundamental types (8 bytes on Win32), so round up */
+	block.storage = new char[block.size + arena_align - 1];
+	block.data = (char *)(((uintptr_t)block.storage + arena_align - 1) & ~(uintptr_t)(arena_align - 1));
+	blocks.push_back(block);
+	blockAllocations++;
+}
+
+void *FrameArena::allocate(size_t bytes) {
+	bytes = (bytes + arena_align - 1) & ~(arena_align - 1);
+
+	while(curOffset + bytes > blocks[curBlock].size) {
+		/* Move on to the next block, making one if needed */
+		curBlock++;
+		curOffset = 0;
+		if(curBlock == blocks.size())
+			addBlock(bytes);
+	}
+
+	void *ret = blocks[curBlock].data + curOffset;
+	curOffset += bytes;
+	bytesUsed += bytes;
+	return ret;
+}
+
+void FrameArena::reset() {
+	if(blocks.size() > 1) {
+		/* Coalesce, so next frame fits in one block */
+		size_t total = 0;
+		for(auto &block : blocks) {
+			total += block.size;
+			delete[] block.storage;
+		}
+		blocks.clear();
+		addBlock(total);
+	}
+
+	curBlock = 0;
+	curOffset = 0;
+	bytesUsed = 0;
+}
+
+FrameArena *FrameArena::current() {
+	return currentArena;
+}
+
+FrameArena::Scope::Scope(FrameArena &arena) : prev(currentArena) {
+	currentArena = &arena;
+}
+
+FrameArena::Scope::~Scope() {
+	currentArena = prev;
+}
+
+/* Every allocation is preceded by a header recording the arena it came from (NULL for the heap) */
+union ArenaHeader {
+	FrameArena *arena;
+	char pad[arena_align];
+};
+
+void *arenaAllocate(size_t bytes) {
+	FrameArena *arena = currentArena;
+	void *p = arena ? arena->allocate(sizeof(ArenaHeader) + bytes) : ::operator new(sizeof(ArenaHeader) + bytes);
+	ArenaHeader *header = (ArenaHeader *)p;
+	header->arena = arena;
+	return header + 1;
+}
+
+void arenaDeallocate(void *p) {
+	if(!p)
+		return;
+	ArenaHeader *header = (ArenaHeader *)p - 1;
+	if(!header->arena)
+		::operator delete(header);
+	/* Arena memory is reclaimed by FrameArena::reset() */
+}
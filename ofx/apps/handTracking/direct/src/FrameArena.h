@@ -0,0 +1,112 @@
+//
+//  FrameArena.h
+//  Per-frame bump allocator for tracker scratch memory.
+//
+//
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/* Bump allocator which is emptied once per frame. Memory is carved out of large blocks which
+   are kept between frames, so a tracker in steady state never touches the heap.
+   Not thread-safe: give each thread its own arena. */
+class FrameArena {
+private:
+	struct Block {
+		char *storage; // as allocated
+		char *data; // storage rounded up to the arena's alignment
+		size_t size; // usable bytes from data
+	};
+	std::vector<Block> blocks;
+	size_t curBlock; // block currently being carved up
+	size_t curOffset; // offset of the first free byte in that block
+	size_t blockSize;
+	size_t bytesUsed; // bytes handed out since the last reset
+	int blockAllocations;
+
+	void addBlock(size_t minSize);
+
+	/* Forbid copying */
+	FrameArena &operator=(const FrameArena &);
+	FrameArena(const FrameArena &);
+
+public:
+	FrameArena(size_t blockSize = 1 << 20);
+	~FrameArena();
+
+	/* Allocate bytes, aligned for any type */
+	void *allocate(size_t bytes);
+
+	/* Release everything allocated since the last reset. Anything allocated from the arena
+	   (including containers using ArenaAllocator) must be gone by then.
+	   If the last frame spilled into several blocks, they are merged into one big enough for it. */
+	void reset();
+
+	size_t getBytesUsed() const { return bytesUsed; }
+	/* Number of blocks requested from the heap over the arena's lifetime */
+	int getBlockAllocations() const { return blockAllocations; }
+
+	/* The arena ArenaAllocator uses on the calling thread, or NULL */
+	static FrameArena *current();
+
+	/* Makes an arena current on this thread for the lifetime of the scope */
+	class Scope {
+		FrameArena *prev;
+	public:
+		Scope(FrameArena &arena);
+		~Scope();
+	};
+};
+
+/* Used by ArenaAllocator: allocate from the current arena, or from the heap if there is none */
+void *arenaAllocate(size_t bytes);
+void arenaDeallocate(void *p);
+
+/* STL allocator drawing from the calling thread's current FrameArena. It is stateless, so containers
+   can be freely copied and swapped; each block remembers whether it came from an arena or the heap.
+   Deallocation is a no-op for arena memory, which is reclaimed all at once by FrameArena::reset(). */
+template<typename T>
+class ArenaAllocator {
+public:
+	typedef T value_type;
+	typedef T *pointer;
+	typedef const T *const_pointer;
+	typedef T &reference;
+	typedef const T &const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	template<typename U> struct rebind {
+		typedef ArenaAllocator<U> other;
+	};
+
+	ArenaAllocator() {}
+	template<typename U> ArenaAllocator(const ArenaAllocator<U> &) {}
+
+	pointer address(reference x) const { return &x; }
+	const_pointer address(const_reference x) const { return &x; }
+
+	pointer allocate(size_type n, const void * = 0) {
+		return (pointer)arenaAllocate(n * sizeof(T));
+	}
+	void deallocate(pointer p, size_type) {
+		arenaDeallocate(p);
+	}
+
+	size_type max_size() const { return size_type(-1) / sizeof(T); }
+
+	void construct(pointer p, const T &val) { new((void *)p) T(val); }
+	void destroy(pointer p) { p->~T(); }
+
+	template<typename U> bool operator==(const ArenaAllocator<U> &) const { return true; }
+	template<typename U> bool operator!=(const ArenaAllocator<U> &) const { return false; }
+};
+
+/* vector allocating from the current frame arena */
+template<typename T>
+struct FrameVector {
+	typedef std::vector<T, ArenaAllocator<T> > type;
+};
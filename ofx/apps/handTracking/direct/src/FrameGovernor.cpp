@@ -0,0 +1,61 @@
+//
+//  FrameGovernor.cpp
+//  Trades processing quality for time when frames run over budget.
+//
+//
+
+#include "FrameGovernor.h"
+
+/* Governor configuration */
+static const float TIME_SMOOTHING = 0.1f; // EWMA weight of the newest frame time
+static const int DEGRADE_FRAMES = 15; // frames over budget before degrading one level (0.5 s at 30 Hz)
+static const int RECOVER_FRAMES = 90; // frames with headroom before recovering one level (3 s at 30 Hz)
+static const float RECOVER_HEADROOM = 0.6f; // headroom: average frame time below this fraction of the budget
+
+FrameGovernor::FrameGovernor(const string &name, float budget)
+: name(name), budget(budget), enabled(true), level(0), avgTime(0), overFrames(0), underFrames(0) {
+	levels.push_back("full quality");
+}
+
+void FrameGovernor::addLevel(const string &levelName) {
+	levels.push_back(levelName);
+}
+
+void FrameGovernor::setBudget(float budget) {
+	this->budget = budget;
+}
+
+void FrameGovernor::setEnabled(bool enabled) {
+	this->enabled = enabled;
+	if(!enabled)
+		setLevel(0, "governor disabled");
+}
+
+void FrameGovernor::setLevel(int newLevel, const char *reason) {
+	if(newLevel == level)
+		return;
+	ofLogNotice(name) << reason << " (" << ofToString(avgTime, 1) << " ms/frame, budget " << ofToString(budget, 1)
+		<< " ms): level " << level << " -> " << newLevel << " (" << levels[newLevel] << ")";
+	level = newLevel;
+	overFrames = underFrames = 0;
+}
+
+bool FrameGovernor::update(float frameTime) {
+	avgTime += TIME_SMOOTHING * (frameTime - avgTime);
+	if(!enabled)
+		return false;
+
+	int oldLevel = level;
+	if(avgTime > budget) {
+		underFrames = 0;
+		if(++overFrames >= DEGRADE_FRAMES && level < levels.size() - 1)
+			setLevel(level + 1, "over budget");
+	} else if(avgTime < budget * RECOVER_HEADROOM) {
+		overFrames = 0;
+		if(++underFrames >= RECOVER_FRAMES && level > 0)
+			setLevel(level - 1, "headroom");
+	} else {
+		overFrames = underFrames = 0;
+	}
+	return level != oldLevel;
+}
@@ -0,0 +1,47 @@
+//
+//  FrameGovernor.h
+//  Trades processing quality for time when frames run over budget.
+//
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+#include <atomic>
+
+/* Watches how long a worker thread takes per frame and steps through a ladder of quality degradations
+   when it keeps exceeding its budget, stepping back once there is headroom again. Level 0 is full quality;
+   each further level is cheaper than the one before. The owner reports frame times with update() and
+   applies whatever getLevel() says; level changes are logged. */
+class FrameGovernor {
+private:
+	string name; // for the log
+	vector<string> levels;
+	float budget; // ms per frame
+	bool enabled;
+
+	std::atomic<int> level;
+	float avgTime; // ms, smoothed
+	int overFrames, underFrames; // consecutive frames above budget / with headroom
+
+	void setLevel(int newLevel, const char *reason);
+
+public:
+	FrameGovernor(const string &name, float budget);
+
+	/* Degradations, in the order they are applied */
+	void addLevel(const string &levelName);
+	void setBudget(float budget);
+	float getBudget() const { return budget; }
+	/* A disabled governor returns to full quality and stays there */
+	void setEnabled(bool enabled);
+
+	/* Report the time taken by a frame (ms). Returns true if the level changed. Call from one thread only. */
+	bool update(float frameTime);
+
+	int getLevel() const { return level; }
+	int getNumLevels() const { return levels.size(); }
+	const string &getLevelName() const { return levels[level]; }
+	float getAverageTime() const { return avgTime; }
+};
@@ -0,0 +1,41 @@
+//
+//  GuardBand.h
+//  Sentinel borders and stride specialization for flood-fill kernels.
+//
+//
+
+#pragma once
+
+#include <algorithm>
+
+/* Overwrite the outermost `border` rows and columns of a w x h plane with `value`.
+   If `value` is something a flood fill never enters, every pixel the fill reaches
+   has all of its neighbours (up to `border` away) inside the plane, so neighbour tests
+   can use plain offset loads with no bounds checks. */
+template<typename T>
+inline void fillGuardBand(T *px, int w, int h, T value, int border=1) {
+	std::fill_n(px, w * border, value);
+	std::fill_n(px + (h - border) * w, w * border, value);
+	for(int y=border; y<h-border; y++) {
+		std::fill_n(px + y * w, border, value);
+		std::fill_n(px + (y + 1) * w - border, border, value);
+	}
+}
+
+/* Row strides for flood kernels. Kernels take the stride as a template type so that the
+   Kinect 2's 512-pixel rows fold into constant offsets (and divisions by the stride into
+   multiplies); RuntimeStride is the fallback for any other resolution.
+   Call sites dispatch on w == kinect2_depth_width. */
+const int kinect2_depth_width = 512;
+
+template<int W>
+struct FixedStride {
+	FixedStride(int) {}
+	operator int() const { return W; }
+};
+
+struct RuntimeStride {
+	int w;
+	RuntimeStride(int w) : w(w) {}
+	operator int() const { return w; }
+};
@@ -0,0 +1,325 @@
+//
+//  HybridTouchTracker.cpp
+//  Splits the surface into zones, each handled by its own touch tracker.
+//
+//
+
+#include "HybridTouchTracker.h"
+#include "TextUtils.h"
+
+/* Zone configuration */
+static const int ZONE_OVERLAP = 32; // px: trackers also process this far past their zones
+static const int ZONE_UPDATE_INTERVAL = 1000; // ms: how often depth zones follow the background
+static const float HANDOFF_DIST = 30; // px: a touch appearing this close to one which just vanished takes over its ID
+
+static const ofColor ZONE_COLORS[] = {ofColor::limeGreen, ofColor::magenta, ofColor::cyan, ofColor::orange};
+static const int NUM_ZONE_COLORS = sizeof(ZONE_COLORS) / sizeof(ZONE_COLORS[0]);
+
+/* Average the valid background depth over each tile, and split the tiles at splitDepth */
+void HybridTouchTracker::updateDepthZones() {
+	const int tileSize = BackgroundUpdaterThread::tileSize;
+	const int tileCols = background.getTileCols();
+	const float *bgmean = background.getBackgroundMean().getPixels();
+
+	float split;
+	int nearOwner, farOwner;
+	vector<int> owners;
+	{
+		ofScopedLock lock(zoneLock);
+		split = splitDepth;
+		nearOwner = nearMember;
+		farOwner = farMember;
+		owners.resize(tileOwners.size());
+		lastZoneUpdate = ofGetElapsedTimeMillis(); // setDepthZones() meanwhile forces another update
+	}
+
+	for(int t=0; t<owners.size(); t++) {
+		const int x0 = (t % tileCols) * tileSize, y0 = (t / tileCols) * tileSize;
+		double sum = 0;
+		int count = 0;
+		for(int y=y0; y<min(y0 + tileSize, h); y++) {
+			for(int i=y*w+x0; i<y*w+min(x0 + tileSize, w); i++) {
+				if(bgmean[i] != 0) {
+					sum += bgmean[i];
+					count++;
+				}
+			}
+		}
+		owners[t] = (count > 0 && sum / count < split) ? nearOwner : farOwner;
+	}
+
+	{
+		ofScopedLock lock(zoneLock);
+		/* Zones set by setZones() meanwhile stand */
+		if(splitDepth <= 0)
+			return;
+		tileOwners.swap(owners);
+	}
+	applyZones();
+}
+
+/* Give each tracker its zones, grown by the overlap band */
+void HybridTouchTracker::applyZones() {
+	const int tileCols = background.getTileCols();
+	const int tileRows = background.getTileRows();
+	const int overlap = (ZONE_OVERLAP + BackgroundUpdaterThread::tileSize - 1) / BackgroundUpdaterThread::tileSize;
+
+	ofScopedLock lock(zoneLock);
+	vector<uint8_t> zone(tileOwners.size());
+	for(int m=0; m<members.size(); m++) {
+		fill(zone.begin(), zone.end(), 0);
+		for(int t=0; t<tileOwners.size(); t++) {
+			if(tileOwners[t] != m)
+				continue;
+			const int tx = t % tileCols, ty = t / tileCols;
+			for(int y=max(ty-overlap, 0); y<=min(ty+overlap, tileRows-1); y++) {
+				fill_n(&zone[y*tileCols + max(tx-overlap, 0)], min(tx+overlap, tileCols-1) - max(tx-overlap, 0) + 1, 1);
+			}
+		}
+		members[m].tracker->setZoneTiles(zone);
+	}
+}
+
+/* Keep the touches each tracker reports inside its own zones, and give them hybrid IDs. A touch keeps its ID
+   while its tracker keeps tracking it; a touch which its tracker has only just started reporting (e.g. after
+   crossing into its zone) takes over the ID of a touch which another tracker has just stopped reporting nearby.
+   Within one tracker, a new touch is new: its tracker's own association already decided so. */
+vector<FingerTouch> HybridTouchTracker::mergeTouches() {
+	const int tileSize = BackgroundUpdaterThread::tileSize;
+	const int tileCols = background.getTileCols();
+
+	vector<FingerTouch> newTouches;
+	vector<pair<int, int> > sources;
+	{
+		ofScopedLock lock(zoneLock);
+		for(int m=0; m<members.size(); m++) {
+			for(const FingerTouch &touch : members[m].touches) {
+				int x = ofClamp(touch.tip.x, 0, w - 1), y = ofClamp(touch.tip.y, 0, h - 1);
+				if(tileOwners[(y / tileSize) * tileCols + x / tileSize] != m)
+					continue;
+				newTouches.push_back(touch);
+				sources.push_back(make_pair(m, touch.id));
+			}
+		}
+	}
+
+	/* Member which reported each of the current touches */
+	map<int, int> idMembers;
+	for(const auto &entry : idMap) {
+		idMembers[entry.second] = entry.first.first;
+	}
+
+	/* Touches which were already being reported */
+	map<pair<int, int>, int> newIdMap;
+	set<int> keptIds;
+	for(int i=0; i<newTouches.size(); i++) {
+		auto it = idMap.find(sources[i]);
+		if(it == idMap.end()) {
+			newTouches[i].id = -1;
+			continue;
+		}
+		newTouches[i].id = it->second;
+		keptIds.insert(it->second);
+		newIdMap[sources[i]] = it->second;
+	}
+
+	/* New touches: hand over from the nearest touch which vanished from another member, if there is one */
+	for(int i=0; i<newTouches.size(); i++) {
+		FingerTouch &touch = newTouches[i];
+		if(touch.id >= 0)
+			continue;
+		const FingerTouch *handoff = NULL;
+		float handoffDist = HANDOFF_DIST;
+		for(const FingerTouch &old : touches) {
+			if(keptIds.count(old.id))
+				continue;
+			auto member = idMembers.find(old.id);
+			if(member == idMembers.end() || member->second == sources[i].first)
+				continue;
+			float d = old.tip.distance(touch.tip);
+			if(d <= handoffDist) {
+				handoff = &old;
+				handoffDist = d;
+			}
+		}
+		if(handoff) {
+			touch.id = handoff->id;
+			touch.touchAge = max(touch.touchAge, handoff->touchAge + 1);
+		} else {
+			touch.id = nextTouchId++;
+		}
+		keptIds.insert(touch.id);
+		newIdMap[sources[i]] = touch.id;
+	}
+
+	idMap.swap(newIdMap);
+	return newTouches;
+}
+
+void HybridTouchTracker::threadedFunction() {
+	fps.fps = 30; // estimated fps
+
+	bool depthZones;
+	{
+		ofScopedLock lock(zoneLock);
+		depthZones = splitDepth > 0;
+	}
+	if(depthZones)
+		updateDepthZones();
+	else
+		applyZones();
+	for(auto &m : members) {
+		m.tracker->startThread();
+	}
+
+	while(isThreadRunning()) {
+		bool zonesDue;
+		{
+			ofScopedLock lock(zoneLock);
+			zonesDue = splitDepth > 0 && ofGetElapsedTimeMillis() - lastZoneUpdate >= ZONE_UPDATE_INTERVAL;
+		}
+		if(zonesDue)
+			updateDepthZones();
+
+		/* Only the latest frame from each tracker matters; the merged frame takes the newest timestamps */
+		bool updated = false;
+		uint64_t sensorTimestamp = 0, captureTime = 0;
+		for(auto &m : members) {
+			m.channel->drain([&](const TouchFrame &frame) {
+				m.touches.assign(frame.touches.begin(), frame.touches.end());
+				if(frame.captureTime >= captureTime) {
+					sensorTimestamp = frame.sensorTimestamp;
+					captureTime = frame.captureTime;
+				}
+				updated = true;
+			});
+		}
+		if(!updated) {
+			ofSleepMillis(2);
+			continue;
+		}
+		fps.update();
+
+		vector<FingerTouch> finalTouches = mergeTouches();
+		{
+			ofScopedLock lock(touchLock);
+			touches = finalTouches;
+			touchesUpdated = true;
+		}
+		deliverTouches(sensorTimestamp, captureTime);
+	}
+
+	for(auto &m : members) {
+		m.tracker->stopThread();
+		m.tracker->waitForThread();
+	}
+}
+
+int HybridTouchTracker::addTracker(TouchTracker *tracker, const string &name) {
+	Member member;
+	member.tracker = tracker;
+	member.channel = tracker->openChannel();
+	member.name = name;
+	members.push_back(member);
+	return members.size() - 1;
+}
+
+bool HybridTouchTracker::setZones(const vector<int> &tileOwners) {
+	const int numTiles = background.getTileCols() * background.getTileRows();
+	if(tileOwners.size() != numTiles) {
+		ofLogError("HybridTouchTracker") << "setZones: " << tileOwners.size() << " tile owners for " << numTiles << " tiles";
+		return false;
+	}
+	for(int owner : tileOwners) {
+		if(owner < 0 || owner >= members.size()) {
+			ofLogError("HybridTouchTracker") << "setZones: no tracker " << owner;
+			return false;
+		}
+	}
+
+	{
+		ofScopedLock lock(zoneLock);
+		this->tileOwners.assign(tileOwners.begin(), tileOwners.end());
+		splitDepth = 0;
+	}
+	if(isThreadRunning())
+		applyZones();
+	return true;
+}
+
+bool HybridTouchTracker::setDepthZones(float splitDepth, int nearTracker, int farTracker) {
+	if(nearTracker < 0 || nearTracker >= members.size() || farTracker < 0 || farTracker >= members.size()) {
+		ofLogError("HybridTouchTracker") << "setDepthZones: no tracker " << nearTracker << " or " << farTracker;
+		return false;
+	}
+
+	ofScopedLock lock(zoneLock);
+	this->splitDepth = splitDepth;
+	nearMember = nearTracker;
+	farMember = farTracker;
+	lastZoneUpdate = 0; // update on the next frame
+	return true;
+}
+
+void HybridTouchTracker::drawDebug(float x, float y) {
+	const int tileSize = BackgroundUpdaterThread::tileSize;
+	const int tileCols = background.getTileCols();
+
+	{
+		ofScopedLock lock(zoneLock);
+		uint8_t *zonePx = zoneIm.getPixels();
+		for(int py=0; py<h; py++) {
+			for(int px=0; px<w; px++) {
+				const ofColor &color = ZONE_COLORS[tileOwners[(py / tileSize) * tileCols + px / tileSize] % NUM_ZONE_COLORS];
+				uint8_t *rgb = zonePx + 3*(py*w + px);
+				rgb[0] = color.r / 2;
+				rgb[1] = color.g / 2;
+				rgb[2] = color.b / 2;
+			}
+		}
+	}
+	zoneIm.reloadTexture();
+	zoneIm.draw(x, y);
+
+	const int lh = 13;
+	drawText("Zones", x, y, HAlign::left, VAlign::top);
+	for(int m=0; m<members.size(); m++) {
+		ofPushStyle();
+		ofSetColor(ZONE_COLORS[m % NUM_ZONE_COLORS]);
+		drawText(ofVAArgsToString("%d: %s (%.1f FPS)", m, members[m].name.c_str(), members[m].tracker->fps.fps),
+			x, y + lh*(m+1), HAlign::left, VAlign::top);
+		ofPopStyle();
+	}
+}
+
+/* update() function called from the main thread */
+bool HybridTouchTracker::update(vector<FingerTouch> &retTouches) {
+	fps.tick();
+
+	ofScopedLock lock(touchLock);
+	if(touchesUpdated) {
+		retTouches = touches;
+		touchesUpdated = false;
+		return true;
+	} else {
+		return false;
+	}
+}
+
+HybridTouchTracker::~HybridTouchTracker() {
+	stopThread();
+	waitForThread();
+	for(auto &m : members) {
+		delete m.tracker;
+	}
+}
+
+HybridTouchTracker::HybridTouchTracker(ofxKinect2::DepthStream &depthStream, ofxKinect2::IrStream &irStream, BackgroundUpdaterThread &background)
+: TouchTracker(depthStream, irStream, background) {
+	tileOwners.assign(background.getTileCols() * background.getTileRows(), 0);
+	splitDepth = 0;
+	nearMember = farMember = 0;
+	lastZoneUpdate = 0;
+
+	zoneIm.allocate(w, h, OF_IMAGE_COLOR);
+}
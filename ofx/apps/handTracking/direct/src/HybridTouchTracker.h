@@ -0,0 +1,68 @@
+//
+//  HybridTouchTracker.h
+//  Splits the surface into zones, each handled by its own touch tracker.
+//
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxKinect2.h"
+
+#include "TouchTracker.h"
+
+/* Runs several trackers side by side, each restricted to its own zones of the surface (background tiles),
+   and merges their touches into a single ID space. Zones can follow the background depth: near the sensor,
+   noise is low and fingers are large, so a cheap tracker is good enough; far away, the accurate one is needed.
+
+   Each tracker processes its zones plus an overlap band, so that hands crossing a boundary are seen whole,
+   but only the touches whose tips lie in its own zones are kept. */
+class HybridTouchTracker : public TouchTracker {
+protected:
+	void threadedFunction();
+
+private:
+	struct Member {
+		TouchTracker *tracker;
+		TouchChannel *channel; // every touch frame from the tracker
+		string name;
+		vector<FingerTouch> touches; // latest touches from the tracker, in its own ID space
+	};
+	vector<Member> members;
+
+	/* Zones */
+	ofMutex zoneLock;
+	vector<int> tileOwners; // member index of each background tile
+	float splitDepth; // mm; zones follow the background depth if positive
+	int nearMember, farMember;
+	uint64_t lastZoneUpdate; // ms; these zone settings are all guarded by zoneLock
+	void updateDepthZones();
+	void applyZones();
+
+	/* Touch IDs */
+	map<pair<int, int>, int> idMap; // (member, member touch ID) -> touch ID
+	vector<FingerTouch> mergeTouches();
+
+	/* Debugging */
+	ofImage zoneIm;
+
+public:
+	HybridTouchTracker(ofxKinect2::DepthStream &depthStream, ofxKinect2::IrStream &irStream, BackgroundUpdaterThread &background);
+	virtual ~HybridTouchTracker();
+
+	/* Takes ownership of the tracker, which must not have been started. Add every tracker before setting zones
+	   and before startThread(); they are started and stopped along with the hybrid. Returns the tracker's index. Until zones
+	   are set, the first tracker handles the whole surface. */
+	int addTracker(TouchTracker *tracker, const string &name);
+
+	/* Hand each background tile to a tracker, by index. Returns false, leaving the zones as they were, unless
+	   there is one owner per tile and every owner is a tracker's index. */
+	bool setZones(const vector<int> &tileOwners);
+	/* Hand the tiles whose background is nearer than splitDepth (mm) to one tracker, and the rest, including
+	   tiles without any background, to the other. The zones follow the background as it changes. Returns false,
+	   leaving the zones as they were, if either index isn't a tracker's. */
+	bool setDepthZones(float splitDepth, int nearTracker, int farTracker);
+
+	virtual void drawDebug(float x, float y);
+	virtual bool update(vector<FingerTouch> &retTouches);
+};
@@ -7,8 +7,12 @@
 //
 
 #include "IRDepthTouchTracker.h"
+#include "GuardBand.h"
 #include "TextUtils.h"
 
+#include <random>
+#include <thread>
+
 /* Tweakable parameters */
 /// Edge/fence parameters
 const int edge_depthrel_dist = 2;	// px: distance range to consider relative-depth (smoothness) fence
@@ -31,45 +35,163 @@ const int finger_min_size = 10; // px: minimum size of finger blob
 const int finger_min_dist = 5; // px: finger minimum length (distance); shorter "fingers" are pruned
 const int tip_max_dist = 30; // px: maximum flood distance for tip fill (if exceeded, rollback)
 
+/// coarse segmentation parameters
+const int coarse_scale = 4; // px: side of the max-pooled cells used to find the regions which can hold arms
+const int region_margin = tip_max_dist + 2; // px: how far the floods can reach past an arm's lowconf cells
+const int canny_margin = 4; // px: context around the flood reach, so that Canny's border effects don't matter
+
+/// idle fast path
+const int idle_foreground_pixels = arm_min_size; // px: with fewer midconf + highconf pixels than this no arm can be found, so the frame is idle
+
+/// cascade: a cheap threshold over every tile decides where the full tracker runs
+const int cascade_min_diff = 12; // mm: candidate pixels are at least midconf high
+const int cascade_min_pixels = 8; // px: candidate pixels a tile needs to be kept; fewer are speckle
+const int cascade_margin = region_margin + canny_margin; // px: tiles within this distance of a kept tile go along, so the floods can reach them
+const int cascade_hold_frames = 15; // frames: kept tiles stay kept this long, so that moving hands don't recompute the tiles they leave
+
+/// frame-budget governor: degradations, in the order they are applied
+const float frame_budget = 1000.0f / 30; // ms: one Kinect frame, for the whole frame serially or for the slowest stage when pipelined
+#define QUALITY_NO_DEBUG 1 // skip the blob colors, which are only used for display
+#define QUALITY_TIGHT_ROI 2 // build edges in tighter regions; long fingertips may leak past them and be rejected
+#define QUALITY_HALF_RES_EDGES 3 // find IR edges on a half-resolution image
+const int tight_region_margin = tip_max_dist / 2 + 2; // px
+
+/// pipeline statistics
+const int stats_max_frames = 4096; // latencies of the most recent frames kept for getStats()
+const int stats_warmup_frames = 30; // frames after a reset in which buffers may still grow to their working size
+
+/// incremental processing parameters
+const int tile_depth_noise = 4; // mm: depth change a tile must see before it is recomputed
+const int tile_ir_noise = 256; // IR change a tile must see before it is recomputed
+const int full_refresh_interval = 30; // frames: recompute every tile at least this often
+
 /// postprocessing settings
 // n.b. no smoothing for tip now (it is very stable with IR data)
 const float smooth_tip_alpha = 1.0; // higher = less smoothing
 const float smooth_touchz_alpha = 0.5;
+const float track_gate = 50; // px: furthest a touch may move between frames and keep its ID
+const int optimal_cluster_size = 6; // touches; largest cluster side matched optimally, when enabled
 
 const int tipavg_window = 1; // number of highest-distance pixels to average for tip position averaging
 const int touchz_window = 8; // number of highest-distance pixels to average for touchz detection
 const float touchz_enter = 0.5; // below this avg. z, a touch is considered active
 const float touchz_exit = 2.5; // above this avg. z, a touch is considered inactive (must be higher than touchz_enter)
 
-/* diffPx operators and definitions */
-#define ZONE(x) ((x) & 0xffff0000)
-#define DIFF(x) ((x) & 0x0000ffff)
-#define ZONE_ERROR 0x00000000
-#define ZONE_NOISE 0xff000000
-#define ZONE_LOW   0xff400000
-#define ZONE_MID   0xff800000
-#define ZONE_HIGH  0xffc00000
-
-#define BLOB_REJECTED 0x00020000
-#define BLOB_VISITED 0x00010000
+/// touch-down anticipation: a finger closing in on the surface is announced as imminent before it is touched
+const float smooth_touchz_velocity_alpha = 0.5;
+const float anticipate_horizon = 0.05; // s: announce a touch-down this far ahead of its estimated contact
+const float anticipate_min_speed = 20; // mm/s: fingers descending slower than this are hovering
+const float anticipate_max_z = 6; // mm: fingers higher than this are not about to touch
+
+/* classPx operators and definitions: zone in the low bits, edge flags above */
+#define ZONE(x) ((x) & 0x07)
+#define ZONE_ERROR 0
+#define ZONE_NOISE 1
+#define ZONE_LOW   2
+#define ZONE_MID   3
+#define ZONE_HIGH  4
+#define EDGE_IR       0x08
+#define EDGE_DEPTHREL 0x10
+#define EDGE_DEPTHABS 0x20
+
+/* blobPx operators and definitions. The zone of the flood which claimed a pixel is kept in the top bits,
+   so that claimed pixels can be compared by zone directly. The low byte holds the flood distance. */
+#define BLOB_ZONE(zone) ((zone) << 13)
+#define BLOB_DIST(x) ((x) & 0xff)
+#define BLOB_VISITED 0x0100
+#define BLOB_REJECTED 0x0200
+#define BLOB_REASON(reason) (((reason) & 0x7) << 10)
+
+/* Merge overlapping regions into their bounding boxes, so that no pixel goes through Canny twice */
+static void mergeRegions(vector<IRDepthRegion> &regions) {
+	bool merged = true;
+	while(merged) {
+		merged = false;
+		for(int i=0; i<regions.size(); i++) {
+			for(int j=regions.size()-1; j>i; j--) {
+				IRDepthRegion &a = regions[i], &b = regions[j];
+				if(a.x0 >= b.x1 || b.x0 >= a.x1 || a.y0 >= b.y1 || b.y0 >= a.y1)
+					continue;
+				a.x0 = min(a.x0, b.x0); a.y0 = min(a.y0, b.y0);
+				a.x1 = max(a.x1, b.x1); a.y1 = max(a.y1, b.y1);
+				regions.erase(regions.begin() + j);
+				merged = true;
+			}
+		}
+	}
+}
 
 #pragma region Edge Map
-void IRDepthTouchTracker::buildEdgeImage() {
+void IRDepthTouchTracker::buildEdgeImage(IRDepthFrame &frame) {
 	const int n = w * h;
+	const int tileSize = BackgroundUpdaterThread::tileSize;
 	
-	uint32_t *diffPx = (uint32_t *)diffIm[front].getPixels();
-	uint32_t *edgePx = (uint32_t *)edgeIm[front].getPixels();
-	fill_n(edgePx, n, 0);
+	const uint16_t *diffPx = &frame.diffPlane[0];
+	uint8_t *classPx = &frame.classPlane[0];
+
+	/* Edges are only needed where the floods can go, i.e. inside the regions,
+	   and only need rebuilding in tiles whose edges have gone stale. */
+	edgeTiles.clear();
+	edgeRects.clear();
+	for(const auto &region : frame.regions) {
+		for(int ty=region.y0 / tileSize; ty<=(region.y1 - 1) / tileSize; ty++) {
+			for(int tx=region.x0 / tileSize; tx<=(region.x1 - 1) / tileSize; tx++) {
+				int t = ty*tileCols + tx;
+				if(tileEdgesValid[t])
+					continue;
+				tileEdgesValid[t] = 1;
+				edgeTiles.push_back(t);
+
+				/* Give Canny some context around the tile */
+				IRDepthRegion tile = tileBounds(t);
+				IRDepthRegion rect = {
+					max(tile.x0 - canny_margin, 0), max(tile.y0 - canny_margin, 0),
+					min(tile.x1 + canny_margin, w), min(tile.y1 + canny_margin, h)
+				};
+				edgeRects.push_back(rect);
+			}
+		}
+	}
+	if(edgeTiles.empty())
+		return;
+	mergeRegions(edgeRects);
 
 	/* Build IR canny map */
-	uint16_t *irPx = irStream.getPixelsRef().getPixels();
+	const uint16_t *irPx = &frame.ir[0];
 	uint8_t *ircannyPx = irCanny.getPixels();
-	for(int i=0; i<n; i++) {
-		ircannyPx[i] = irPx[i] / 64;
-	}
+	fill_n(ircannyPx, n, 0);
 	cv::Mat irCannyMat(irCanny.getCvImage());
-	/* Edge finding, lightly tuned parameters */
-	cv::Canny(irCannyMat, irCannyMat, 4000, 8000, 7, true);
+	for(const auto &rect : edgeRects) {
+		for(int y=rect.y0; y<rect.y1; y++) {
+			for(int i=y*w+rect.x0; i<y*w+rect.x1; i++) {
+				ircannyPx[i] = irPx[i] / 64;
+			}
+		}
+		const int rw = rect.x1 - rect.x0, rh = rect.y1 - rect.y0;
+		cv::Mat rectMat = irCannyMat(cv::Rect(rect.x0, rect.y0, rw, rh));
+		if(frame.quality < QUALITY_HALF_RES_EDGES) {
+			/* Edge finding, lightly tuned parameters */
+			AllocationCounter::Pause pause;
+			cv::Canny(rectMat, rectMat, 4000, 8000, 7, true);
+			continue;
+		}
+
+		/* Degraded: find the edges one pyramid level down, and scale them back up */
+		const int hw = (rw + 1) / 2, hh = (rh + 1) / 2;
+		cv::Mat halfMat = irCannyHalf(cv::Rect(0, 0, hw, hh));
+		{
+			AllocationCounter::Pause pause;
+			cv::resize(rectMat, halfMat, halfMat.size(), 0, 0, cv::INTER_AREA);
+			cv::Canny(halfMat, halfMat, 4000, 8000, 7, true);
+		}
+		for(int y=0; y<rh; y++) {
+			const uint8_t *halfRow = halfMat.ptr<uint8_t>(y / 2);
+			uint8_t *row = ircannyPx + (rect.y0 + y)*w + rect.x0;
+			for(int x=0; x<rw; x++) {
+				row[x] = halfRow[x / 2];
+			}
+		}
+	}
 
 	/* Mark significant pixels (IR pixels that will be holefilled). */
 	/* Currently, all pixels are considered significant. */
@@ -81,99 +203,110 @@ void IRDepthTouchTracker::buildEdgeImage() {
 	fillIrCannyHoles();
 
 	/* Build final edge map */
-	for(int i=0; i<n; i++) {
-		if(ircannyPx[i])
-			edgePx[i] |= 0xff000000 | (ircannyPx[i] << 16);
+	for(int t : edgeTiles) {
+		IRDepthRegion tile = tileBounds(t);
+		for(int y=tile.y0; y<tile.y1; y++) {
+			for(int i=y*w+tile.x0; i<y*w+tile.x1; i++) {
+				classPx[i] = ZONE(classPx[i]) | (ircannyPx[i] ? EDGE_IR : 0);
+			}
+		}
 	}
 
 	/* Depth relative edges */
 	{
 		const int WIN = edge_depthrel_dist; // flatness check window size
-		for(int i=w*WIN; i<n-w*WIN; i++) {
-			int myval = DIFF(diffPx[i]);
-			for(int dy=-1; dy<=1; dy++) {
-				for(int dx=-1; dx<=1; dx++) {
-					int diffval = diffPx[i+dx*WIN+dy*WIN*w];
-					// Reject if the other pixel differs greatly in diff value
-					if(abs(myval - DIFF(diffval)) > edge_depthrel_thresh) {
-						goto add_depthedge;
+		const int lo = w*WIN+WIN, hi = n-w*WIN-WIN; // stay in bounds of the window
+		for(int t : edgeTiles) {
+			IRDepthRegion tile = tileBounds(t);
+			for(int y=tile.y0; y<tile.y1; y++) {
+				for(int i=max(y*w+tile.x0, lo); i<min(y*w+tile.x1, hi); i++) {
+					int myval = diffPx[i];
+					for(int dy=-1; dy<=1; dy++) {
+						for(int dx=-1; dx<=1; dx++) {
+							int diffval = diffPx[i+dx*WIN+dy*WIN*w];
+							// Reject if the other pixel differs greatly in diff value
+							if(abs(myval - diffval) > edge_depthrel_thresh) {
+								goto add_depthedge;
+							}
+						}
 					}
+					continue;
+			add_depthedge:
+					classPx[i] |= EDGE_DEPTHREL;
 				}
 			}
-			continue;
-	add_depthedge:
-			edgePx[i] |= 0xff00ff00;
 		}
 	}
 
 	/* Depth absolute edges */
 	{
 		const int WIN = edge_depthabs_dist; // flatness check window size
-		for(int i=w*WIN; i<n-w*WIN; i++) {
-			/* Check that nearby pixels are also near the background.
-			This check eliminates gradiated pixels on the edges of arms, knuckles, etc. */
-			for(int dy=-1; dy<=1; dy++) {
-				for(int dx=-1; dx<=1; dx++) {
-					int diffval = diffPx[i+dx*WIN+dy*WIN*w];
-					// Reject if the other pixel is too high off the ground
-					if(DIFF(diffval) > edge_depthabs_thresh) {
-						goto add_depthabs;
+		const int lo = w*WIN+WIN, hi = n-w*WIN-WIN;
+		for(int t : edgeTiles) {
+			IRDepthRegion tile = tileBounds(t);
+			for(int y=tile.y0; y<tile.y1; y++) {
+				for(int i=max(y*w+tile.x0, lo); i<min(y*w+tile.x1, hi); i++) {
+					/* Check that nearby pixels are also near the background.
+					This check eliminates gradiated pixels on the edges of arms, knuckles, etc. */
+					for(int dy=-1; dy<=1; dy++) {
+						for(int dx=-1; dx<=1; dx++) {
+							int diffval = diffPx[i+dx*WIN+dy*WIN*w];
+							// Reject if the other pixel is too high off the ground
+							if(diffval > edge_depthabs_thresh) {
+								goto add_depthabs;
+							}
+						}
 					}
+					continue;
+			add_depthabs:
+					classPx[i] |= EDGE_DEPTHABS;
 				}
 			}
-			continue;
-	add_depthabs:
-			edgePx[i] |= 0xff0000ff;
 		}
 	}
 }
 
-void IRDepthTouchTracker::fillIrCannyHoles() {
+/* 255 = insignificant canny
+   224 = unvisited significant canny
+   208 = seen, unvisited significant canny
+   192 = visited significant canny
+   160 = fill candidate
+   128 = filled significant canny
+   0 = no canny */
+template<typename Stride>
+static void fillCannyHoles(uint8_t *ircannypx, Stride w, int h, vector<int> &queue) {
 	const int n = w * h;
-	/* 255 = insignificant canny
-	   224 = unvisited significant canny
-	   208 = seen, unvisited significant canny
-	   192 = visited significant canny
-	   160 = fill candidate
-	   128 = filled significant canny
-	   0 = no canny */
-	uint8_t *ircannypx = irCanny.getPixels();
 
 	/* Find significant pixels and fill outwards */
-	queue<int> queue;
-
 	for(int idx=0; idx<n; idx++) {
 		if(ircannypx[idx] != 224)
 			continue;
 
-		queue.push(idx);
+		queue.clear();
+		queue.push_back(idx);
+		int qhead = 0;
 
 		ircannypx[idx] = 208;
-		while(!queue.empty()) {
-			int curidx = queue.front();
-			queue.pop();
+		while(qhead < queue.size()) {
+			int curidx = queue[qhead++];
 			int curpx = ircannypx[curidx];
 
 			if(curpx == 208) {
 				ircannypx[curidx] = 192;
 			}
 
-			int y = curidx / w;
-			int x = curidx % w;
 			int found = 0;
 
-			// Find unvisited significant neighbours
-#define TEST(dx,dy) do { int xx = x+dx, yy = y+dy; \
-			if(0 <= xx && xx < w && 0 <= yy && yy < h) { \
-				int otheridx = curidx + dy*w + dx; \
-				if(ircannypx[otheridx] <= 192) \
-					continue; /* must be unvisited, real canny pixels */ \
-				found++; \
-				if(ircannypx[otheridx] != 224) \
-					continue; /* already visited, or not significant */ \
-				queue.push(otheridx); \
-				ircannypx[otheridx] = 208; \
-			} \
+			// Find unvisited significant neighbours (the guard band keeps these in bounds)
+#define TEST(dx,dy) do { \
+			int otheridx = curidx + dy*w + dx; \
+			if(ircannypx[otheridx] <= 192) \
+				continue; /* must be unvisited, real canny pixels */ \
+			found++; \
+			if(ircannypx[otheridx] != 224) \
+				continue; /* already visited, or not significant */ \
+			queue.push_back(otheridx); \
+			ircannypx[otheridx] = 208; \
 			} while(0)
 			/* Eight-way neighbours, to cross diagonals */
 			TEST(-1,-1);TEST(-1,0);TEST(-1,1);TEST(0,-1);TEST(0,1);TEST(1,-1);TEST(1,0);TEST(1, 1);
@@ -188,14 +321,12 @@ void IRDepthTouchTracker::fillIrCannyHoles() {
 				}
 			} else if(!found) {
 				/* Mark all neighbours as fill candidates */
-#define TEST(dx,dy) do { int xx = x+dx, yy = y+dy; \
-			if(0 <= xx && xx < w && 0 <= yy && yy < h) { \
-				int otheridx = curidx + dy*w + dx; \
-				if(ircannypx[otheridx] != 0) \
-					continue; /* must be blank pixel */ \
-				queue.push(otheridx); \
-				ircannypx[otheridx] = 160; \
-			} \
+#define TEST(dx,dy) do { \
+			int otheridx = curidx + dy*w + dx; \
+			if(ircannypx[otheridx] != 0) \
+				continue; /* must be blank pixel */ \
+			queue.push_back(otheridx); \
+			ircannypx[otheridx] = 160; \
 			} while(0)
 			/* Eight-way neighbours, to cross diagonals */
 			TEST(-1,-1);TEST(-1,0);TEST(-1,1);TEST(0,-1);TEST(0,1);TEST(1,-1);TEST(1,0);TEST(1, 1);
@@ -204,45 +335,481 @@ void IRDepthTouchTracker::fillIrCannyHoles() {
 		}
 	}
 }
+
+void IRDepthTouchTracker::fillIrCannyHoles() {
+	uint8_t *ircannypx = irCanny.getPixels();
+
+	/* The image border is outside the tracked area (see detectTouches): fence it off with a guard band
+	   (128 is neither significant nor blank), and clear it afterwards. */
+	fillGuardBand<uint8_t>(ircannypx, w, h, 128);
+
+	if(w == kinect2_depth_width)
+		fillCannyHoles(ircannypx, FixedStride<kinect2_depth_width>(w), h, cannyQueue);
+	else
+		fillCannyHoles(ircannypx, RuntimeStride(w), h, cannyQueue);
+
+	fillGuardBand<uint8_t>(ircannypx, w, h, 0);
+}
 #pragma endregion
 
-void IRDepthTouchTracker::buildDiffImage() {
-	const int n = w * h;
+#pragma region Incremental Processing
+IRDepthRegion IRDepthTouchTracker::tileBounds(int tile) const {
+	const int tileSize = BackgroundUpdaterThread::tileSize;
+	const int x0 = (tile % tileCols) * tileSize, y0 = (tile / tileCols) * tileSize;
+	IRDepthRegion bounds = {x0, y0, min(x0 + tileSize, w), min(y0 + tileSize, h)};
+	return bounds;
+}
+
+/* Decide which tiles need their diff (and zones) recomputed: those whose depth or IR have changed beyond
+   noise since they were last computed, or whose background has changed. Inputs are compared against the
+   frame each tile was last computed from, so slow drift still adds up to a change. */
+void IRDepthTouchTracker::findDirtyTiles(IRDepthFrame &frame) {
+	const uint16_t *depthPx = &frame.depth[0];
+	const uint16_t *irPx = &frame.ir[0];
+	const float *bgmean = background.getBackgroundMean().getPixels();
+	uint16_t *refDepthPx = &refDepth[0];
+	uint16_t *refIrPx = &refIr[0];
+	const int numTiles = tileCols * tileRows;
+
+	bool refresh = !incremental || framesSinceRefresh >= full_refresh_interval || lastProcessedFrame < 0;
+	framesSinceRefresh = refresh ? 0 : framesSinceRefresh + 1;
+
+	int dirtyTiles = 0;
+	for(int t=0; t<numTiles; t++) {
+		IRDepthRegion tile = tileBounds(t);
+		const int bgGeneration = background.getTileGeneration(t);
+		bool dirty = refresh || bgGeneration != tileBgGenerations[t];
+		for(int y=tile.y0; y<tile.y1 && !dirty; y++) {
+			for(int i=y*w+tile.x0; i<y*w+tile.x1; i++) {
+				int depth = depthPx[i], refDepth = refDepthPx[i];
+				if(depth == 0) {
+					/* Dropouts are sensor noise: keep what the tile was computed from */
+					continue;
+				} else if(refDepth == 0) {
+					dirty = bgmean[i] != 0 && fabs(bgmean[i] - depth) > tile_depth_noise;
+				} else {
+					dirty = abs(depth - refDepth) > tile_depth_noise;
+				}
+				if(dirty || abs(irPx[i] - refIrPx[i]) > tile_ir_noise) {
+					dirty = true;
+					break;
+				}
+			}
+		}
+
+		tileDirty[t] = dirty;
+		if(!dirty)
+			continue;
+		dirtyTiles++;
+		tileBgGenerations[t] = bgGeneration;
+		int candidatePixels = 0;
+		for(int y=tile.y0; y<tile.y1; y++) {
+			for(int i=y*w+tile.x0; i<y*w+tile.x1; i++) {
+				if(depthPx[i]) {
+					refDepthPx[i] = depthPx[i];
+					refIrPx[i] = irPx[i];
+					if(bgmean[i] - depthPx[i] >= cascade_min_diff)
+						candidatePixels++;
+				}
+			}
+		}
+		tileCandidatePixels[t] = candidatePixels;
+	}
+
+	/* Cascade: the full tracker only sees the tiles kept by the cheap stage. Tiles entering or leaving that set
+	   are recomputed, as their planes hold the other state. */
+	findCandidateTiles(frame);
+	for(int t=0; t<numTiles; t++) {
+		if(tileCandidate[t] != tileWasCandidate[t] && !tileDirty[t]) {
+			tileDirty[t] = 1;
+			dirtyTiles++;
+		}
+	}
+	tileWasCandidate.assign(tileCandidate.begin(), tileCandidate.end());
+
+	frame.dirtyTiles = dirtyTiles;
+
+	/* Edges depend on each pixel's surroundings, so they go stale within a tile of any dirty tile */
+	for(int t=0; t<numTiles; t++) {
+		if(!tileDirty[t])
+			continue;
+		const int tx = t % tileCols, ty = t / tileCols;
+		for(int y=max(ty-1, 0); y<=min(ty+1, tileRows-1); y++) {
+			for(int x=max(tx-1, 0); x<=min(tx+1, tileCols-1); x++) {
+				tileEdgesValid[y*tileCols + x] = 0;
+			}
+		}
+	}
+}
+#pragma endregion
+
+/* Pick the tiles the full tracker runs on: those in the tracker's zone, narrowed down by the cascade if it is on.
+   The cheap stage of the cascade: the threshold counts made by findDirtyTiles act as a tile-sized boxcar over
+   the candidate mask. Tiles with enough candidates, and every tile within cascade_margin of them, are kept
+   until they have gone cascade_hold_frames without being picked again. */
+void IRDepthTouchTracker::findCandidateTiles(IRDepthFrame &frame) {
+	const int tileSize = BackgroundUpdaterThread::tileSize;
+	const int numTiles = tileCols * tileRows;
+	const int margin = (cascade_margin + tileSize - 1) / tileSize;
+
+	if(!cascade) {
+		/* Without the cascade, every tile in the tracker's zone is kept */
+		int candidateTiles = 0;
+		for(int t=0; t<numTiles; t++) {
+			tileCandidate[t] = zoneTiles.empty() || zoneTiles[t];
+			candidateTiles += tileCandidate[t];
+		}
+		frame.candidateTiles = candidateTiles;
+		return;
+	}
+
+	for(int t=0; t<numTiles; t++) {
+		tileCandidateAge[t]++;
+	}
+	for(int t=0; t<numTiles; t++) {
+		if(tileCandidatePixels[t] < cascade_min_pixels)
+			continue;
+		const int tx = t % tileCols, ty = t / tileCols;
+		for(int y=max(ty-margin, 0); y<=min(ty+margin, tileRows-1); y++) {
+			fill_n(&tileCandidateAge[y*tileCols + max(tx-margin, 0)], min(tx+margin, tileCols-1) - max(tx-margin, 0) + 1, 0);
+		}
+	}
 
-	uint16_t *depthPx = depthStream.getPixelsRef().getPixels();
-	uint32_t *diffPx = (uint32_t *)diffIm[front].getPixels();
+	int candidateTiles = 0;
+	for(int t=0; t<numTiles; t++) {
+		tileCandidate[t] = tileCandidateAge[t] <= cascade_hold_frames && (zoneTiles.empty() || zoneTiles[t]);
+		candidateTiles += tileCandidate[t];
+	}
+	frame.candidateTiles = candidateTiles;
+}
+
+/* Classify one band of tiles (a tile row): zone and diff for the dirty tiles, carried over from the last processed
+   frame for the clean ones. When fused, each tile's background pixels are updated right after it is classified,
+   while its inputs are still in cache. */
+void IRDepthTouchTracker::buildDiffBand(int ty) {
+	const uint64_t startTime = ofGetElapsedTimeMicros();
+	const int tileSize = BackgroundUpdaterThread::tileSize;
+
+	IRDepthFrame &frame = *diffFrame;
+	const IRDepthFrame *last = diffLast;
+	const uint16_t *depthPx = &frame.depth[0];
+	uint16_t *diffPx = &frame.diffPlane[0];
+	uint8_t *classPx = &frame.classPlane[0]; // edge flags are added by buildEdgeImage
+	/* Without a last frame, findDirtyTiles has marked every tile dirty */
+	const uint16_t *lastDiffPx = last ? &last->diffPlane[0] : NULL;
+	const uint8_t *lastClassPx = last ? &last->classPlane[0] : NULL;
 
 	const float *bgmean = background.getBackgroundMean().getPixels();
 	const float *bgstdev = background.getBackgroundStdev().getPixels();
 
-	/* Update diff image */
-	for(int i=0; i<n; i++) {
-		/* Update diff image */
-		float diff;
-		float z;
-		if(depthPx[i]) {
-			diff = bgmean[i] - depthPx[i];
-			z = diff / bgstdev[i];
-		} else {
-			diff = 0;
-			z = 0;
+	const int y0 = ty * tileSize, y1 = min(y0 + tileSize, h);
+	for(int tx=0; tx<tileCols; tx++) {
+		const int t = ty*tileCols + tx;
+		for(int y=y0; y<y1; y++) {
+			const int segStart = y*w + tx*tileSize, segEnd = y*w + min((tx+1)*tileSize, w);
+			if(tileDirty[t] && !tileCandidate[t]) {
+				/* Left out by the cascade: nothing can be found or flooded here */
+				fill(classPx + segStart, classPx + segEnd, ZONE_ERROR);
+				fill(diffPx + segStart, diffPx + segEnd, 0);
+			} else if(tileDirty[t]) {
+				for(int i=segStart; i<segEnd; i++) {
+					float diff;
+					float z;
+					if(depthPx[i]) {
+						diff = bgmean[i] - depthPx[i];
+						z = diff / bgstdev[i];
+					} else {
+						diff = 0;
+						z = 0;
+					}
+					if(bgmean[i] == 0 || ZONE_ERROR_COND) { classPx[i] = ZONE_ERROR; diffPx[i] = 0; }
+					else if(ZONE_NOISE_COND){ classPx[i] = ZONE_NOISE; diffPx[i] = (uint16_t)abs(diff); }
+					else if(ZONE_LOW_COND)	{ classPx[i] = ZONE_LOW; diffPx[i] = (uint16_t)diff; }
+					else if(ZONE_MID_COND)	{ classPx[i] = ZONE_MID; diffPx[i] = (uint16_t)diff; }
+					else					{ classPx[i] = ZONE_HIGH; diffPx[i] = (uint16_t)diff; }
+				}
+			} else {
+				/* Carry over the last processed frame, and its edges if they are still valid */
+				const uint8_t keep = tileEdgesValid[t] ? 0xff : ZONE(0xff);
+				copy(lastDiffPx + segStart, lastDiffPx + segEnd, diffPx + segStart);
+				for(int i=segStart; i<segEnd; i++) {
+					classPx[i] = lastClassPx[i] & keep;
+				}
+			}
+		}
+		if(diffUpdateBackground)
+			background.updateTile(t);
+	}
+
+	/* Record runs of arm pixels so detectTouches doesn't need to rescan the frame */
+	vector<IRDepthRun> &runs = bandRuns[ty];
+	runs.clear();
+	int foregroundPixels = 0;
+	for(int y=y0; y<y1; y++) {
+		int runStart = -1;
+		for(int i=y*w; i<(y+1)*w; i++) {
+			if(ZONE(classPx[i]) >= ZONE_MID)
+				foregroundPixels++;
+			if(ZONE(classPx[i]) == ZONE_HIGH) {
+				if(runStart < 0)
+					runStart = i;
+			} else if(runStart >= 0) {
+				IRDepthRun run = {runStart, i};
+				runs.push_back(run);
+				runStart = -1;
+			}
+		}
+		if(runStart >= 0) {
+			IRDepthRun run = {runStart, (y+1)*w};
+			runs.push_back(run);
 		}
-		// A=valid B=zone GR=diff
-		if(bgmean[i] == 0 || ZONE_ERROR_COND) diffPx[i] = ZONE_ERROR;
-		else if(ZONE_NOISE_COND)diffPx[i] = ZONE_NOISE | (uint16_t)abs(diff);
-		else if(ZONE_LOW_COND)	diffPx[i] = ZONE_LOW | (uint16_t)diff;
-		else if(ZONE_MID_COND)	diffPx[i] = ZONE_MID | (uint16_t)diff;
-		else					diffPx[i] = ZONE_HIGH | (uint16_t)diff;
 	}
+	bandForeground[ty] = foregroundPixels;
+	bandMicros[ty] = ofGetElapsedTimeMicros() - startTime;
 }
 
+void IRDepthTouchTracker::buildDiffImage(IRDepthFrame &frame, const IRDepthFrame *last) {
+	diffFrame = &frame;
+	diffLast = last;
+	diffUpdateBackground = fused && background.beginExternalFrame(&frame.depth[0]);
+	if(fused) {
+		/* Only capture this, so the std::function doesn't need to allocate */
+		pool.parallelFor(tileRows, [this](int ty) {
+			AllocationCounter::Scope countScope(prepareAllocations);
+			buildDiffBand(ty);
+		});
+	} else {
+		for(int ty=0; ty<tileRows; ty++) {
+			buildDiffBand(ty);
+		}
+	}
+	if(diffUpdateBackground)
+		background.endExternalFrame();
+	frame.backgroundTime = diffUpdateBackground ? background.getLastPassTime() : 0;
+
+	const uint64_t startTime = ofGetElapsedTimeMicros();
+	vector<IRDepthRun> &highRuns = frame.highRuns;
+	highRuns.clear();
+	int foregroundPixels = 0;
+	for(int ty=0; ty<tileRows; ty++) {
+		highRuns.insert(highRuns.end(), bandRuns[ty].begin(), bandRuns[ty].end());
+		foregroundPixels += bandForeground[ty];
+	}
+	frame.idle = foregroundPixels < idle_foreground_pixels;
+
+	/* Bands may run in parallel: count the time spent on each, less the background's share */
+	uint64_t micros = ofGetElapsedTimeMicros() - startTime;
+	for(int ty=0; ty<tileRows; ty++) {
+		micros += bandMicros[ty];
+	}
+	frame.diffTime = micros / 1000.0f - frame.backgroundTime;
+}
+
+/* Fused mode, on frames which aren't processed: the background still has to see them */
+void IRDepthTouchTracker::updateBackgroundOnly(IRDepthFrame &frame) {
+	frame.backgroundTime = 0;
+	if(background.beginExternalFrame(&frame.depth[0])) {
+		pool.parallelFor(tileRows, [this](int ty) {
+			for(int tx=0; tx<tileCols; tx++) {
+				background.updateTile(ty*tileCols + tx);
+			}
+		});
+		background.endExternalFrame();
+		frame.backgroundTime = background.getLastPassTime();
+	}
+	frame.diffTime = 0;
+}
+
+#pragma region Coarse Segmentation
+/* Find the regions of the frame which can hold an arm, on a max-pooled zone map.
+   Each cell is coarse_scale px square and holds the highest zone among its pixels, so every connected
+   set of zone >= LOW pixels lies within one connected set of zone >= LOW cells. Every arm, and every hand,
+   finger and tip flooded from it, therefore lies within the bounding box of one such set of cells (plus the
+   tip reach), and sets with too few highconf cells to hold an arm can be dropped outright. */
+void IRDepthTouchTracker::findRegions(IRDepthFrame &frame) {
+	static const uint8_t CELL_VISITED = 0x80;
+
+	const uint8_t *classPx = &frame.classPlane[0];
+	const int cw = (w + coarse_scale - 1) / coarse_scale;
+	const int ch = (h + coarse_scale - 1) / coarse_scale;
+	const int gw = cw + 2; // cell rows include a guard band of ZONE_ERROR cells
+
+	coarseZones.assign(gw * (ch + 2), ZONE_ERROR);
+	for(int y=0; y<h; y++) {
+		uint8_t *cellRow = &coarseZones[(y / coarse_scale + 1) * gw + 1];
+		const uint8_t *row = classPx + y*w;
+		for(int x=0; x<w; x++) {
+			uint8_t &cell = cellRow[x / coarse_scale];
+			cell = max(cell, (uint8_t)ZONE(row[x]));
+		}
+	}
+
+	vector<IRDepthRegion> &regions = frame.regions;
+	regions.clear();
+	for(int c=gw; c<gw*(ch+1); c++) {
+		if((coarseZones[c] & CELL_VISITED) || ZONE(coarseZones[c]) < ZONE_LOW)
+			continue;
+
+		int highCells = 0;
+		int cx0 = cw, cy0 = ch, cx1 = -1, cy1 = -1;
+		coarseQueue.clear();
+		coarseQueue.push_back(c);
+		coarseZones[c] |= CELL_VISITED;
+		for(int qhead=0; qhead<coarseQueue.size(); qhead++) {
+			int cur = coarseQueue[qhead];
+			if(ZONE(coarseZones[cur]) == ZONE_HIGH)
+				highCells++;
+			int cx = cur % gw - 1, cy = cur / gw - 1;
+			cx0 = min(cx0, cx); cx1 = max(cx1, cx);
+			cy0 = min(cy0, cy); cy1 = max(cy1, cy);
+
+#define TEST(d) do { \
+			int other = cur + (d); \
+			if((coarseZones[other] & CELL_VISITED) || ZONE(coarseZones[other]) < ZONE_LOW) \
+				continue; \
+			coarseZones[other] |= CELL_VISITED; \
+			coarseQueue.push_back(other); \
+		} while(0)
+			// four-way connectivity
+			TEST(-1);TEST(-gw);TEST(gw);TEST(1);
+#undef TEST
+		}
+
+		/* Each highconf cell holds at most coarse_scale^2 arm pixels */
+		if(highCells * coarse_scale * coarse_scale < arm_min_size)
+			continue;
+
+		const int margin = ((frame.quality >= QUALITY_TIGHT_ROI) ? tight_region_margin : region_margin) + canny_margin;
+		IRDepthRegion region = {
+			max(cx0 * coarse_scale - margin, 0), max(cy0 * coarse_scale - margin, 0),
+			min((cx1 + 1) * coarse_scale + margin, w), min((cy1 + 1) * coarse_scale + margin, h)
+		};
+		regions.push_back(region);
+	}
+
+	mergeRegions(regions);
+}
+#pragma endregion
+
 #pragma region Flood Filling
-void IRDepthTouchTracker::rejectBlob(const vector<unsigned> &blob, int reason) {
-	uint32_t *blobPx = (uint32_t *)blobIm[front].getPixels();
+static void rejectBlob(uint16_t *blobPx, const IRDepthPixels &blob, int reason=0) {
+	for(auto i : blob) {
+		blobPx[i & 0xffffff] |= BLOB_REJECTED | BLOB_REASON(reason);
+	}
+}
+
+static void rejectRuns(uint16_t *blobPx, const vector<IRDepthRun> &runs, int reason=0) {
+	for(const auto &run : runs) {
+		for(unsigned i=run.start; i<run.end; i++) {
+			blobPx[i] |= BLOB_REJECTED | BLOB_REASON(reason);
+		}
+	}
+}
+
+static void colorRuns(uint8_t *colorPx, const IRDepthRun *begin, const IRDepthRun *end, uint8_t color) {
+	for(const IRDepthRun *run = begin; run != end; run++) {
+		fill(colorPx + run->start, colorPx + run->end, color);
+	}
+}
+
+/* Record an accepted blob; blob IDs (and colors) are handed out once all arms are done. */
+static void acceptRuns(IRDepthArmTask &task, const vector<IRDepthRun> &runs) {
+	task.blobRuns.insert(task.blobRuns.end(), runs.begin(), runs.end());
+	task.blobEnds.push_back(task.blobRuns.size());
+}
 
+static void acceptBlob(IRDepthArmTask &task, const IRDepthPixels &blob) {
 	for(auto i : blob) {
-		blobPx[i & 0xffffff] |= BLOB_REJECTED | ((reason & 0x3f) << 18);
+		IRDepthRun run = {i & 0xffffff, (i & 0xffffff) + 1};
+		task.blobRuns.push_back(run);
+	}
+	task.blobEnds.push_back(task.blobRuns.size());
+}
+
+/* Scanline flood fill. Grows the four-way connected component of unclaimed (blobPx == 0) pixels
+   accepted by canFill, starting from seed (which is always included), and stores it as a list of
+   horizontal runs, marking each pixel with mark.
+   Every unclaimed four-way neighbour of the component which cannot be filled is passed to onBoundary.
+   blobPx must have a guard band, so that runs never reach the edge of the image.
+   Returns the number of pixels in the component. */
+template <typename Stride, typename FillFn, typename BoundaryFn>
+static int floodRuns(Stride w, uint16_t *blobPx, unsigned seed, uint16_t mark,
+					 FillFn canFill, BoundaryFn onBoundary, vector<IRDepthRun> &runs) {
+	int count = 0;
+	int qtail = 0;
+
+#define ADD_RUN(idx) do { \
+			unsigned lo = (idx), hi = (idx) + 1; \
+			while(blobPx[lo-1] == 0 && canFill(lo-1)) \
+				lo--; \
+			while(blobPx[hi] == 0 && canFill(hi)) \
+				hi++; \
+			for(unsigned j=lo; j<hi; j++) \
+				blobPx[j] |= mark; \
+			IRDepthRun newRun = {lo, hi}; \
+			runs.push_back(newRun); \
+			count += hi - lo; \
+		} while(0)
+
+	ADD_RUN(seed);
+
+	while(qtail < runs.size()) {
+		IRDepthRun run = runs[qtail++];
+
+		/* Horizontal neighbours: runs are maximal, so these can only be boundary pixels */
+		if(blobPx[run.start-1] == 0)
+			onBoundary(run.start-1);
+		if(blobPx[run.end] == 0)
+			onBoundary(run.end);
+
+		/* Vertical neighbours: start a new run at each fillable pixel */
+		for(int dy=-1; dy<=1; dy+=2) {
+			unsigned end = run.end + dy*w;
+			for(unsigned i=run.start + dy*w; i<end; i++) {
+				if(blobPx[i] != 0)
+					continue;
+				if(canFill(i)) {
+					ADD_RUN(i);
+					i = runs.back().end - 1;
+				} else {
+					onBoundary(i);
+				}
+			}
+		}
 	}
+#undef ADD_RUN
+
+	return count;
+}
+
+/* The same, pixel by pixel in breadth-first order: the runs hold one pixel each, in the order visited, and
+   neighbours are tried left, up, down, right. For checking the scanline fill against. */
+template <typename FillFn, typename BoundaryFn>
+static int floodPixels(int w, uint16_t *blobPx, unsigned seed, uint16_t mark,
+					   FillFn canFill, BoundaryFn onBoundary, vector<IRDepthRun> &runs) {
+	int qtail = 0;
+	blobPx[seed] |= mark;
+	IRDepthRun seedRun = {seed, seed + 1};
+	runs.push_back(seedRun);
+
+	while(qtail < runs.size()) {
+		unsigned curidx = runs[qtail++].start;
+		const int offsets[4] = {-1, -w, w, 1};
+		for(int k=0; k<4; k++) {
+			unsigned otheridx = curidx + offsets[k];
+			if(blobPx[otheridx] != 0)
+				continue;
+			if(canFill(otheridx)) {
+				blobPx[otheridx] |= mark;
+				IRDepthRun run = {otheridx, otheridx + 1};
+				runs.push_back(run);
+			} else {
+				onBoundary(otheridx);
+			}
+		}
+	}
+
+	return runs.size();
 }
 
 static int colorForBlobIndex(int blobId) {
@@ -254,149 +821,256 @@ static int colorForBlobIndex(int blobId) {
 	return b;
 }
 
-vector<IRDepthArm> IRDepthTouchTracker::detectTouches() {
+FrameVector<IRDepthArm>::type IRDepthTouchTracker::detectTouches(IRDepthFrame &frame) {
 	const int n = w * h;
 
-	nextBlobId = 1;
+	uint16_t *blobPx = &frame.blobPlane[0];
+	uint8_t *colorPx = &frame.colorPlane[0];
 
-	vector<IRDepthArm> arms;
-	uint32_t *diffPx = (uint32_t *)diffIm[front].getPixels();
-	uint32_t *blobPx = (uint32_t *)blobIm[front].getPixels();
+	/* Last frame's arms are gone by now. An arm which found no hands may still hold some of its arena, so
+	   release it first: reset() may free the blocks its vector would have to look at. */
+	for(auto &task : armTasks) {
+		FrameVector<IRDepthHand>::type().swap(task.arm.hands);
+		task.arena->reset();
+	}
 
 	fill_n(blobPx, n, 0);
-
-	for(int i=0; i<n; i++) {
-		if(ZONE(diffPx[i]) != ZONE_HIGH)
-			continue;
-		if(blobPx[i] != 0)
-			continue;
-
-		IRDepthArm arm;
-		if(floodArm(arm, i)) {
-			arms.push_back(arm);
+	/* Nothing is tracked on the image border. This guard band lets the flood fills skip bounds checks. */
+	fillGuardBand<uint16_t>(blobPx, w, h, BLOB_REJECTED);
+
+	/* Pass 1: find the arms. This only touches highconf pixels and their immediate border. */
+	int numArms = 0;
+	for(const auto &run : frame.highRuns) {
+		for(unsigned i=run.start; i<run.end; i++) {
+			if(blobPx[i] != 0)
+				continue;
+
+			if(armTasks.size() <= numArms) {
+				armTasks.resize(numArms + 1);
+				armTasks[numArms].arena = ofPtr<FrameArena>(new FrameArena(256 << 10));
+			}
+			IRDepthArmTask &task = armTasks[numArms];
+			task.classPx = &frame.classPlane[0];
+			task.depthPx = &frame.depth[0];
+			task.blobPx = blobPx;
+			if(findArm(task, i))
+				numArms++;
 		}
 	}
-	return arms;
-}
-
-bool IRDepthTouchTracker::floodArm(IRDepthArm &arm, unsigned idx) {
-	const int n = w * h;
-
-	uint32_t *diffPx = (uint32_t *)diffIm[front].getPixels();
-	uint32_t *blobPx = (uint32_t *)blobIm[front].getPixels();
-
-	vector<unsigned> q, q2;
-	int qtail = 0;
 
-	q.push_back(idx);
+	/* Pass 2: flood the hands, fingers and tips of each arm.
+	   With several arms, every arm floods into its own copy of the post-discovery blob image,
+	   so the results don't depend on thread scheduling. */
+	if(numArms == 1) {
+		FrameArena::Scope arenaScope(*armTasks[0].arena);
+		armTasks[0].blobPx = blobPx;
+		armTasks[0].found = floodArm(armTasks[0]);
+	} else if(numArms > 1) {
+		armSnapshot.assign(blobPx, blobPx + n);
+		/* Only capture this, so the std::function doesn't need to allocate */
+		pool.parallelFor(numArms, [this](int k) {
+			IRDepthArmTask &task = armTasks[k];
+			AllocationCounter::Scope countScope(segmentAllocations);
+			FrameArena::Scope arenaScope(*task.arena);
+			task.blobBuf.assign(armSnapshot.begin(), armSnapshot.end());
+			task.blobPx = &task.blobBuf[0];
+			task.found = floodArm(task);
+		});
+
+		/* Merge the arms' blob images in arm order. Serially, an arm stops at pixels an earlier arm claimed, so
+		   an arm whose floods came near such pixels may have found something else, or the same hand again.
+		   Such an arm is flooded again on the merged image, as the serial tracker would have. Floods only read
+		   pixels within region_margin of pixels they leave changed, so an arm which changed nothing within
+		   that distance of an earlier arm's pixels found exactly what it would have serially. This is
+		   checked a tile segment at a time, with the earlier arms' tiles grown by region_margin. */
+		const int tileSize = BackgroundUpdaterThread::tileSize;
+		const int reach = (region_margin + tileSize - 1) / tileSize; // tiles
+		const uint16_t *snapPx = &armSnapshot[0];
+		fill(armClaimedTiles.begin(), armClaimedTiles.end(), 0);
+		auto claimTile = [&](int tx, int ty) {
+			for(int cy=max(ty - reach, 0); cy<=min(ty + reach, tileRows - 1); cy++) {
+				for(int cx=max(tx - reach, 0); cx<=min(tx + reach, tileCols - 1); cx++) {
+					armClaimedTiles[cy*tileCols + cx] = 1;
+				}
+			}
+		};
+		for(int k=0; k<numArms; k++) {
+			IRDepthArmTask &task = armTasks[k];
+			const uint16_t *taskPx = task.blobPx;
+			fill(armChangedTiles.begin(), armChangedTiles.end(), 0);
+			bool conflict = false;
+			for(int y=0; y<h; y++) {
+				int rowStart = y*w;
+				if(memcmp(taskPx + rowStart, snapPx + rowStart, w * sizeof(uint16_t)) == 0)
+					continue;
+				for(int tx=0; tx<tileCols; tx++) {
+					int segStart = rowStart + tx*tileSize, segLen = min(tileSize, w - tx*tileSize);
+					if(memcmp(taskPx + segStart, snapPx + segStart, segLen * sizeof(uint16_t)) == 0)
+						continue;
+					const int t = (y / tileSize)*tileCols + tx;
+					armChangedTiles[t] = 1;
+					conflict = conflict || armClaimedTiles[t];
+				}
+			}
 
-	while(qtail < q.size()) {
-		unsigned curidx = q[qtail++];
+			if(conflict) {
+				FrameArena::Scope arenaScope(*task.arena);
+				task.arm.hands.clear();
+				task.blobRuns.clear();
+				task.blobEnds.clear();
+				task.blobPx = blobPx;
+				task.found = floodArm(task);
+				/* Claim whatever all the arms so far have changed */
+				for(int t=0; t<tileCols * tileRows; t++) {
+					IRDepthRegion tile = tileBounds(t);
+					for(int y=tile.y0; y<tile.y1; y++) {
+						if(memcmp(blobPx + y*w + tile.x0, snapPx + y*w + tile.x0, (tile.x1 - tile.x0) * sizeof(uint16_t)) != 0) {
+							claimTile(t % tileCols, t / tileCols);
+							break;
+						}
+					}
+				}
+				continue;
+			}
 
-		blobPx[curidx] |= ZONE_HIGH;
+			/* No earlier arm changed anything in this arm's tiles, so they can be copied whole */
+			for(int t=0; t<tileCols * tileRows; t++) {
+				if(!armChangedTiles[t])
+					continue;
+				IRDepthRegion tile = tileBounds(t);
+				for(int y=tile.y0; y<tile.y1; y++) {
+					copy(taskPx + y*w + tile.x0, taskPx + y*w + tile.x1, blobPx + y*w + tile.x0);
+				}
+				claimTile(t % tileCols, t / tileCols);
+			}
+		}
+	}
 
-		int y = curidx / w;
-		int x = curidx % w;
+	/* Pass 3: hand out blob IDs in a deterministic order, and collect the arms */
+	nextBlobId = 1;
+	const bool colorBlobs = frame.quality < QUALITY_NO_DEBUG;
+	if(colorBlobs)
+		fill_n(colorPx, n, 0);
+
+	FrameVector<IRDepthArm>::type arms;
+	for(int k=0; k<numArms; k++) {
+		IRDepthArmTask &task = armTasks[k];
+		if(!task.found)
+			continue;
 
-#define TEST(dx,dy) do {\
-			int xx=x+dx, yy=y+dy; \
-			if(0 <= xx && xx < w && 0 <= yy && yy < h) { \
-				int otheridx = curidx + dy*w + dx; \
-				if(blobPx[otheridx] != 0) \
-					continue; \
-				if(ZONE(diffPx[otheridx]) == ZONE_HIGH) \
-					q.push_back(otheridx); \
-				else if(ZONE(diffPx[otheridx]) == ZONE_MID) \
-					q2.push_back(otheridx); \
-				blobPx[otheridx] |= BLOB_VISITED; \
-			} \
-		} while(0)
-		// four-way connectivity
-		TEST(-1,0);TEST(0,-1);TEST(0,1);TEST(1,0);
-#undef TEST
+		int start = 0;
+		for(int end : task.blobEnds) {
+			if(colorBlobs)
+				colorRuns(colorPx, &task.blobRuns[0] + start, &task.blobRuns[0] + end, colorForBlobIndex(nextBlobId));
+			nextBlobId++;
+			start = end;
+		}
+		/* Move the hands out, so that the task holds nothing from its arena when it is reset */
+		arms.push_back(IRDepthArm());
+		arms.back().hands.swap(task.arm.hands);
 	}
+	return arms;
+}
 
-	if(q.size() < arm_min_size) {
+bool IRDepthTouchTracker::findArm(IRDepthArmTask &task, unsigned idx) {
+	const uint8_t *classPx = task.classPx;
+	uint16_t *blobPx = task.blobPx;
+
+	vector<IRDepthRun> &runs = task.runs;
+	vector<unsigned> &q2 = task.seeds;
+	runs.clear();
+	q2.clear();
+
+	auto canFill = [&](unsigned i) {
+		return ZONE(classPx[i]) == ZONE_HIGH;
+	};
+	auto onBoundary = [&](unsigned i) {
+		if(ZONE(classPx[i]) == ZONE_MID)
+			q2.push_back(i);
+		blobPx[i] |= BLOB_VISITED;
+	};
+	int count = referenceFloods
+		? floodPixels(w, blobPx, idx, BLOB_ZONE(ZONE_HIGH), canFill, onBoundary, runs)
+		: (w == kinect2_depth_width)
+		? floodRuns(FixedStride<kinect2_depth_width>(w), blobPx, idx, BLOB_ZONE(ZONE_HIGH), canFill, onBoundary, runs)
+		: floodRuns(RuntimeStride(w), blobPx, idx, BLOB_ZONE(ZONE_HIGH), canFill, onBoundary, runs);
+
+	if(count < arm_min_size) {
 		/* Not enough pixels */
-		rejectBlob(q, 1);
+		rejectRuns(blobPx, runs, 1);
 		return false;
 	}
 
-	/* Enough pixels for the arm: onto the next stage! */
+	/* Enough pixels for the arm: onto the next stage! The floods find boundary pixels in different orders,
+	   so hands are seeded in scan order. */
+	sort(q2.begin(), q2.end());
 	for(auto i : q2) {
 		blobPx[i] &= ~BLOB_VISITED;
 	}
 
+	task.arm.hands.clear();
+	task.blobRuns.clear();
+	task.blobEnds.clear();
+	return true;
+}
+
+bool IRDepthTouchTracker::floodArm(IRDepthArmTask &task) {
+	uint16_t *blobPx = task.blobPx;
+
 	bool found_hands = false;
-	for(auto i : q2) {
+	for(auto i : task.seeds) {
 		if(blobPx[i] != 0)
 			continue;
 		IRDepthHand hand;
-		if(floodHand(hand, i)) {
-			arm.hands.push_back(hand);
+		if(floodHand(task, hand, i)) {
+			task.arm.hands.push_back(hand);
 			found_hands = true;
 		}
 	}
 
 	if(!found_hands) {
-		rejectBlob(q, 2);
+		rejectRuns(blobPx, task.runs, 2);
 		return false;
 	}
 
-	int color = colorForBlobIndex(nextBlobId++) << 8;
-	for(auto i : q) {
-		blobPx[i] |= color;
-	}
+	acceptRuns(task, task.runs);
 	return true;
 }
 
-bool IRDepthTouchTracker::floodHand(IRDepthHand &hand, unsigned idx) {
-	const int n = w * h;
-
-	uint32_t *diffPx = (uint32_t *)diffIm[front].getPixels();
-	uint32_t *edgePx = (uint32_t *)edgeIm[front].getPixels();
-	uint32_t *blobPx = (uint32_t *)blobIm[front].getPixels();
-
-	vector<unsigned> q, q2;
-	int qtail = 0;
-
-	q.push_back(idx);
-
-	while(qtail < q.size()) {
-		unsigned curidx = q[qtail++];
-
-		blobPx[curidx] |= ZONE_MID;
-
-		int y = curidx / w;
-		int x = curidx % w;
-
-#define TEST(dx,dy) do {\
-			int xx=x+dx, yy=y+dy; \
-			if(0 <= xx && xx < w && 0 <= yy && yy < h) { \
-				int otheridx = curidx + dy*w + dx; \
-				if(blobPx[otheridx] != 0) \
-					continue; \
-				if(edgePx[otheridx] & 0x00ffff00) /* IR + depth edge */\
-					continue; \
-				if(ZONE(diffPx[otheridx]) >= ZONE_MID) \
-					q.push_back(otheridx); \
-				else if(ZONE(diffPx[otheridx]) == ZONE_LOW) \
-					q2.push_back(otheridx); \
-				blobPx[otheridx] |= BLOB_VISITED; \
-			} \
-		} while(0)
-		// four-way connectivity
-		TEST(-1,0);TEST(0,-1);TEST(0,1);TEST(1,0);
-#undef TEST
-	}
-
-	if(q.size() < hand_min_size) {
+bool IRDepthTouchTracker::floodHand(IRDepthArmTask &task, IRDepthHand &hand, unsigned idx) {
+	const uint8_t *classPx = task.classPx;
+	uint16_t *blobPx = task.blobPx;
+
+	/* Hands don't nest, so their lists can live in the task */
+	vector<IRDepthRun> &runs = task.handRuns;
+	vector<unsigned> &q2 = task.handSeeds;
+	runs.clear();
+	q2.clear();
+
+	auto canFill = [&](unsigned i) {
+		return !(classPx[i] & (EDGE_IR | EDGE_DEPTHREL)) && ZONE(classPx[i]) >= ZONE_MID;
+	};
+	auto onBoundary = [&](unsigned i) {
+		if(classPx[i] & (EDGE_IR | EDGE_DEPTHREL))
+			return;
+		if(ZONE(classPx[i]) == ZONE_LOW)
+			q2.push_back(i);
+		blobPx[i] |= BLOB_VISITED;
+	};
+	int count = referenceFloods
+		? floodPixels(w, blobPx, idx, BLOB_ZONE(ZONE_MID), canFill, onBoundary, runs)
+		: (w == kinect2_depth_width)
+		? floodRuns(FixedStride<kinect2_depth_width>(w), blobPx, idx, BLOB_ZONE(ZONE_MID), canFill, onBoundary, runs)
+		: floodRuns(RuntimeStride(w), blobPx, idx, BLOB_ZONE(ZONE_MID), canFill, onBoundary, runs);
+
+	if(count < hand_min_size) {
 		/* Not enough pixels */
-		rejectBlob(q, 3);
+		rejectRuns(blobPx, runs, 3);
 		return false;
 	}
 
-	/* Enough pixels for the hand: onto the next stage! */
+	/* Enough pixels for the hand: onto the next stage! Fingers are seeded in scan order, as for hands. */
+	sort(q2.begin(), q2.end());
 	for(auto i : q2) {
 		blobPx[i] &= ~BLOB_VISITED;
 	}
@@ -406,33 +1080,27 @@ bool IRDepthTouchTracker::floodHand(IRDepthHand &hand, unsigned idx) {
 		if(blobPx[i] != 0)
 			continue;
 		IRDepthFinger finger;
-		if(floodFinger(finger, i)) {
+		if(floodFinger(task, finger, i)) {
 			hand.fingers.push_back(finger);
 			found_fingers = true;
 		}
 	}
 
 	if(!found_fingers) {
-		rejectBlob(q, 4);
+		rejectRuns(blobPx, runs, 4);
 		return false;
 	}
 
-	int color = colorForBlobIndex(nextBlobId++) << 8;
-	for(auto i : q) {
-		blobPx[i] |= color;
-	}
+	acceptRuns(task, runs);
 	return true;
 }
 
-bool IRDepthTouchTracker::floodFinger(IRDepthFinger &finger, unsigned idx) {
-	const int n = w * h;
-
-	uint32_t *diffPx = (uint32_t *)diffIm[front].getPixels();
-	uint32_t *edgePx = (uint32_t *)edgeIm[front].getPixels();
-	uint32_t *blobPx = (uint32_t *)blobIm[front].getPixels();
+bool IRDepthTouchTracker::floodFinger(IRDepthArmTask &task, IRDepthFinger &finger, unsigned idx) {
+	const uint8_t *classPx = task.classPx;
+	uint16_t *blobPx = task.blobPx;
 
-	vector<unsigned> q, q2;
-	vector<unsigned> roots; // pixels next to mid/high conf pixels
+	IRDepthPixels q, q2;
+	IRDepthPixels roots; // pixels next to mid/high conf pixels
 	int qtail = 0;
 
 	q.push_back(idx);
@@ -442,29 +1110,24 @@ bool IRDepthTouchTracker::floodFinger(IRDepthFinger &finger, unsigned idx) {
 		unsigned dist = curidx >> 24;
 		curidx &= 0xffffff;
 
-		int y = curidx / w;
-		int x = curidx % w;
-
-		blobPx[curidx] |= ZONE_LOW | dist;
+		blobPx[curidx] |= BLOB_ZONE(ZONE_LOW) | dist;
 
 		bool isRoot = false; // are we adjacent to a mid/highconf pixel?
 
+		// The guard band keeps neighbours in bounds
 #define TEST(dx,dy) do {\
-			int xx=x+dx, yy=y+dy; \
-			if(0 <= xx && xx < w && 0 <= yy && yy < h) { \
-				int otheridx = curidx + dy*w + dx; \
-				if(blobPx[otheridx] >= ZONE_MID) \
-					isRoot = true; \
-				if(blobPx[otheridx] != 0) \
-					continue; \
-				if(edgePx[otheridx] & 0x00ff00ff) /* IR + depth abs */\
-					continue; \
-				if(ZONE(diffPx[otheridx]) >= ZONE_LOW) \
-					q.push_back(otheridx | ((dist+1)<<24)); \
-				else if(ZONE(diffPx[otheridx]) == ZONE_NOISE) \
-					q2.push_back(otheridx | ((dist+1)<<24)); \
-				blobPx[otheridx] |= BLOB_VISITED; \
-			} \
+			int otheridx = curidx + dy*w + dx; \
+			if(blobPx[otheridx] >= BLOB_ZONE(ZONE_MID)) \
+				isRoot = true; \
+			if(blobPx[otheridx] != 0) \
+				continue; \
+			if(classPx[otheridx] & (EDGE_IR | EDGE_DEPTHABS)) \
+				continue; \
+			if(ZONE(classPx[otheridx]) >= ZONE_LOW) \
+				q.push_back(otheridx | ((dist+1)<<24)); \
+			else if(ZONE(classPx[otheridx]) == ZONE_NOISE) \
+				q2.push_back(otheridx | ((dist+1)<<24)); \
+			blobPx[otheridx] |= BLOB_VISITED; \
 		} while(0)
 		// four-way connectivity
 		TEST(-1,0);TEST(0,-1);TEST(0,1);TEST(1,0);
@@ -480,13 +1143,13 @@ bool IRDepthTouchTracker::floodFinger(IRDepthFinger &finger, unsigned idx) {
 		blobPx[i & 0xffffff] &= ~BLOB_VISITED;
 	}
 
-	vector<unsigned> tipq;
+	IRDepthPixels tipq;
 
 	for(auto i : q2) {
 		if(blobPx[i & 0xffffff] != 0)
 			continue;
 		IRDepthTip tip;
-		if(floodTip(tip, i)) {
+		if(floodTip(task, tip, i)) {
 			for(int j : tip.pixels) {
 				q.push_back(j);
 				tipq.push_back(j);
@@ -499,60 +1162,74 @@ bool IRDepthTouchTracker::floodFinger(IRDepthFinger &finger, unsigned idx) {
 	
 	if(q.size() < finger_min_size) {
 		/* Not enough pixels */
-		rejectBlob(q, 5);
+		rejectBlob(blobPx, q, 5);
 		for(auto i : tipq) {
 			blobPx[i & 0xffffff] = 0;
 		}
 		return false;
 	}
 
-	refloodFinger(q, roots);
+	refloodFinger(task, q, roots);
 
-	if(!computeFingerMetrics(finger, q)) {
+	if(!computeFingerMetrics(task, finger, q)) {
 		/* Finger not really a finger */
-		rejectBlob(q, 6);
+		rejectBlob(blobPx, q, 6);
 		for(auto i : tipq) {
 			blobPx[i & 0xffffff] = 0;
 		}
 		return false;
 	}
 
-	int color = colorForBlobIndex(nextBlobId++) << 8;
-	for(auto i : q) {
-		unsigned idx = i & 0xffffff;
-		unsigned dist = i >> 24;
-
-		blobPx[i & 0xffffff] |= color;
-	}
-
+	acceptBlob(task, q);
 	return true;
 }
 
-void IRDepthTouchTracker::refloodFinger(const vector<unsigned> &blob, vector<unsigned> &roots) {
-	uint32_t *diffPx = (uint32_t *)diffIm[front].getPixels();
-	uint32_t *edgePx = (uint32_t *)edgeIm[front].getPixels();
-	uint32_t *blobPx = (uint32_t *)blobIm[front].getPixels();
+void IRDepthTouchTracker::refloodFinger(IRDepthArmTask &task, const IRDepthPixels &blob, IRDepthPixels &roots) {
+	uint16_t *blobPx = task.blobPx;
+
+	if(roots.empty())
+		return;
 
-	set<unsigned> unseen;
-	for(auto i : blob)
-		unseen.insert(i & 0xffffff);
-	for(auto i : roots)
-		unseen.erase(i);
+	/* Geodesic distances are computed on a tile covering the finger's bounding box */
+	int x0 = w, y0 = h, x1 = -1, y1 = -1;
+	for(auto i : blob) {
+		int idx = i & 0xffffff;
+		int x = idx % w, y = idx / w;
+		x0 = min(x0, x); x1 = max(x1, x);
+		y0 = min(y0, y); y1 = max(y1, y);
+	}
+
+	/* The tile has a one-pixel guard band of non-finger labels, so neighbour tests need no bounds checks */
+	x0--; y0--;
+	const int tw = x1 - x0 + 2, th = y1 - y0 + 2;
+	vector<int> &tile = task.fingerTile;
+	tile.assign(tw * th, -1);
+	for(auto i : blob) {
+		int idx = i & 0xffffff;
+		tile[(idx / w - y0) * tw + (idx % w - x0)] = -2;
+	}
+
+	vector<int> &q = task.fingerQueue;
+	q.clear();
+	for(auto i : roots) {
+		int t = (i / w - y0) * tw + (i % w - x0);
+		tile[t] = 0;
+		q.push_back(t);
+	}
 
-	vector<unsigned> q = roots;
 	int qtail = 0;
 	while(qtail < q.size()) {
-		unsigned curidx = q[qtail++];
-		unsigned dist = curidx >> 24;
-		curidx &= 0xffffff;
+		int t = q[qtail++];
+		int dist = tile[t];
 
-		blobPx[curidx] = (blobPx[curidx] & ~0xff) | dist;
+		unsigned idx = (t / tw + y0) * w + (t % tw + x0);
+		blobPx[idx] = (blobPx[idx] & ~0xff) | min(dist, 0xff);
 
 #define TEST(dx,dy) do {\
-			int otheridx = curidx + dy*w + dx; \
-			if(unseen.count(otheridx)) { \
-				q.push_back(otheridx | ((dist+1)<<24)); \
-				unseen.erase(otheridx); \
+			int othert = t + dy*tw + dx; \
+			if(tile[othert] == -2) { \
+				tile[othert] = dist+1; \
+				q.push_back(othert); \
 			} \
 		} while(0)
 		// four-way connectivity
@@ -561,43 +1238,67 @@ void IRDepthTouchTracker::refloodFinger(const vector<unsigned> &blob, vector<uns
 	}
 }
 
-bool IRDepthTouchTracker::computeFingerMetrics(IRDepthFinger &finger, vector<unsigned> &px) {
-	uint16_t *depthPx = depthStream.getPixelsRef().getPixels();
-	uint32_t *blobPx = (uint32_t *)blobIm[front].getPixels();
+/* Enough highest-distance pixels for both averaging windows */
+const int fingertip_window = (touchz_window > tipavg_window) ? touchz_window : tipavg_window;
+
+bool IRDepthTouchTracker::computeFingerMetrics(IRDepthArmTask &task, IRDepthFinger &finger, const IRDepthPixels &px) {
+	const uint16_t *depthPx = task.depthPx;
+	const uint16_t *blobPx = task.blobPx;
 
 	const float *bgmean = background.getBackgroundMean().getPixels();
 
-	/* Sort pixels by distance */
-	sort(px.begin(), px.end(), [&](unsigned a, unsigned b) { return (blobPx[a & 0xffffff] & 0xff) < (blobPx[b & 0xffffff] & 0xff); });
+	/* Keep the highest-distance pixels, ordered by increasing distance.
+	   Among equally distant pixels, later pixels in px rank higher. */
+	int top[fingertip_window], topDist[fingertip_window];
+	int ntop = 0;
+	for(auto i : px) {
+		int idx = i & 0xffffff;
+		int dist = BLOB_DIST(blobPx[idx]);
+		if(ntop == fingertip_window) {
+			if(dist < topDist[0])
+				continue;
+			ntop--;
+			for(int j=0; j<ntop; j++) {
+				top[j] = top[j+1];
+				topDist[j] = topDist[j+1];
+			}
+		}
+		int j = ntop++;
+		for(; j > 0 && topDist[j-1] > dist; j--) {
+			top[j] = top[j-1];
+			topDist[j] = topDist[j-1];
+		}
+		top[j] = idx;
+		topDist[j] = dist;
+	}
 
 	/* Check max distance */
-	int maxidx = px[px.size()-1] & 0xffffff;
-	int maxdist = blobPx[maxidx] & 0xff;
+	int maxdist = topDist[ntop-1];
 	if(maxdist < finger_min_dist)
 		return false;
 
 	/* Average the z-heights */
-	int start = px.size() - touchz_window;
+	int start = ntop - touchz_window;
 	if(start < 0) start = 0;
 
 	float avgdiff = 0;
 	int count = 0;
 	int idx;
-	for(int i=start; i<px.size(); i++) {
-		idx = px[i] & 0xffffff;
+	for(int i=start; i<ntop; i++) {
+		idx = top[i];
 		avgdiff += bgmean[idx] - depthPx[idx];
 		count++;
 	}
 	finger.z = avgdiff / count;
 
 	/* Average the tip x and y values */
-	start = px.size() - tipavg_window;
+	start = ntop - tipavg_window;
 	if(start < 0) start = 0;
 
 	float avgx = 0, avgy = 0;
 	count = 0;
-	for(int i=start; i<px.size(); i++) {
-		idx = px[i] & 0xffffff;
+	for(int i=start; i<ntop; i++) {
+		idx = top[i];
 		avgx += idx % w;
 		avgy += idx / w;
 		count++;
@@ -608,16 +1309,13 @@ bool IRDepthTouchTracker::computeFingerMetrics(IRDepthFinger &finger, vector<uns
 	return true;
 }
 
-bool IRDepthTouchTracker::floodTip(IRDepthTip &tip, unsigned idx) {
-	const int n = w * h;
-	
+bool IRDepthTouchTracker::floodTip(IRDepthArmTask &task, IRDepthTip &tip, unsigned idx) {
 	unsigned initial_dist = idx >> 24;
 
-	uint32_t *diffPx = (uint32_t *)diffIm[front].getPixels();
-	uint32_t *edgePx = (uint32_t *)edgeIm[front].getPixels();
-	uint32_t *blobPx = (uint32_t *)blobIm[front].getPixels();
+	const uint8_t *classPx = task.classPx;
+	uint16_t *blobPx = task.blobPx;
 
-	vector<unsigned> q;
+	IRDepthPixels q;
 	int qtail = 0;
 
 	q.push_back(idx);
@@ -629,26 +1327,21 @@ bool IRDepthTouchTracker::floodTip(IRDepthTip &tip, unsigned idx) {
 		if(dist > tip_max_dist)
 			goto reject_blob;
 
-		int y = curidx / w;
-		int x = curidx % w;
-
-		blobPx[curidx] |= ZONE_NOISE | dist;
+		blobPx[curidx] |= BLOB_ZONE(ZONE_NOISE) | dist;
 
 		bool isRoot = false; // are we adjacent to a mid/highconf pixel?
 
+		// The guard band keeps neighbours in bounds
 #define TEST(dx,dy) do {\
-			int xx=x+dx, yy=y+dy; \
-			if(0 <= xx && xx < w && 0 <= yy && yy < h) { \
-				int otheridx = curidx + dy*w + dx; \
-				if(blobPx[otheridx] >= ZONE_MID) \
-					isRoot = true; \
-				if(blobPx[otheridx] != 0) \
-					continue; \
-				if(edgePx[otheridx] & 0x00ff0000) /* IR only */\
-					continue; \
-				q.push_back(otheridx | ((dist+1) << 24)); \
-				blobPx[otheridx] |= BLOB_VISITED; \
-			} \
+			int otheridx = curidx + dy*w + dx; \
+			if(blobPx[otheridx] >= BLOB_ZONE(ZONE_MID)) \
+				isRoot = true; \
+			if(blobPx[otheridx] != 0) \
+				continue; \
+			if(classPx[otheridx] & EDGE_IR) \
+				continue; \
+			q.push_back(otheridx | ((dist+1) << 24)); \
+			blobPx[otheridx] |= BLOB_VISITED; \
 		} while(0)
 		// four-way connectivity
 		TEST(-1,0);TEST(0,-1);TEST(0,1);TEST(1,0);
@@ -671,154 +1364,430 @@ reject_blob:
 }
 #pragma endregion
 
-vector<FingerTouch> IRDepthTouchTracker::mergeTouches(vector<FingerTouch> &curTouches, vector<FingerTouch> &newTouches) {
-    struct touch_dist {
-        int cur_index, new_index;
-        float dist;
-        bool operator<(const struct touch_dist &other) const {
-            return dist < other.dist;
-        }
-    };
-
-    /* Assign each new touch to the nearest cur neighbour */
-    for(auto &i : newTouches) {
-        i.id = -1;
-    }
-
-    vector<touch_dist> distances;
-    for(int i=0; i<curTouches.size(); i++) {
-        for(int j=0; j<newTouches.size(); j++) {
-            float d = curTouches[i].tip.distance(newTouches[j].tip);
-            if(d > 50)
-                continue;
-			touch_dist dist = {i,j,d};
-            distances.push_back(dist);
-        }
-    }
-    std::sort(distances.begin(), distances.end());
-
-    for(const auto &i : distances) {
-        FingerTouch &curTouch = curTouches[i.cur_index];
-        FingerTouch &newTouch = newTouches[i.new_index];
-        /* check if already assigned */
-        if(curTouch.id < 0 || newTouch.id >= 0)
-            continue;
-        /* move cur id into new id */
-        newTouch.id = curTouch.id;
-        curTouch.id = -1;
-
-		/* update other attributes */
-        newTouch.touchAge = curTouch.touchAge + 1;
-		/* EWMA new touch */
-		newTouch.tip = smooth_tip_alpha * (newTouch.tip - curTouch.tip) + curTouch.tip;
-		newTouch.touchZ = smooth_touchz_alpha * (newTouch.touchZ - curTouch.touchZ) + curTouch.touchZ;
-
-		if(curTouch.touched && newTouch.touchZ > touchz_exit) {
-			newTouch.touched = false;
-            newTouch.statusAge = 0;
-		} else if(!curTouch.touched && newTouch.touchZ < touchz_enter) {
-			newTouch.touched = true;
-            newTouch.statusAge = 0;
-		} else {
-			newTouch.touched = curTouch.touched;
-			newTouch.statusAge = curTouch.statusAge + 1;
+/* Carry one touch over to its detection in the next frame, dt seconds later: smoothing, touch state and
+   touch-down anticipation */
+static void mergeTouch(const FingerTouch &curTouch, FingerTouch &newTouch, float dt) {
+	/* EWMA new touch */
+	newTouch.tip = smooth_tip_alpha * (newTouch.tip - curTouch.tip) + curTouch.tip;
+	newTouch.touchZ = smooth_touchz_alpha * (newTouch.touchZ - curTouch.touchZ) + curTouch.touchZ;
+	float velocity = (newTouch.touchZ - curTouch.touchZ) / dt;
+	if(curTouch.touchAge > 0)
+		velocity = smooth_touchz_velocity_alpha * (velocity - curTouch.touchZVelocity) + curTouch.touchZVelocity;
+	newTouch.touchZVelocity = velocity;
+
+	/* Touch state, with hysteresis */
+	if(curTouch.touched && newTouch.touchZ > touchz_exit) {
+		newTouch.touched = false;
+		newTouch.statusAge = 0;
+	} else if(!curTouch.touched && newTouch.touchZ < touchz_enter) {
+		newTouch.touched = true;
+		newTouch.statusAge = 0;
+	} else {
+		newTouch.touched = curTouch.touched;
+		newTouch.statusAge = curTouch.statusAge + 1;
+	}
+
+	/* Anticipation: the smoothed touchZ reaches touchz_enter a frame or more after the finger does. An untouched
+	   finger descending fast enough to get there within the horizon is imminent, and stays so until it touches,
+	   stalls or rises. */
+	newTouch.imminent = false;
+	newTouch.contactTime = 0;
+	if(!newTouch.touched && velocity < 0 && newTouch.touchZ < anticipate_max_z) {
+		const float contactTime = (newTouch.touchZ - touchz_enter) / -velocity;
+		const float minSpeed = curTouch.imminent ? anticipate_min_speed / 2 : anticipate_min_speed;
+		if(-velocity >= minSpeed && (curTouch.imminent || contactTime <= anticipate_horizon)) {
+			newTouch.imminent = true;
+			newTouch.contactTime = max(contactTime, 0.0f);
 		}
 	}
+}
 
-    for(auto &i : newTouches) {
-        i.missing = false;
-        i.missingAge = 0;
-    }
+/* Associate and merge, as mergeTouches does; shared with the offline anticipation evaluation */
+template<typename CurVector, typename DetVector>
+static void mergeDetections(TouchAssociator &associator, const CurVector &touches, DetVector &newTouches, int &nextTouchId, float dt) {
+	associator.associate(touches, newTouches, nextTouchId, [dt](const FingerTouch &curTouch, FingerTouch &newTouch) {
+		mergeTouch(curTouch, newTouch, dt);
+	});
+
+	/* A touch-down is not imminent on a finger that has been lost */
+	for(FingerTouch &touch : newTouches) {
+		if(touch.missing)
+			touch.imminent = false;
+	}
+}
 
-    /* Add 'missing' touches back */
-    for(auto &i : curTouches) {
-        if(i.id >= 0 && (!i.missing || i.missingAge < 3)) {
-            i.missingAge = (i.missing) ? i.missingAge+1 : 0;
-            i.missing = true;
-            i.statusAge++;
-            i.touchAge++;
-            newTouches.push_back(i);
-        }
-    }
+void IRDepthTouchTracker::mergeTouches(FrameVector<FingerTouch>::type &newTouches, float dt) {
+	mergeDetections(associator, touches, newTouches, nextTouchId, dt);
+}
 
-    /* Handle new touches and output */
-    vector<FingerTouch> finalTouches;
-    for(auto &i : newTouches) {
-        if(i.id < 0) {
-            i.id = nextTouchId++;
-            i.statusAge = i.touchAge = 0;
-        }
-        finalTouches.push_back(i);
-    }
+#pragma region Pipeline
+/* Take the next sensor frame, if there is one, into the frame's snapshot */
+bool IRDepthTouchTracker::captureFrame(IRDepthFrame &frame) {
+	{
+		ofScopedLock lock(replayLock);
+		if(replay) {
+			/* Recorded frames become available at a fixed rate; pick up the newest one */
+			uint64_t now = ofGetElapsedTimeMicros();
+			const uint64_t period = (uint64_t)(1000000 / replayRate);
+			int available = min((int)((now - replayStart) / period) + 1, (int)replay->depth.size());
+			if(available <= replayNext) {
+				uint64_t nextTime = replayStart + replayNext * period;
+				ofSleepMillis(max((int)((nextTime - now) / 1000), 1));
+				return false;
+			}
+			int idx = available - 1;
+			replayDropped += idx - replayNext;
+			replayNext = available;
+			frame.availableTime = replayStart + idx * period;
+			frame.replayIndex = idx;
+			frame.sensorTimestamp = 0;
+			frame.depth.assign(replay->depth[idx].begin(), replay->depth[idx].end());
+			frame.ir.assign(replay->ir[idx].begin(), replay->ir[idx].end());
+			if(replayNext == replay->depth.size())
+				replay.reset();
+			return true;
+		}
+	}
 
-    return finalTouches;
+	// Check if the depth frame is new
+	uint64_t curDepthTimestamp = depthStream.getFrameTimestamp();
+	if(lastDepthTimestamp == curDepthTimestamp) {
+		ofSleepMillis(5);
+		return false;
+	}
+	lastDepthTimestamp = curDepthTimestamp;
+
+	frame.availableTime = ofGetElapsedTimeMicros();
+	frame.replayIndex = -1;
+	frame.sensorTimestamp = curDepthTimestamp;
+	const uint16_t *depthPx = depthStream.getPixelsRef().getPixels();
+	const uint16_t *irPx = irStream.getPixelsRef().getPixels();
+	frame.depth.assign(depthPx, depthPx + w * h);
+	frame.ir.assign(irPx, irPx + w * h);
+	return true;
 }
 
-void IRDepthTouchTracker::threadedFunction() {
-	uint64_t lastDepthTimestamp = 0;
-	int curDepthFrame = 0;
-	fps.fps = 30; // estimated fps
+void IRDepthTouchTracker::prepareFrame(IRDepthFrame &frame) {
+	uint64_t startTime = ofGetElapsedTimeMicros();
+	uint64_t allocationsBefore = prepareAllocations.getCount();
 
-	while(isThreadRunning()) {
-		// Check if the depth frame is new
-		uint64_t curDepthTimestamp = depthStream.getFrameTimestamp();
-		if(lastDepthTimestamp == curDepthTimestamp) {
-			ofSleepMillis(5);
-			continue;
-		}
-		lastDepthTimestamp = curDepthTimestamp;
-		curDepthFrame++;
-		fps.update();
+	updateZoneTiles();
 
-		buildDiffImage();
-		buildEdgeImage(); // edge image depends on diff
+	/* The frame keeps one quality level throughout. Carried-over tiles were built at the old level, so start over if it changed. */
+	frame.quality = governor.getLevel();
+	if(frame.quality != preparedQuality) {
+		preparedQuality = frame.quality;
+		framesSinceRefresh = full_refresh_interval;
+	}
 
-		vector<IRDepthArm> arms = detectTouches();
+	{
+		AllocationCounter::Scope countScope(prepareAllocations);
+
+		findDirtyTiles(frame);
+		frame.processed = frame.dirtyTiles > 0;
+		if(frame.processed) {
+			buildDiffImage(frame, (lastProcessedFrame >= 0) ? frames[lastProcessedFrame].get() : NULL);
+			if(frame.idle) {
+				/* Nothing on the table: skip the edges and segmentation entirely */
+				frame.regions.clear();
+			} else {
+				findRegions(frame);
+				buildEdgeImage(frame); // edge image depends on diff and regions
+			}
+		} else {
+			frame.idle = frames[lastProcessedFrame]->idle;
+			if(fused)
+				updateBackgroundOnly(frame);
+			else
+				frame.diffTime = frame.backgroundTime = 0;
+		}
+	}
+	background.reportForeground(!frame.idle);
+	frame.allocations = (int)(prepareAllocations.getCount() - allocationsBefore);
+	frame.stageTimes[0] = (ofGetElapsedTimeMicros() - startTime) / 1000.0f;
+}
 
-		vector<FingerTouch> newTouches;
-		for(const IRDepthArm &arm : arms) {
-			for(const IRDepthHand &hand : arm.hands) {
-				for(const IRDepthFinger &finger : hand.fingers) {
-					FingerTouch touch;
-					touch.tip.set(finger.x, finger.y);
-					touch.touchZ = finger.z;
-					newTouches.push_back(touch);
+void IRDepthTouchTracker::segmentFrame(IRDepthFrame &frame) {
+	uint64_t startTime = ofGetElapsedTimeMicros();
+	uint64_t allocationsBefore = segmentAllocations.getCount();
+	{
+		AllocationCounter::Scope countScope(segmentAllocations);
+		frameArena.reset();
+		FrameArena::Scope arenaScope(frameArena);
+
+		frame.detections.clear();
+		if(frame.processed && frame.idle) {
+			/* Publish an empty touch set. The blob planes are only cleared for display. */
+			if(frame.quality < QUALITY_NO_DEBUG) {
+				fill(frame.blobPlane.begin(), frame.blobPlane.end(), 0);
+				fill(frame.colorPlane.begin(), frame.colorPlane.end(), 0);
+			}
+			lastDetections.clear();
+		} else if(frame.processed) {
+			FrameVector<IRDepthArm>::type arms = detectTouches(frame);
+
+			for(const IRDepthArm &arm : arms) {
+				for(const IRDepthHand &hand : arm.hands) {
+					for(const IRDepthFinger &finger : hand.fingers) {
+						FingerTouch touch;
+						touch.tip.set(finger.x, finger.y);
+						touch.touchZ = finger.z;
+						frame.detections.push_back(touch);
+					}
 				}
 			}
+			lastDetections.assign(frame.detections.begin(), frame.detections.end());
+		} else {
+			/* Nothing moved: the last frame's detections still stand */
+			frame.detections.assign(lastDetections.begin(), lastDetections.end());
 		}
+	}
+	frame.allocations += (int)(segmentAllocations.getCount() - allocationsBefore);
+	frame.stageTimes[1] = (ofGetElapsedTimeMicros() - startTime) / 1000.0f;
+}
+
+void IRDepthTouchTracker::publishFrame(int frameIdx) {
+	IRDepthFrame &frame = *frames[frameIdx];
 
-		vector<FingerTouch> curTouches = touches;
+	uint64_t startTime = ofGetElapsedTimeMicros();
+	uint64_t allocationsBefore = publishAllocations.getCount();
+	{
+		AllocationCounter::Scope countScope(publishAllocations);
+		mergeArena.reset();
+		FrameArena::Scope arenaScope(mergeArena);
+
+		FrameVector<FingerTouch>::type newTouches(frame.detections.begin(), frame.detections.end());
+		const float dt = (lastMergeTime && frame.availableTime > lastMergeTime) ? (frame.availableTime - lastMergeTime) / 1e6f : frame_budget / 1000;
+		lastMergeTime = frame.availableTime;
+		mergeTouches(newTouches, dt);
 		{
 			ofScopedLock lock(touchLock);
-			touches = mergeTouches(curTouches, newTouches);
+			touches.assign(newTouches.begin(), newTouches.end()); // reuses the existing buffer
 			touchesUpdated = true;
 		}
+		deliverTouches(frame.sensorTimestamp, frame.availableTime);
+	}
+	const int allocations = frame.allocations + (int)(publishAllocations.getCount() - allocationsBefore);
+	frameAllocations = allocations;
+	frame.stageTimes[2] = (ofGetElapsedTimeMicros() - startTime) / 1000.0f;
+	fps.update();
+
+	/* Serially the stages share the budget; pipelined, the slowest stage sets the pace. Quiet frames skip
+	   most of the work, so they say nothing about the cost of a real frame. */
+	if(frame.processed) {
+		float frameTime = pipelined
+			? max(max(frame.stageTimes[0], frame.stageTimes[1]), frame.stageTimes[2])
+			: frame.stageTimes[0] + frame.stageTimes[1] + frame.stageTimes[2];
+		governor.update(frameTime);
+	}
+
+	{
+		ofScopedLock lock(statsLock);
+		statsEnd = ofGetElapsedTimeMicros();
+		latencies[statsFrames % stats_max_frames] = (statsEnd - frame.availableTime) / 1000.0f;
+		statsFrames++;
+		statsTiles += tileCols * tileRows;
+		statsDiffTime += frame.diffTime;
+		statsBackgroundTime += frame.backgroundTime;
+		statsCandidateTiles += frame.candidateTiles;
+		if(statsFrames > stats_warmup_frames && allocations > 0)
+			statsAllocatingFrames++;
+	}
+
+	/* Keep what replayed frames found, unless they are from a replay which has since been restarted */
+	if(frame.replayIndex >= 0) {
+		ofScopedLock lock(replayLock);
+		if(frame.replayIndex < replayResults.size()) {
+			IRDepthReplayFrame &result = replayResults[frame.replayIndex];
+			result.published = true;
+			result.detections.assign(frame.detections.begin(), frame.detections.end());
+			result.allocations = allocations;
+		}
+	}
+
+	/* The display frame stays put until a newer processed frame replaces it, because the next prepareFrame
+	   may still be carrying tiles over from it. */
+	if(frame.processed) {
+		int lastDisplayFrame;
+		{
+			ofScopedLock lock(displayLock);
+			lastDisplayFrame = displayFrame;
+			displayFrame = frameIdx;
+			/* Only one frame is pinned at a time, so any frame retired earlier is free by now */
+			if(lastDisplayFrame >= 0 && lastDisplayFrame == pinnedFrame)
+				swap(lastDisplayFrame, retiredFrame);
+		}
+		if(lastDisplayFrame >= 0)
+			freeFrames.push(lastDisplayFrame);
+	} else {
+		freeFrames.push(frameIdx);
+	}
+}
+
+/* Wait for a frame from another stage; returns false if the pipeline is stopping */
+bool IRDepthTouchTracker::waitForFrame(FrameQueue &queue, int &frameIdx) {
+	for(int spins=0; !queue.pop(frameIdx); spins++) {
+		if(!pipelineRunning)
+			return false;
+		/* Spin briefly, since frames usually follow each other closely */
+		if(spins < 100)
+			std::this_thread::yield();
+		else
+			ofSleepMillis(1);
+	}
+	return true;
+}
+
+/* Take back the retired display frame, if drawDebug has let go of it. Capture only. */
+bool IRDepthTouchTracker::reclaimRetiredFrame(int &frameIdx) {
+	ofScopedLock lock(displayLock);
+	if(retiredFrame < 0 || retiredFrame == pinnedFrame)
+		return false;
+	frameIdx = retiredFrame;
+	retiredFrame = -1;
+	return true;
+}
+
+/* Put every frame back in the free queue, except one drawDebug still holds, before the stages start. Frames
+   left in the queues by an earlier run are dropped first, so that no frame is queued twice. */
+void IRDepthTouchTracker::resetFrameQueues() {
+	int frameIdx;
+	while(freeFrames.pop(frameIdx)) {}
+	while(preparedFrames.pop(frameIdx)) {}
+	while(segmentedFrames.pop(frameIdx)) {}
+
+	ofScopedLock lock(displayLock);
+	displayFrame = -1;
+	retiredFrame = pinnedFrame;
+	for(int i=0; i<frames.size(); i++) {
+		if(i != pinnedFrame)
+			freeFrames.push(i);
+	}
+	lastProcessedFrame = -1;
+}
+
+void IRDepthTouchTracker::segmentStage() {
+	int frameIdx;
+	while(waitForFrame(preparedFrames, frameIdx)) {
+		segmentFrame(*frames[frameIdx]);
+		segmentedFrames.push(frameIdx);
+	}
+}
+
+void IRDepthTouchTracker::publishStage() {
+	int frameIdx;
+	while(waitForFrame(segmentedFrames, frameIdx)) {
+		publishFrame(frameIdx);
+	}
+}
+
+void IRDepthTouchTracker::threadedFunction() {
+	fps.fps = 30; // estimated fps
+
+	resetFrameQueues();
+
+	pipelineRunning = true;
+	if(pipelined) {
+		segmentThread.startThread();
+		publishThread.startThread();
+	}
+
+	int frameIdx = -1;
+	while(isThreadRunning()) {
+		/* Wait for a free workspace first, so that the freshest sensor frame goes into it */
+		if(frameIdx < 0 && !freeFrames.pop(frameIdx) && !reclaimRetiredFrame(frameIdx)) {
+			ofSleepMillis(1);
+			continue;
+		}
+		IRDepthFrame &frame = *frames[frameIdx];
+		if(!captureFrame(frame))
+			continue;
+
+		prepareFrame(frame);
+		if(frame.processed)
+			lastProcessedFrame = frameIdx;
+
+		if(pipelined) {
+			preparedFrames.push(frameIdx);
+		} else {
+			segmentFrame(frame);
+			publishFrame(frameIdx);
+		}
+		frameIdx = -1;
+	}
 
-		front = !front;
+	pipelineRunning = false;
+	if(pipelined) {
+		segmentThread.waitForThread(false);
+		publishThread.waitForThread(false);
 	}
 }
+#pragma endregion
 
 void IRDepthTouchTracker::drawDebug(float x, float y) {
 	const int dw = depthStream.getWidth();
 	const int dh = depthStream.getHeight();
 
-	int back = !front;
-
-	diffIm[back].reloadTexture();
-	edgeIm[back].reloadTexture();
-	blobIm[back].reloadTexture();
+	/* Pin the display frame, so that capture can't reuse it while it is drawn */
+	int frameIdx;
+	{
+		ofScopedLock lock(displayLock);
+		frameIdx = pinnedFrame = displayFrame;
+	}
+	if(frameIdx < 0)
+		return;
+	const IRDepthFrame &frame = *frames[frameIdx];
+	renderDebugImages(frame);
 
-	diffIm[back].draw(x, y);
-	edgeIm[back].draw(x, y+dh);
-	diffIm[back].draw(x+dw, y);
-	edgeIm[back].draw(x+dw, y);
+	diffIm.draw(x, y);
+	edgeIm.draw(x, y+dh);
+	diffIm.draw(x+dw, y);
+	edgeIm.draw(x+dw, y);
 
-	blobIm[back].draw(x+dw, y+dh);
+	blobIm.draw(x+dw, y+dh);
 	
-	drawText("Diff", x, y, HAlign::left, VAlign::top);
-	drawText("Edge", x, y+dh, HAlign::left, VAlign::top);
-	drawText("Diff+Edge", x+dw, y, HAlign::left, VAlign::top);
-	drawText("Blob", x+dw, y+dh, HAlign::left, VAlign::top);
+	IRDepthPipelineStats stats = getStats();
+	drawText(frame.idle ? "Diff (idle)" : "Diff", x, y, HAlign::left, VAlign::top);
+	drawText("Edge (" + ofToString(frame.dirtyTiles) + " dirty tiles" + (cascade ? ", " + ofToString(frame.candidateTiles) + " kept by cascade)" : ")"),
+		x, y+dh, HAlign::left, VAlign::top);
+	drawText(string(pipelined ? "Diff+Edge (pipelined, " : "Diff+Edge (") + ofToString(stats.p50Latency, 1) + " ms latency, "
+		+ governor.getLevelName() + ")", x+dw, y, HAlign::left, VAlign::top);
+	drawText("Blob (" + ofToString(frameAllocations.load()) + " allocs/frame)", x+dw, y+dh, HAlign::left, VAlign::top);
+
+	ofScopedLock lock(displayLock);
+	pinnedFrame = -1;
+}
+
+/* Expand the tracking planes into RGBA images, in the layouts described in the header */
+void IRDepthTouchTracker::renderDebugImages(const IRDepthFrame &frame) {
+	static const uint32_t zoneColors[8] = {0x00000000, 0xff000000, 0xff400000, 0xff800000, 0xffc00000};
+	const int n = w * h;
+
+	const uint16_t *diffPx = &frame.diffPlane[0];
+	const uint8_t *classPx = &frame.classPlane[0];
+	const uint16_t *blobPx = &frame.blobPlane[0];
+	const uint8_t *colorPx = &frame.colorPlane[0];
+
+	uint32_t *diffImPx = (uint32_t *)diffIm.getPixels();
+	uint32_t *edgeImPx = (uint32_t *)edgeIm.getPixels();
+	uint32_t *blobImPx = (uint32_t *)blobIm.getPixels();
+
+	for(int i=0; i<n; i++) {
+		diffImPx[i] = zoneColors[ZONE(classPx[i])] | diffPx[i];
+
+		uint32_t edge = 0;
+		if(classPx[i] & EDGE_IR) edge |= 0xffc00000;
+		if(classPx[i] & EDGE_DEPTHREL) edge |= 0xff00ff00;
+		if(classPx[i] & EDGE_DEPTHABS) edge |= 0xff0000ff;
+		edgeImPx[i] = edge;
+
+		/* Flags and reject reason go in B, blob color in G, distance in R */
+		blobImPx[i] = zoneColors[blobPx[i] >> 13] | ((blobPx[i] & 0x1f00) << 8) | (colorPx[i] << 8) | BLOB_DIST(blobPx[i]);
+	}
+
+	diffIm.reloadTexture();
+	edgeIm.reloadTexture();
+	blobIm.reloadTexture();
 }
 
 /* update() function called from the main thread */
@@ -838,16 +1807,313 @@ bool IRDepthTouchTracker::update(vector<FingerTouch> &retTouches) {
 IRDepthTouchTracker::~IRDepthTouchTracker() {
 	stopThread();
 	waitForThread();
+	/* Hand the background back to its own thread (after any pass of ours still in flight) */
+	if(fused)
+		background.setExternalUpdate(false);
+}
+
+IRDepthFrame::IRDepthFrame(int w, int h)
+: availableTime(0), sensorTimestamp(0), replayIndex(-1), processed(false), idle(false), quality(0), diffTime(0), backgroundTime(0), dirtyTiles(0), candidateTiles(0), allocations(0),
+  depth(w * h), ir(w * h), diffPlane(w * h), classPlane(w * h), blobPlane(w * h), colorPlane(w * h) {
+	detections.reserve(64);
+	fill_n(stageTimes, 3, 0.0f);
 }
 
 IRDepthTouchTracker::IRDepthTouchTracker(ofxKinect2::DepthStream &depthStream, ofxKinect2::IrStream &irStream, BackgroundUpdaterThread &background)
-: TouchTracker(depthStream, irStream, background) {
-	front = 0;
+: TouchTracker(depthStream, irStream, background), frameArena(64 << 10), mergeArena(16 << 10), associator(track_gate),
+  governor("IRDepthTouchTracker", frame_budget),
+  segmentThread(*this, &IRDepthTouchTracker::segmentStage), publishThread(*this, &IRDepthTouchTracker::publishStage),
+  pool(WorkerPool::shared()) {
+	frameAllocations = 0;
 
+	/* The frame being worked on, plus the one on display */
 	for(int i=0; i<2; i++) {
-		diffIm[i].allocate(w, h, OF_IMAGE_COLOR_ALPHA);
-		edgeIm[i].allocate(w, h, OF_IMAGE_COLOR_ALPHA);
-		blobIm[i].allocate(w, h, OF_IMAGE_COLOR_ALPHA);
+		frames.push_back(ofPtr<IRDepthFrame>(new IRDepthFrame(w, h)));
 	}
+	pipelined = false;
+	pipelineRunning = false;
+	lastProcessedFrame = -1;
+	displayFrame = pinnedFrame = retiredFrame = -1;
+	lastDepthTimestamp = 0;
+	lastMergeTime = 0;
+
+	replayStart = 0;
+	replayRate = 30;
+	replayNext = 0;
+	replayDropped = 0;
+	latencies.resize(stats_max_frames);
+	statsFrames = 0;
+	statsTiles = statsCandidateTiles = 0;
+	statsDiffTime = statsBackgroundTime = 0;
+	statsAllocatingFrames = 0;
+	statsStart = statsEnd = ofGetElapsedTimeMicros();
+
+	diffIm.allocate(w, h, OF_IMAGE_COLOR_ALPHA);
+	edgeIm.allocate(w, h, OF_IMAGE_COLOR_ALPHA);
+	blobIm.allocate(w, h, OF_IMAGE_COLOR_ALPHA);
 	irCanny.allocate(w, h);
+	irCannyHalf.create((h + 1) / 2, (w + 1) / 2, CV_8UC1);
+	cannyQueue.reserve(w * h);
+	coarseQueue.reserve((w / coarse_scale + 2) * (h / coarse_scale + 2));
+
+	governor.addLevel("no debug images");
+	governor.addLevel("tight edge regions");
+	governor.addLevel("half-resolution edges");
+	preparedQuality = 0;
+
+	incremental = false;
+	framesSinceRefresh = full_refresh_interval; // start with a full refresh
+	tileCols = background.getTileCols();
+	tileRows = background.getTileRows();
+	refDepth.resize(w * h);
+	refIr.resize(w * h);
+	tileBgGenerations.assign(tileCols * tileRows, -1);
+	tileDirty.assign(tileCols * tileRows, 1);
+	tileEdgesValid.assign(tileCols * tileRows, 0);
+	cascade = false;
+	referenceFloods = false;
+	tileCandidatePixels.assign(tileCols * tileRows, 0);
+	tileCandidate.assign(tileCols * tileRows, 1);
+	tileCandidateAge.assign(tileCols * tileRows, cascade_hold_frames + 1);
+	tileWasCandidate.assign(tileCols * tileRows, 1);
+	fused = false;
+	diffFrame = NULL;
+	diffLast = NULL;
+	diffUpdateBackground = false;
+	bandRuns.resize(tileRows);
+	for(auto &runs : bandRuns) {
+		runs.reserve(BackgroundUpdaterThread::tileSize * 8);
+	}
+	bandForeground.assign(tileRows, 0);
+	bandMicros.assign(tileRows, 0);
+	armClaimedTiles.assign(tileCols * tileRows, 0);
+	armChangedTiles.assign(tileCols * tileRows, 0);
+	edgeTiles.reserve(tileCols * tileRows);
+	edgeRects.reserve(tileCols * tileRows);
+	lastDetections.reserve(64);
+}
+
+void IRDepthTouchTracker::setIncremental(bool incremental) {
+	this->incremental = incremental;
 }
+
+void IRDepthTouchTracker::setFused(bool fused) {
+	this->fused = fused;
+	background.setExternalUpdate(fused);
+}
+
+void IRDepthTouchTracker::setReferenceFloods(bool reference) {
+	referenceFloods = reference;
+}
+
+void IRDepthTouchTracker::setCascade(bool cascade) {
+	this->cascade = cascade;
+}
+
+void IRDepthTouchTracker::setOptimalAssociation(bool optimal) {
+	associator.setOptimalClusterSize(optimal ? optimal_cluster_size : 0);
+}
+
+void IRDepthTouchTracker::setPipelined(bool pipelined) {
+	this->pipelined = pipelined;
+	/* One frame per stage, one on display, and one to let capture run ahead */
+	int numFrames = pipelined ? 5 : 2;
+	while(frames.size() < numFrames) {
+		frames.push_back(ofPtr<IRDepthFrame>(new IRDepthFrame(w, h)));
+	}
+}
+
+void IRDepthTouchTracker::startReplay(const ofPtr<IRDepthRecording> &recording, float hz) {
+	ofScopedLock lock(replayLock);
+	replay = recording;
+	replayRate = hz;
+	replayStart = ofGetElapsedTimeMicros();
+	replayNext = 0;
+	replayDropped = 0;
+	replayResults.assign(recording->depth.size(), IRDepthReplayFrame());
+}
+
+bool IRDepthTouchTracker::isReplaying() {
+	ofScopedLock lock(replayLock);
+	return replay.get() != NULL;
+}
+
+vector<IRDepthReplayFrame> IRDepthTouchTracker::getReplayResults() {
+	ofScopedLock lock(replayLock);
+	return replayResults;
+}
+
+IRDepthPipelineStats IRDepthTouchTracker::getStats() {
+	IRDepthPipelineStats stats;
+	vector<float> sorted;
+	{
+		ofScopedLock lock(statsLock);
+		sorted.assign(latencies.begin(), latencies.begin() + min(statsFrames, stats_max_frames));
+		stats.framesPublished = statsFrames;
+		stats.throughput = (statsEnd > statsStart) ? statsFrames * 1e6 / (statsEnd - statsStart) : 0;
+		stats.workAvoided = (statsTiles > 0) ? 1.0 - (double)statsCandidateTiles / statsTiles : 0;
+		stats.meanDiffTime = (statsFrames > 0) ? statsDiffTime / statsFrames : 0;
+		stats.meanBackgroundTime = (statsFrames > 0) ? statsBackgroundTime / statsFrames : 0;
+		stats.allocatingFrames = statsAllocatingFrames;
+	}
+	{
+		ofScopedLock lock(replayLock);
+		stats.framesDropped = replayDropped;
+	}
+
+	std::sort(sorted.begin(), sorted.end());
+	stats.meanLatency = stats.p50Latency = stats.p99Latency = stats.maxLatency = 0;
+	if(!sorted.empty()) {
+		double sum = 0;
+		for(float latency : sorted)
+			sum += latency;
+		stats.meanLatency = sum / sorted.size();
+		stats.p50Latency = sorted[sorted.size() / 2];
+		stats.p99Latency = sorted[(int)(sorted.size() * 0.99)];
+		stats.maxLatency = sorted.back();
+	}
+	return stats;
+}
+
+void IRDepthTouchTracker::resetStats() {
+	ofScopedLock lock(statsLock);
+	statsFrames = 0;
+	statsTiles = statsCandidateTiles = 0;
+	statsDiffTime = statsBackgroundTime = 0;
+	statsAllocatingFrames = 0;
+	statsStart = statsEnd = ofGetElapsedTimeMicros();
+}
+
+#pragma region Anticipation Evaluation
+/* Follows the imminent states through a sequence of merged frames */
+class AnticipationCounter {
+	struct Pending {
+		double onset, contact; // s: when the state was raised, and the contact time estimated then
+	};
+	map<int, Pending> pending; // by touch ID
+	double leadSum, errorSum;
+
+public:
+	IRDepthAnticipationStats stats;
+
+	AnticipationCounter() : leadSum(0), errorSum(0) {
+		memset(&stats, 0, sizeof(stats));
+	}
+
+	/* Touches of the frame captured at time t (s) */
+	template<typename TouchVector>
+	void update(const TouchVector &touches, double t) {
+		set<int> seen;
+		for(const FingerTouch &touch : touches) {
+			seen.insert(touch.id);
+			auto it = pending.find(touch.id);
+			if(touch.touched && touch.statusAge == 0) {
+				stats.touchDowns++;
+				if(it != pending.end()) {
+					stats.anticipated++;
+					leadSum += t - it->second.onset;
+					errorSum += fabs(t - it->second.contact);
+					pending.erase(it);
+				}
+			} else if(touch.imminent && it == pending.end()) {
+				stats.anticipations++;
+				Pending p = {t, t + touch.contactTime};
+				pending[touch.id] = p;
+			} else if(!touch.imminent && it != pending.end()) {
+				stats.cancelled++;
+				pending.erase(it);
+			}
+		}
+		for(auto it = pending.begin(); it != pending.end(); ) {
+			if(!seen.count(it->first)) {
+				stats.cancelled++;
+				pending.erase(it++);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	IRDepthAnticipationStats finish() {
+		stats.meanLead = stats.anticipated ? leadSum * 1000 / stats.anticipated : 0;
+		stats.meanContactError = stats.anticipated ? errorSum * 1000 / stats.anticipated : 0;
+		return stats;
+	}
+};
+
+IRDepthAnticipationStats evaluateTouchAnticipation(const vector<IRDepthReplayFrame> &frames, float hz) {
+	TouchAssociator associator(track_gate);
+	AnticipationCounter counter;
+	vector<FingerTouch> touches, newTouches;
+	int nextTouchId = 1;
+	int lastFrame = -1;
+	for(int i=0; i<frames.size(); i++) {
+		if(!frames[i].published)
+			continue;
+		const float dt = (lastFrame >= 0) ? (i - lastFrame) / hz : 1 / hz;
+		lastFrame = i;
+		newTouches = frames[i].detections;
+		mergeDetections(associator, touches, newTouches, nextTouchId, dt);
+		touches.swap(newTouches);
+		counter.update(touches, i / hz);
+	}
+	return counter.finish();
+}
+
+/* Uniform in [lo, hi) from the evaluation's own generator, so that it neither reseeds nor draws from ofRandom's */
+static float uniform(std::mt19937 &rng, float lo, float hi) {
+	return std::uniform_real_distribution<float>(lo, hi)(rng);
+}
+
+static float gaussian(std::mt19937 &rng, float sigma) {
+	float u = max(uniform(rng, 0, 1), 1e-6f), v = uniform(rng, 0, 1);
+	return sigma * sqrt(-2 * log(u)) * cos(TWO_PI * v);
+}
+
+float evaluateSyntheticTouchAnticipation() {
+	const int APPROACHES = 400;
+	const float HZ = 30, Z_NOISE = 0.4f; // mm
+
+	/* Each approach: hover, descend with a minimum-jerk profile, rest, then lift off. Every third one stops
+	   short of the surface. */
+	std::mt19937 rng(1);
+	vector<IRDepthReplayFrame> frames;
+	int taps = 0;
+	for(int i=0; i<APPROACHES; i++) {
+		const bool tap = (i % 3 != 2);
+		taps += tap;
+		const float hover = uniform(rng, 6, 25), rest = tap ? uniform(rng, -0.5f, 0.5f) : uniform(rng, 3.5f, 6);
+		const float descent = uniform(rng, 0.1f, 0.35f), hold = uniform(rng, 0.2f, 0.5f); // s
+		const ofPoint tip(uniform(rng, 50, 460), uniform(rng, 50, 370));
+		const int hoverFrames = (int)(uniform(rng, 0.2f, 0.5f) * HZ);
+		const int descentFrames = (int)(descent * HZ), holdFrames = (int)(hold * HZ);
+		for(int k=0; k<hoverFrames + descentFrames + holdFrames * 2; k++) {
+			float z;
+			if(k < hoverFrames) {
+				z = hover;
+			} else if(k < hoverFrames + descentFrames + holdFrames) {
+				const float u = min((k - hoverFrames) / (descent * HZ), 1.0f);
+				z = hover + (rest - hover) * u * u * u * (10 + u * (-15 + u * 6));
+			} else {
+				z = hover;
+			}
+			IRDepthReplayFrame frame;
+			frame.published = true;
+			frame.detections.resize(1);
+			frame.detections[0].tip = tip;
+			frame.detections[0].touchZ = z + gaussian(rng, Z_NOISE);
+			frames.push_back(frame);
+		}
+		frames.push_back(IRDepthReplayFrame()); // the hand leaves between approaches
+		frames.back().published = true;
+	}
+
+	IRDepthAnticipationStats stats = evaluateTouchAnticipation(frames, HZ);
+	const float falseRate = stats.anticipations ? (float)stats.cancelled / stats.anticipations : 0;
+	ofLogNotice("IRDepthTouchTracker") << ofVAArgsToString("%d approaches (%d taps): %d touch-downs, %d anticipated, %.0f ms early on average (contact estimate off by %.0f ms)",
+		APPROACHES, taps, stats.touchDowns, stats.anticipated, stats.meanLead, stats.meanContactError);
+	ofLogNotice("IRDepthTouchTracker") << ofVAArgsToString("%d anticipations, %d cancelled: %.1f%% false",
+		stats.anticipations, stats.cancelled, falseRate * 100);
+	return falseRate;
+}
+#pragma endregion
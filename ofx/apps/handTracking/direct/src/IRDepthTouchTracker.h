@@ -13,10 +13,27 @@
 #include "ofxOpenCv.h"
 
 #include "TouchTracker.h"
+#include "WorkerPool.h"
+#include "FrameArena.h"
+#include "AllocationCounter.h"
+#include "SPSCQueue.h"
+#include "FrameGovernor.h"
+#include "TouchAssociator.h"
+
+struct IRDepthRun {
+	unsigned start, end; // pixel index range [start, end) within a single row
+};
+
+struct IRDepthRegion {
+	int x0, y0, x1, y1; // pixel bounds [x0, x1) x [y0, y1)
+};
+
+/* Detection results and flood scratch lists are allocated from frame arenas, and only live for one frame. */
+typedef FrameVector<unsigned>::type IRDepthPixels;
 
 struct IRDepthTip {
-	vector<unsigned> pixels;
-	vector<unsigned> roots; // pixels next to midconf/highconf pixels
+	IRDepthPixels pixels;
+	IRDepthPixels roots; // pixels next to midconf/highconf pixels
 };
 
 struct IRDepthFinger {
@@ -24,49 +41,314 @@ struct IRDepthFinger {
 };
 
 struct IRDepthHand {
-	vector<IRDepthFinger> fingers;
+	FrameVector<IRDepthFinger>::type fingers;
 };
 
 struct IRDepthArm {
-	vector<IRDepthHand> hands;
+	FrameVector<IRDepthHand>::type hands;
+};
+
+/* Workspace for one frame's trip through the tracker: the sensor snapshot, the tracking planes and
+   the detections. Workspaces are recycled through a small pool, so that in pipelined mode each stage
+   can work on a different frame. */
+struct IRDepthFrame {
+	uint64_t availableTime; // ofGetElapsedTimeMicros() when the sensor frame became available
+	uint64_t sensorTimestamp; // depth stream timestamp of the sensor frame; 0 when replaying
+	int replayIndex; // index of the recorded frame when replaying, else -1
+	bool processed; // false if no tile changed and the last detections were carried over
+	bool idle; // too little foreground for an arm; segmentation is skipped
+	int quality; // governor level the frame is processed at
+	float stageTimes[3]; // ms spent in prepare, segment and publish
+	float diffTime; // ms spent classifying the diff, summed over the threads doing it
+	float backgroundTime; // ms spent updating the background in the tracker's pass when fused, summed likewise
+	int dirtyTiles;
+	int candidateTiles; // tiles the cascade passed on to the full tracker (all of them without the cascade)
+	int allocations; // heap allocations made while processing the frame, over all stages
+
+	vector<uint16_t> depth, ir; // sensor snapshot
+
+	/* Tracking state, kept in compact planes so that the flood fills touch as little memory as possible */
+	vector<uint16_t> diffPlane; // depth difference from the background, mm
+	vector<uint8_t> classPlane; // zone [error/noise/low/mid/high] and IR, depth-relative and depth-absolute edge flags
+	vector<uint16_t> blobPlane; // claiming zone, flags and flood distance
+	vector<uint8_t> colorPlane; // blob colors, only used for display
+
+	vector<IRDepthRun> highRuns; // ZONE_HIGH runs found by buildDiffImage, in raster order
+	vector<IRDepthRegion> regions; // parts of the frame which can hold an arm; edges are only built here
+	vector<FingerTouch> detections; // unmerged touches found in the frame
+
+	IRDepthFrame(int w, int h);
+};
+
+/* Recorded sensor frames, for replaying through the tracker (see IRDepthTouchTracker::startReplay) */
+struct IRDepthRecording {
+	vector<vector<uint16_t> > depth, ir;
+};
+
+/* What the tracker found in one recorded frame, for comparing runs over the same recording */
+struct IRDepthReplayFrame {
+	bool published; // false if the frame was dropped
+	vector<FingerTouch> detections; // unmerged touches
+	int allocations; // heap allocations made while processing the frame (0 unless AllocationCounter::isEnabled())
+
+	IRDepthReplayFrame() : published(false), allocations(0) {}
+};
+
+/* Throughput over the frames published since the last resetStats(), and latency over the most recent of them */
+struct IRDepthPipelineStats {
+	int framesPublished;
+	int framesDropped; // replayed frames which were superseded before they could be picked up
+	double throughput; // published frames per second
+	double meanLatency, p50Latency, p99Latency, maxLatency; // ms from a sensor frame being available to its touches being published
+	double workAvoided; // fraction of tiles the cascade kept from the full tracker
+	double meanDiffTime; // ms per frame spent classifying the diff
+	double meanBackgroundTime; // ms per frame spent updating the background in the tracker's pass (fused only)
+	int allocatingFrames; // frames past the warm-up which made heap allocations (0 unless AllocationCounter::isEnabled())
+};
+
+/* Touch-down anticipation over a sequence of frames (see evaluateTouchAnticipation) */
+struct IRDepthAnticipationStats {
+	int touchDowns; // touches becoming touched
+	int anticipated; // touch-downs which were imminent beforehand
+	int anticipations; // imminent states raised
+	int cancelled; // imminent states which ended without a touch-down: false anticipations
+	double meanLead; // ms: from the imminent state being raised to the touch-down, over anticipated touch-downs
+	double meanContactError; // ms: estimated contact time, when raised, against the actual touch-down
+};
+
+/* Working state for one arm's hand/finger/tip hierarchy. Arms are processed independently
+   (in parallel when there are several), each against its own copy of the blob image. */
+struct IRDepthArmTask {
+	ofPtr<FrameArena> arena; // holds this arm's hands, fingers and flood scratch lists
+	vector<IRDepthRun> runs; // arm pixels
+	vector<unsigned> seeds; // midconf pixels bordering the arm
+	vector<IRDepthRun> handRuns; // pixels of the hand being flooded
+	vector<unsigned> handSeeds; // lowconf pixels bordering that hand
+	IRDepthArm arm;
+	bool found;
+
+	const uint8_t *classPx; // class plane of the frame being processed
+	const uint16_t *depthPx; // depth snapshot of the frame being processed
+	uint16_t *blobPx; // blob plane this task floods into
+	vector<uint16_t> blobBuf; // private blob plane (parallel mode only)
+
+	/* Accepted blobs, in the order in which they receive blob IDs */
+	vector<IRDepthRun> blobRuns;
+	vector<int> blobEnds; // end of each blob in blobRuns
+
+	/* Finger-local scratch space for refloodFinger */
+	vector<int> fingerTile; // guard-banded bounding-box label grid: -1 = not in finger, -2 = unvisited, else distance
+	vector<int> fingerQueue;
 };
 
 class IRDepthTouchTracker : public TouchTracker {
 protected:
 	void threadedFunction();
 
+	/* Pipeline stages. Serially, the tracker thread runs them one after the other; in pipelined mode
+	   segmentation and publishing get a thread each, and frames are handed along through queues. */
+	bool captureFrame(IRDepthFrame &frame);
+	void prepareFrame(IRDepthFrame &frame); // diff, regions and edges
+	void segmentFrame(IRDepthFrame &frame); // floods
+	void publishFrame(int frameIdx); // merge with the existing touches and publish
+	void segmentStage();
+	void publishStage();
+
 	/* Edgemap construction */
-	void buildEdgeImage();
+	void buildEdgeImage(IRDepthFrame &frame);
 	// Fill holes in the irCanny image
 	void fillIrCannyHoles();
 
 	/* Touch tracking stages */
-	void buildDiffImage();
-
-	void rejectBlob(const vector<unsigned> &blob, int reason=0);
+	void findDirtyTiles(IRDepthFrame &frame);
+	void findCandidateTiles(IRDepthFrame &frame);
+	IRDepthRegion tileBounds(int tile) const;
+	void buildDiffImage(IRDepthFrame &frame, const IRDepthFrame *last);
+	void buildDiffBand(int ty);
+	void updateBackgroundOnly(IRDepthFrame &frame);
+	void findRegions(IRDepthFrame &frame);
 
 	int nextBlobId;
-	vector<IRDepthArm> detectTouches();
-	bool floodArm(IRDepthArm &arm, unsigned idx);
-	bool floodHand(IRDepthHand &hand, unsigned idx);
-	bool floodFinger(IRDepthFinger &finger, unsigned idx);
-	bool floodTip(IRDepthTip &tip, unsigned idx);
-	void refloodFinger(const vector<unsigned> &blob, vector<unsigned> &roots);
-	bool computeFingerMetrics(IRDepthFinger &finger, vector<unsigned> &px);
-
-	vector<FingerTouch> mergeTouches(vector<FingerTouch> &curTouches, vector<FingerTouch> &newTouches);
+	FrameVector<IRDepthArm>::type detectTouches(IRDepthFrame &frame);
+	bool findArm(IRDepthArmTask &task, unsigned idx);
+	bool floodArm(IRDepthArmTask &task);
+	bool floodHand(IRDepthArmTask &task, IRDepthHand &hand, unsigned idx);
+	bool floodFinger(IRDepthArmTask &task, IRDepthFinger &finger, unsigned idx);
+	bool floodTip(IRDepthArmTask &task, IRDepthTip &tip, unsigned idx);
+	void refloodFinger(IRDepthArmTask &task, const IRDepthPixels &blob, IRDepthPixels &roots);
+	bool computeFingerMetrics(IRDepthArmTask &task, IRDepthFinger &finger, const IRDepthPixels &px);
+
+	/* Associate this frame's detections with the current touches, in place; dt: s since the last merged frame */
+	uint64_t lastMergeTime; // us: availableTime of the last merged frame
+	void mergeTouches(FrameVector<FingerTouch>::type &newTouches, float dt);
+
+	void renderDebugImages(const IRDepthFrame &frame);
 private:
-	/* Double-buffered images for display's sake */
-	int front;
-	ofImage diffIm[2]; // depth difference image; A=valid B=zone [0=noise/negative 64=close 128=medium 192=far] GR=diff
-	ofImage edgeIm[2]; // edge image; B=IRedge G=depthedge R=depthabs
-	ofImage blobIm[2]; // blob image; B=flags G=blobidx R=dist
+	class StageThread : public ofThread {
+		IRDepthTouchTracker &tracker;
+		void (IRDepthTouchTracker::*stage)();
+	public:
+		StageThread(IRDepthTouchTracker &tracker, void (IRDepthTouchTracker::*stage)()) : tracker(tracker), stage(stage) {}
+		void threadedFunction() { (tracker.*stage)(); }
+	};
+
+	/* Frame workspaces, referred to by index in the queues */
+	vector<ofPtr<IRDepthFrame> > frames;
+	typedef SPSCQueue<int, 8> FrameQueue;
+	FrameQueue freeFrames; // publish -> capture
+	FrameQueue preparedFrames; // prepare -> segment (pipelined mode only)
+	FrameQueue segmentedFrames; // segment -> publish (pipelined mode only)
+	bool waitForFrame(FrameQueue &queue, int &frameIdx);
+
+	bool pipelined;
+	std::atomic<bool> pipelineRunning;
+	StageThread segmentThread, publishThread;
+
+	int preparedQuality; // governor level of the last prepared frame
+	int lastProcessedFrame; // frame the next prepareFrame carries clean tiles over from; owned by capture/prepare
+	/* Display frames: drawDebug pins the one it renders. A display frame replaced while pinned is retired
+	   rather than freed, and capture takes it back once drawDebug lets go of it. */
+	ofMutex displayLock;
+	int displayFrame; // last processed frame to be published; shown by drawDebug
+	int pinnedFrame; // frame drawDebug is rendering, or -1
+	int retiredFrame; // replaced display frame still pinned at the time, or -1
+	bool reclaimRetiredFrame(int &frameIdx);
+	void resetFrameQueues();
+	uint64_t lastDepthTimestamp;
+
+	/* Replay */
+	ofMutex replayLock;
+	ofPtr<IRDepthRecording> replay;
+	uint64_t replayStart; // us
+	float replayRate; // Hz
+	int replayNext; // first recorded frame not yet picked up
+	int replayDropped;
+	vector<IRDepthReplayFrame> replayResults; // by recorded frame index
+
+	/* Statistics, updated as frames are published */
+	ofMutex statsLock;
+	vector<float> latencies; // ms, ring buffer of the most recent frames
+	int statsFrames; // frames published since the last reset
+	uint64_t statsTiles, statsCandidateTiles; // tiles in those frames, and how many of them the cascade kept
+	double statsDiffTime, statsBackgroundTime; // ms
+	int statsAllocatingFrames; // frames past the warm-up which made heap allocations
+	uint64_t statsStart, statsEnd; // us
+
+	/* Debug images, rendered from the display frame when drawn */
+	ofImage diffIm; // depth difference image; A=valid B=zone [0=noise/negative 64=close 128=medium 192=far] GR=diff
+	ofImage edgeIm; // edge image; B=IRedge G=depthedge R=depthabs
+	ofImage blobIm; // blob image; B=flags G=blobidx R=dist
 	ofxCvGrayscaleImage irCanny; // temporary image for canny purposes
+	cv::Mat irCannyHalf; // half-resolution canny image, for degraded frames
+	vector<int> cannyQueue; // fillIrCannyHoles work queue
+
+	/* Coarse segmentation */
+	vector<uint8_t> coarseZones; // max-pooled zone map, coarse_scale px cells
+	vector<int> coarseQueue;
+
+	/* Incremental processing: only tiles whose inputs changed beyond noise are recomputed, the rest are
+	   carried over from the last processed frame. Tiles match the background updater's. */
+	bool incremental;
+	int framesSinceRefresh;
+	int tileCols, tileRows;
+	vector<uint16_t> refDepth, refIr; // inputs each tile was last computed from
+	vector<int> tileBgGenerations; // background generation each tile was last computed against
+	vector<uint8_t> tileDirty; // tiles recomputed this frame
+	vector<uint8_t> tileEdgesValid; // tiles whose edge flags are up to date
+	vector<int> edgeTiles; // tiles whose edges are rebuilt this frame
+	vector<IRDepthRegion> edgeRects; // merged Canny ROIs for those tiles
+	vector<FingerTouch> lastDetections; // detections from the last processed frame; owned by segmentation
+
+	/* Diff classification, by bands of tiles (tile rows). When fused, the pass also updates the background, and
+	   bands are spread over the shared pool, as are the arms when there are several. */
+	bool fused;
+	WorkerPool &pool;
+	IRDepthFrame *diffFrame; // frame being classified
+	const IRDepthFrame *diffLast; // frame clean tiles are carried over from
+	bool diffUpdateBackground; // whether the pass updates the background
+	vector<vector<IRDepthRun> > bandRuns; // ZONE_HIGH runs found in each band
+	vector<int> bandForeground; // midconf + highconf pixels in each band
+	vector<uint64_t> bandMicros; // time spent on each band, background update included
+
+	/* Cascade: a cheap per-tile threshold on the depth difference picks the tiles the full tracker runs on.
+	   The other tiles, and those outside the tracker's zone, are left as ZONE_ERROR; frames without any kept
+	   tile go down the idle path. */
+	bool cascade;
+	vector<int> tileCandidatePixels; // candidate pixels per tile, counted when the tile was last dirty
+	vector<int> tileCandidateAge; // frames since each tile was last picked by the cheap stage
+	vector<uint8_t> tileCandidate; // tiles kept this frame, cascade and zone both
+	vector<uint8_t> tileWasCandidate; // tiles kept when the planes were last built
+
+	/* Per-arm processing */
+	bool referenceFloods; // flood arms and hands pixel by pixel, breadth first
+	vector<IRDepthArmTask> armTasks; // reused between frames to keep their buffers
+	vector<uint16_t> armSnapshot; // blob plane after arm discovery
+	vector<uint8_t> armClaimedTiles; // tiles within reach of the pixels of the arms merged so far
+	vector<uint8_t> armChangedTiles; // tiles the arm being merged changed
+
+	/* Per-frame memory: the tracker should not touch the heap once it has warmed up */
+	FrameArena frameArena; // segmentation
+	FrameArena mergeArena; // publishing
+	TouchAssociator associator;
+	AllocationCounter prepareAllocations, segmentAllocations, publishAllocations; // per stage, as stages can run concurrently
+	std::atomic<int> frameAllocations; // heap allocations made while processing the last published frame; shown by drawDebug
 
 public:
+	/* Degrades tracking quality when frames take longer than the sensor frame period */
+	FrameGovernor governor;
+
 	IRDepthTouchTracker(ofxKinect2::DepthStream &depthStream, ofxKinect2::IrStream &irStream, BackgroundUpdaterThread &background);
 	virtual ~IRDepthTouchTracker();
 
 	virtual void drawDebug(float x, float y);
 	virtual bool update(vector<FingerTouch> &retTouches);
+
+	/* Only recompute the tiles whose inputs changed since the last frame, with a full refresh every
+	   full_refresh_interval frames. Changes within noise are carried over, so detections near the noise
+	   thresholds can differ from full processing until the next refresh; off by default until PipelineBenchmark
+	   shows it matches. Arm discovery already starts from the ZONE_HIGH runs the diff records, so floods are
+	   not seeded from the previous frame's arms. */
+	void setIncremental(bool incremental);
+
+	/* Update the background in the tracker's own pass over each frame, instead of on the background thread,
+	   so that the frame and background planes are streamed once. The tracker takes over the background until
+	   it is destroyed; only one tracker per background may be fused. Call before startThread(); returns once
+	   the background thread has finished the pass it was running. */
+	void setFused(bool fused);
+	bool isFused() const { return fused; }
+
+	/* Only run the full tracker on the tiles where a cheap threshold finds foreground, and near them */
+	void setCascade(bool cascade);
+	bool isCascade() const { return cascade; }
+
+	/* Match small crowded clusters of touches to the next frame's detections optimally, rather than greedily */
+	void setOptimalAssociation(bool optimal);
+	bool isOptimalAssociation() const { return associator.getOptimalClusterSize() > 0; }
+
+	/* Flood arms and hands pixel by pixel in breadth-first order, as the tracker did before they were flooded
+	   over runs. Both cover the same pixels, and the next level is seeded in scan order either way, so they
+	   should find the same touches; this is the reference to check that against (see PipelineBenchmark). */
+	void setReferenceFloods(bool reference);
+
+	/* Run diff+edges, segmentation and merging on separate threads, so that a frame can enter the
+	   pipeline before the previous one has left it. Call before startThread(). */
+	void setPipelined(bool pipelined);
+
+	/* Replay recorded frames instead of the live streams, making one available every 1/hz seconds.
+	   The tracker returns to the live streams once the recording has been played. */
+	void startReplay(const ofPtr<IRDepthRecording> &recording, float hz);
+	bool isReplaying();
+	/* Detections for each frame of the last replay, by recorded frame index */
+	vector<IRDepthReplayFrame> getReplayResults();
+
+	IRDepthPipelineStats getStats();
+	void resetStats();
 };
+
+/* Replay the detections of recorded frames (e.g. IRDepthTouchTracker::getReplayResults) through the tracker's
+   touch merging, 1/hz seconds apart, and measure how early and how reliably it anticipates touch-downs */
+IRDepthAnticipationStats evaluateTouchAnticipation(const vector<IRDepthReplayFrame> &frames, float hz);
+
+/* The same on synthetic detections at 30 Hz: fingers tapping the surface, and fingers stopping just above it.
+   Logs the results and returns the share of false anticipations. */
+float evaluateSyntheticTouchAnticipation();
@@ -1,8 +1,11 @@
 #include "OldIRDepthTouchTracker.h"
+#include "GuardBand.h"
+#include "PixelKernels.h"
 
 // constants
 const float DEPTH_NOISE_Z = 1.0f; // z values below this threshold are considered pure noise
 const uint16_t DEPTH_MAX_DIFF = 100; // distances farther than this above the background are considered simply too far away
+const float TRACK_GATE = 100; // px: furthest a touch may move between frames and keep its ID
 
 #pragma region Touch Detection
 static struct BlobColors {
@@ -72,8 +75,11 @@ not_flat:
 		;
 	}
 
+	/* The guard band keeps the fill's neighbour tests in bounds (128 is neither significant nor blank) */
+	fillGuardBand<uint8_t>(ircannypx, w, h, 128);
+
 	/* Find significant pixels and fill outwards */
-	int *queue = new int[w*h]; // queue for above-threshold pixels
+	int *queue = &floodQueue[0]; // queue for above-threshold pixels
 
 	for(int sy=0; sy<h; sy++) {
 		for(int sx=0; sx<w; sx++) {
@@ -92,22 +98,18 @@ not_flat:
 					ircannypx[curidx] = 192;
 				}
 
-				int y = curidx / w;
-				int x = curidx % w;
 				int found = 0;
 
 				// Find unvisited significant neighbours
-#define TEST(dx,dy) do { int xx = x+dx, yy = y+dy; \
-				if(0 <= xx && xx < w && 0 <= yy && yy < h) { \
-					int otheridx = curidx + dy*w + dx; \
-					if(ircannypx[otheridx] <= 192) \
-						continue; /* must be unvisited, real canny pixels */ \
-					found++; \
-					if(ircannypx[otheridx] != 224) \
-						continue; /* already visited, or not significant */ \
-					queue[queuetail++] = otheridx; \
-					ircannypx[otheridx] = 208; \
-				} \
+#define TEST(dx,dy) do { \
+				int otheridx = curidx + dy*w + dx; \
+				if(ircannypx[otheridx] <= 192) \
+					continue; /* must be unvisited, real canny pixels */ \
+				found++; \
+				if(ircannypx[otheridx] != 224) \
+					continue; /* already visited, or not significant */ \
+				queue[queuetail++] = otheridx; \
+				ircannypx[otheridx] = 208; \
 				} while(0)
 				/* Eight-way neighbours, to cross diagonals */
 				TEST(-1, -1);
@@ -129,14 +131,12 @@ not_flat:
 					}
 				} else if(!found) {
 					/* Mark all neighbours as fill candidates */
-#define TEST(dx,dy) do { int xx = x+dx, yy = y+dy; \
-				if(0 <= xx && xx < w && 0 <= yy && yy < h) { \
-					int otheridx = curidx + dy*w + dx; \
-					if(ircannypx[otheridx] != 0) \
-						continue; /* must be blank pixel */ \
-					queue[queuetail++] = otheridx; \
-					ircannypx[otheridx] = 160; \
-				} \
+#define TEST(dx,dy) do { \
+				int otheridx = curidx + dy*w + dx; \
+				if(ircannypx[otheridx] != 0) \
+					continue; /* must be blank pixel */ \
+				queue[queuetail++] = otheridx; \
+				ircannypx[otheridx] = 160; \
 				} while(0)
 				/* Eight-way neighbours, to cross diagonals */
 				TEST(-1, -1);
@@ -153,7 +153,7 @@ not_flat:
 		}
 	}
 
-	delete[] queue;
+	fillGuardBand<uint8_t>(ircannypx, w, h, 0);
 }
 
 
@@ -166,9 +166,11 @@ void OldIRDepthTouchTracker::touchDetectionConnectedComponents(const uint32_t *s
 	static const int MAXDIFF = 20; // mm
 
 	memset(labels, 0, w*h*sizeof(uint32_t));
+	/* Mark the image border as visited, so the fills never leave the image */
+	fillGuardBand<uint32_t>(labels, w, h, 0x01000000);
 
-	int *queue = new int[w*h]; // queue for above-threshold pixels
-	int *queue2 = new int[w*h]; // queue for below-threshold pixels (scanned up to a certain distance from the nearest above-threshold pixel)
+	int *queue = &floodQueue[0]; // queue for above-threshold pixels
+	int *queue2 = &floodQueue2[0]; // queue for below-threshold pixels (scanned up to a certain distance from the nearest above-threshold pixel)
 	int curlabel = 1;
 
 	/* Color components: A=255-dist B=blobidx G,R=coloring */
@@ -191,21 +193,17 @@ void OldIRDepthTouchTracker::touchDetectionConnectedComponents(const uint32_t *s
 				count++;
 				countPeak++;
 
-				int y = curidx / w;
-				int x = curidx % w;
-#define TEST(dx,dy) do { int xx = x+dx, yy = y+dy; \
-				if(0 <= xx && xx < w && 0 <= yy && yy < h) { \
-					int otheridx = curidx + dy*w + dx; \
-					int otherpx = src[otheridx] & 0xffff; \
-					if(labels[otheridx] != 0 || otherpx < BLACKTHRESH || abs(otherpx - curpx) > MAXDIFF) \
-						continue; \
-					if(otherpx < MINPEAKVAL) { \
-						/* Boundary value */ \
-						queue2[queue2tail++] = otheridx | (1 << 24); \
-					} else { \
-						queue[queuetail++] = otheridx; \
-						labels[otheridx] = colors[curlabel] | ((0xff - 0) << 24); \
-					} \
+#define TEST(dx,dy) do { \
+				int otheridx = curidx + dy*w + dx; \
+				int otherpx = src[otheridx] & 0xffff; \
+				if(labels[otheridx] != 0 || otherpx < BLACKTHRESH || abs(otherpx - curpx) > MAXDIFF) \
+					continue; \
+				if(otherpx < MINPEAKVAL) { \
+					/* Boundary value */ \
+					queue2[queue2tail++] = otheridx | (1 << 24); \
+				} else { \
+					queue[queuetail++] = otheridx; \
+					labels[otheridx] = colors[curlabel] | ((0xff - 0) << 24); \
 				} \
 				} while(0)
 				TEST(-1, 0);
@@ -244,15 +242,11 @@ void OldIRDepthTouchTracker::touchDetectionConnectedComponents(const uint32_t *s
 					continue;
 				dist++;
 
-				int y = curidx / w;
-				int x = curidx % w;
-#define TEST(dx,dy) do { int xx = x+dx, yy = y+dy; \
-				if(0 <= xx && xx < w && 0 <= yy && yy < h) { \
-					int otheridx = curidx + dy*w + dx; \
-					int otherpx = src[otheridx] & 0xff; \
-					if(labels[otheridx] != 0) continue; \
-					queue2[queue2tail++] = otheridx | (dist << 24); \
-				} \
+#define TEST(dx,dy) do { \
+				int otheridx = curidx + dy*w + dx; \
+				int otherpx = src[otheridx] & 0xff; \
+				if(labels[otheridx] != 0) continue; \
+				queue2[queue2tail++] = otheridx | (dist << 24); \
 				} while(0)
 				TEST(-1, 0);
 				TEST(1, 0);
@@ -264,170 +258,107 @@ void OldIRDepthTouchTracker::touchDetectionConnectedComponents(const uint32_t *s
 			curlabel++;
 		}
 	}
-
-	delete[] queue;
-	delete[] queue2;
 }
 #pragma endregion
 
 #pragma region Touch Tracking
-vector<FingerTouch> OldIRDepthTouchTracker::touchTrackingConnectedComponents(uint32_t *touchpx) {
+/* Touch pixels not yet given a blob (A=0xff, B=0); R=distance */
+struct TouchPixels : ComponentPixels {
+	const uint32_t *touchpx;
+	TouchPixels(const uint32_t *touchpx) : touchpx(touchpx) {}
+	bool foreground(int i) const { return (touchpx[i] >> 16) == 0xff00; }
+	int distance(int i) const { return touchpx[i] & 0xff; }
+};
+
+/* A blob's tip is the first of its furthest pixels in flood order from its first pixel. The labeler only knows
+   raster order, so when several pixels share the furthest distance, flood the blob up to the first of them. */
+static int floodToFurthest(uint32_t *touchpx, int w, int *queue, const ComponentStats &blob, int curlabel) {
+	int queuehead = 0, queuetail = 0;
+	queue[queuetail++] = blob.firstIndex;
+	touchpx[blob.firstIndex] |= (curlabel << 16);
+	while(queuehead < queuetail) {
+		int curidx = queue[queuehead++];
+		if((touchpx[curidx] & 0xff) == blob.furthestValue)
+			return curidx;
+
+#define TEST(dx,dy) do { \
+		int otheridx = curidx + dy*w + dx; \
+		if((touchpx[otheridx] >> 16) != 0xff00) \
+			continue; \
+		queue[queuetail++] = otheridx; \
+		touchpx[otheridx] |= (curlabel << 16); \
+		} while(0)
+		TEST(-1, -1);
+		TEST(-1, 0);
+		TEST(-1, 1);
+		TEST(0, -1);
+		TEST(0, 1);
+		TEST(1, -1);
+		TEST(1, 0);
+		TEST(1, 1);
+#undef TEST
+	}
+	return blob.furthestIndex;
+}
+
+FrameVector<FingerTouch>::type OldIRDepthTouchTracker::touchTrackingConnectedComponents(uint32_t *touchpx) {
 	static const int MIN_BLOB_SIZE = 4;
 
-	int *queue = new int[w*h];
 	int curlabel = 1;
-	vector<FingerTouch> touches;
-
-	/* Color components: A=255 B=blobidx G=diff R=distance */
-	for(int sy=0; sy<h; sy++) {
-		for(int sx=0; sx<w; sx++) {
-			int idx = sy*w + sx;
-			if((touchpx[idx] >> 16) != 0xff00)
-				continue; // pixel already labeled (B != 0), or not valid (A != 0xff)
+	FrameVector<FingerTouch>::type touches;
 
-			int count = 0;
-			ofVec2f furthestPos;
-			int furthestDist = 0;
-			int sumDiff = 0;
-
-			int queuehead = 0, queuetail = 0;
-			queue[queuetail++] = idx;
-			touchpx[idx] |= (curlabel << 16);
-			while(queuehead < queuetail) {
-				int curidx = queue[queuehead++];
-				int curpx = touchpx[curidx];
-				count++;
-				sumDiff += ((curpx >> 8) & 0xff) - 0x80;
+	/* Eight-way neighbours, to cross diagonals */
+	const vector<ComponentStats> &blobs = labeler.label(ComponentLabeler::CONNECT_8, TouchPixels(touchpx));
+	FrameVector<uint32_t>::type marks(blobs.size() + 1);
 
-				int y = curidx / w;
-				int x = curidx % w;
-
-				int curdist = curpx & 0xff;
-				if(curdist > furthestDist) {
-					furthestPos.set(x, y);
-					furthestDist = curdist;
-				}
-
-#define TEST(dx,dy) do { int xx = x+dx, yy = y+dy; \
-				if(0 <= xx && xx < w && 0 <= yy && yy < h) { \
-					int otheridx = curidx + dy*w + dx; \
-					if((touchpx[otheridx] >> 16) != 0xff00) \
-						continue; \
-					queue[queuetail++] = otheridx; \
-					touchpx[otheridx] |= (curlabel << 16); \
-				} \
-				} while(0)
-				/* Eight-way neighbours, to cross diagonals */
-				TEST(-1, -1);
-				TEST(-1, 0);
-				TEST(-1, 1);
-				TEST(0, -1);
-				TEST(0, 1);
-				TEST(1, -1);
-				TEST(1, 0);
-				TEST(1, 1);
-#undef TEST
-			}
+	/* Color components: A=255 B=blobidx G=diff R=distance */
+	for(int b=0; b<blobs.size(); b++) {
+		const ComponentStats &blob = blobs[b];
+		if(blob.count < MIN_BLOB_SIZE) {
+			/* Reject blob */
+			marks[b+1] = 0;
+			continue;
+		}
 
-			if(count < MIN_BLOB_SIZE) {
-				/* Reject blob */
-				for(int i=0; i<queuehead; i++) {
-					/* Mark as visited, but not part of any blob */
-					touchpx[queue[i]] = 0x4000ff00;
-				}
-				continue;
-			}
+		/* Valid blob! */
+		FingerTouch tp;
+		tp.touched = true;
+		tp.id = curlabel;
+		if(blob.furthestValue > 0) {
+			int tipidx = (blob.furthestCount > 1) ? floodToFurthest(touchpx, w, &floodQueue[0], blob, curlabel) : blob.furthestIndex;
+			tp.tip.set(tipidx % w, tipidx / w);
+		}
+		touches.push_back(tp);
+		marks[b+1] = curlabel << 16;
 
-			/* Valid blob! */
-			FingerTouch tp;
-			tp.touched = true;//(sumDiff / (float)count) < 6;
-			tp.id = curlabel;
-			tp.tip = furthestPos;
-			touches.push_back(tp);
+		curlabel++;
+		if(curlabel == 256)
+			curlabel = 1; // avoid 0
+	}
 
-			curlabel++;
-			if(curlabel == 256)
-				curlabel = 1; // avoid 0
+	labeler.forEachRun([&](const ComponentRun &run) {
+		const uint32_t mark = marks[run.label];
+		for(int i=run.y*w+run.x0; i<run.y*w+run.x1; i++) {
+			if(mark)
+				touchpx[i] |= mark;
+			else
+				touchpx[i] = 0x4000ff00; // visited, but not part of any blob
 		}
-	}
+	});
 
-	delete[] queue;
 	return touches;
 }
 
-vector<FingerTouch> OldIRDepthTouchTracker::mergeTouches(vector<FingerTouch> &curTouches, vector<FingerTouch> &newTouches) {
-    struct touch_dist {
-        int cur_index, new_index;
-        float dist;
-        bool operator<(const struct touch_dist &other) const {
-            return dist < other.dist;
-        }
-    };
-
-    /* Assign each new touch to the nearest cur neighbour */
-    for(auto &i : newTouches) {
-        i.id = -1;
-    }
-
-    vector<touch_dist> distances;
-    for(int i=0; i<curTouches.size(); i++) {
-        for(int j=0; j<newTouches.size(); j++) {
-            float d = curTouches[i].tip.distance(newTouches[j].tip);
-            if(d > 100)
-                continue;
-			touch_dist dist = {i,j,d};
-            distances.push_back(dist);
-        }
-    }
-    std::sort(distances.begin(), distances.end());
-
-    for(const auto &i : distances) {
-        FingerTouch &curTouch = curTouches[i.cur_index];
-        FingerTouch &newTouch = newTouches[i.new_index];
-        /* check if already assigned */
-        if(curTouch.id < 0 || newTouch.id >= 0)
-            continue;
-        /* move cur id into new id */
-        newTouch.id = curTouch.id;
-        curTouch.id = -1;
-        /* copy other attributes */
-        if(curTouch.touched == newTouch.touched) {
-            newTouch.statusAge = curTouch.statusAge + 1;
-        } else {
-            newTouch.statusAge = 0;
-        }
-        newTouch.touchAge = curTouch.touchAge + 1;
+void OldIRDepthTouchTracker::mergeTouches(FrameVector<FingerTouch>::type &newTouches) {
+	associator.associate(touches, newTouches, nextTouchId, [](const FingerTouch &curTouch, FingerTouch &newTouch) {
+		if(curTouch.touched == newTouch.touched) {
+			newTouch.statusAge = curTouch.statusAge + 1;
+		} else {
+			newTouch.statusAge = 0;
+		}
 		/* EWMA new touch */
 		newTouch.tip = 0.50 * (newTouch.tip - curTouch.tip) + curTouch.tip;
-    }
-
-    for(auto &i : newTouches) {
-        i.missing = false;
-        i.missingAge = 0;
-    }
-
-    /* Add 'missing' touches back */
-    for(auto &i : curTouches) {
-        if(i.id >= 0 && (!i.missing || i.missingAge < 3)) {
-            i.missingAge = (i.missing) ? i.missingAge+1 : 0;
-            i.missing = true;
-            i.statusAge++;
-            i.touchAge++;
-            newTouches.push_back(i);
-        }
-    }
-
-    /* Handle new touches and output */
-    vector<FingerTouch> finalTouches;
-    for(auto &i : newTouches) {
-        if(i.id < 0) {
-            i.id = nextTouchId++;
-            i.statusAge = i.touchAge = 0;
-        }
-        finalTouches.push_back(i);
-    }
-
-    return finalTouches;
+	});
 }
 #pragma endregion
 
@@ -444,9 +375,13 @@ void OldIRDepthTouchTracker::threadedFunction() {
 			continue;
 		}
 		lastDepthTimestamp = curDepthTimestamp;
+		uint64_t captureTime = ofGetElapsedTimeMicros();
 		curDepthFrame++;
 		fps.update();
 
+		frameArena.reset();
+		FrameArena::Scope arenaScope(frameArena);
+
 		/* Setup images for touch tracking */
 		auto &depthPixels = depthStream.getPixelsRef();
 		auto &irPixels = irStream.getPixelsRef();
@@ -469,24 +404,8 @@ void OldIRDepthTouchTracker::threadedFunction() {
 		/* Edge finding, lightly tuned parameters */
 		cv::Canny(irCannyMat, irCannyMat, 4000, 8000, 7, true);
 
-		/* Update diff image */
-		for(int i=0; i<n; i++) {
-			/* Update diff image */
-			float diff;
-			float z;
-			if(depthpx[i]) {
-				diff = bgmean[i] - depthpx[i];
-				z = diff / bgstdev[i];
-			} else {
-				diff = 0;
-				z = 0;
-			}
-			// pixels stored in ABGR order: A=valid, B=zone (127=normal, 255=too far), GR=z-value
-			if(bgmean[i] == 0) diffpx[i] = 0;
-			else if(z < DEPTH_NOISE_Z) diffpx[i] = 0xff000000;
-			else if(diff < DEPTH_MAX_DIFF) diffpx[i] = 0xff7f0000 | (uint16_t)diff;
-			else diffpx[i] = 0xffff0000 | (uint16_t)diff;
-		}
+		/* Update diff image. Pixels stored in ABGR order: A=valid, B=zone (127=normal, 255=too far), GR=diff */
+		pixelKernels().zScoreDiff(bgmean, bgstdev, depthpx, diffpx, n, DEPTH_NOISE_Z, DEPTH_MAX_DIFF);
 		
 		fillIrCannyHoles();
 
@@ -525,13 +444,15 @@ void OldIRDepthTouchTracker::threadedFunction() {
 		}
 
 		/* Finally, find blobs in the labelled image. */
-		vector<FingerTouch> newTouches = touchTrackingConnectedComponents(touchpx);
-		vector<FingerTouch> curTouches = touches;
+		fillGuardBand<uint32_t>(touchpx, w, h, 0);
+		FrameVector<FingerTouch>::type newTouches = touchTrackingConnectedComponents(touchpx);
+		mergeTouches(newTouches);
 		{
 			ofScopedLock lock(touchLock);
-			touches = mergeTouches(curTouches, newTouches);
+			touches.assign(newTouches.begin(), newTouches.end());
 			touchesUpdated = true;
 		}
+		deliverTouches(curDepthTimestamp, captureTime);
 	}
 }
 
@@ -573,11 +494,13 @@ OldIRDepthTouchTracker::~OldIRDepthTouchTracker() {
 }
 
 OldIRDepthTouchTracker::OldIRDepthTouchTracker(ofxKinect2::DepthStream &depthStream, ofxKinect2::IrStream &irStream, BackgroundUpdaterThread &background)
-: TouchTracker(depthStream, irStream, background) {
+: TouchTracker(depthStream, irStream, background), labeler(w, h), associator(TRACK_GATE), frameArena(64 << 10) {
 	diffimage.allocate(w, h, OF_IMAGE_COLOR_ALPHA);
 	irCanny.allocate(w, h);
 	blobviz.allocate(w, h, OF_IMAGE_COLOR_ALPHA);
 	touchviz.allocate(w, h, OF_IMAGE_COLOR_ALPHA);
+	floodQueue.resize(w*h);
+	floodQueue2.resize(w*h);
 
 	nextTouchId = 1;
 }
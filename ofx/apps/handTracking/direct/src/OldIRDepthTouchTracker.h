@@ -5,6 +5,9 @@
 #include "ofxOpenCv.h"
 
 #include "TouchTracker.h"
+#include "FrameArena.h"
+#include "ComponentLabeler.h"
+#include "TouchAssociator.h"
 
 class OldIRDepthTouchTracker : public TouchTracker {
 protected:
@@ -13,8 +16,15 @@ protected:
 	/* Touch tracking stages */
 	void fillIrCannyHoles();
 	void touchDetectionConnectedComponents(const uint32_t *src, const uint8_t *edges, uint32_t *labels);
-	vector<FingerTouch> touchTrackingConnectedComponents(uint32_t *touchpx);
-	vector<FingerTouch> mergeTouches(vector<FingerTouch> &curTouches, vector<FingerTouch> &newTouches);
+	FrameVector<FingerTouch>::type touchTrackingConnectedComponents(uint32_t *touchpx);
+	void mergeTouches(FrameVector<FingerTouch>::type &newTouches);
+
+	/* Flood-fill work queues, allocated once (w*h each) */
+	vector<int> floodQueue;
+	vector<int> floodQueue2;
+	ComponentLabeler labeler; // touch blobs
+	TouchAssociator associator;
+	FrameArena frameArena; // touch lists for the frame being processed
 public:
 	/* Images should not be modified outside this class */
 	ofImage diffimage, blobviz, touchviz;
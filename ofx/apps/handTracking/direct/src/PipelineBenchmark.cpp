@@ -0,0 +1,367 @@
+//
+//  PipelineBenchmark.cpp
+//  Serial vs. pipelined vs. cascaded vs. fused IRDepth tracker benchmark on replayed sensor frames.
+//
+//
+
+#include "PipelineBenchmark.h"
+#include "TextUtils.h"
+
+/* Benchmark configuration */
+static const int RECORD_FRAMES = 300; // sensor frames to record (10 s at 30 Hz)
+static const int DRAIN_MILLIS = 200; // time allowed for the last frames to leave the pipeline
+
+static const float MATCH_DIST = 3; // px: a cascade detection this close to a full-tracker detection recalls it
+
+static const int ARM_FRAMES = 90; // synthetic frames per arm count (3 s at 30 Hz)
+
+const PipelineBenchmark::Run PipelineBenchmark::RUNS[] = {
+	{false, false, false, 30, 0, false, false, 1, &PipelineBenchmark::reportReference}, // must come first: the others compare against it
+	{false, false, false, 60, 0, false, false, 1, NULL},
+	{false, false, false, 120, 0, false, false, 1, NULL},
+	{true, false, false, 30, 0, false, false, 1, NULL},
+	{true, false, false, 60, 0, false, false, 1, NULL},
+	{true, false, false, 120, 0, false, false, 1, NULL},
+	{false, true, false, 30, 0, false, false, 1, &PipelineBenchmark::reportCascade},
+	{false, false, true, 30, 0, false, false, 1, &PipelineBenchmark::reportFused},
+	{false, false, false, 30, 0, true, false, 1, &PipelineBenchmark::reportReferenceFloods},
+	{false, false, false, 30, 0, false, true, 1, &PipelineBenchmark::reportIncremental},
+	{false, false, false, 30, 0, false, false, 2, &PipelineBenchmark::reportSteadyState},
+	/* Scaling with the number of arms, processed in parallel */
+	{false, false, false, 30, 1, false, false, 1, &PipelineBenchmark::reportArms},
+	{false, false, false, 30, 2, false, false, 1, &PipelineBenchmark::reportArms},
+	{false, false, false, 30, 3, false, false, 1, &PipelineBenchmark::reportArms},
+	{false, false, false, 30, 4, false, false, 1, &PipelineBenchmark::reportArms},
+	{false, false, false, 30, 5, false, false, 1, &PipelineBenchmark::reportArms},
+	{false, false, false, 30, 6, false, false, 1, &PipelineBenchmark::reportArms},
+	{false, false, false, 30, 7, false, false, 1, &PipelineBenchmark::reportArms},
+	{false, false, false, 30, 8, false, false, 1, &PipelineBenchmark::reportArms},
+};
+const int PipelineBenchmark::NUM_RUNS = sizeof(RUNS) / sizeof(RUNS[0]);
+
+/* Fraction of the reference detections found again in the same frames, over the frames published in both runs */
+static double computeRecall(const vector<IRDepthReplayFrame> &reference, const vector<IRDepthReplayFrame> &results) {
+	int found = 0, total = 0;
+	for(int i=0; i<reference.size() && i<results.size(); i++) {
+		if(!reference[i].published || !results[i].published)
+			continue;
+		for(const FingerTouch &ref : reference[i].detections) {
+			total++;
+			for(const FingerTouch &touch : results[i].detections) {
+				if(ref.tip.distance(touch.tip) <= MATCH_DIST) {
+					found++;
+					break;
+				}
+			}
+		}
+	}
+	return (total > 0) ? (double)found / total : 1.0;
+}
+
+static bool touchLess(const FingerTouch &a, const FingerTouch &b) {
+	if(a.tip.x != b.tip.x)
+		return a.tip.x < b.tip.x;
+	if(a.tip.y != b.tip.y)
+		return a.tip.y < b.tip.y;
+	return a.touchZ < b.touchZ;
+}
+
+/* Frames published in both runs, and how many of them have exactly the same detections, in any order */
+static void compareDetections(const vector<IRDepthReplayFrame> &reference, const vector<IRDepthReplayFrame> &results, int &identical, int &total) {
+	identical = total = 0;
+	vector<FingerTouch> a, b;
+	for(int i=0; i<reference.size() && i<results.size(); i++) {
+		if(!reference[i].published || !results[i].published)
+			continue;
+		total++;
+		a = reference[i].detections;
+		b = results[i].detections;
+		if(a.size() != b.size())
+			continue;
+		sort(a.begin(), a.end(), touchLess);
+		sort(b.begin(), b.end(), touchLess);
+		bool same = true;
+		for(int j=0; j<a.size() && same; j++) {
+			same = a[j].tip == b[j].tip && a[j].touchZ == b[j].touchZ;
+		}
+		if(same)
+			identical++;
+	}
+}
+
+/* Raise a capsule from (x0, y0) to (x1, y1) of radius r (px) to height (mm) over the background, at the given
+   IR brightness; it slopes down by 30% towards its rim */
+static void stampCapsule(vector<uint16_t> &depth, vector<uint16_t> &ir, const float *bgmean, int w, int h,
+	float x0, float y0, float x1, float y1, float r, float height, uint16_t irValue) {
+	const int minx = max(0, (int)(min(x0, x1) - r)), maxx = min(w - 1, (int)(max(x0, x1) + r));
+	const int miny = max(0, (int)(min(y0, y1) - r)), maxy = min(h - 1, (int)(max(y0, y1) + r));
+	const ofVec2f a(x0, y0), ab(x1 - x0, y1 - y0);
+	for(int y=miny; y<=maxy; y++) {
+		for(int x=minx; x<=maxx; x++) {
+			const int i = y*w + x;
+			const ofVec2f ap = ofVec2f(x, y) - a;
+			const float t = (ab.lengthSquared() > 0) ? ofClamp(ap.dot(ab) / ab.lengthSquared(), 0, 1) : 0;
+			const float d = ap.distance(ab * t);
+			if(d > r || bgmean[i] == 0)
+				continue;
+			const uint16_t z = (uint16_t)(bgmean[i] - height * (1 - 0.3f * d / r));
+			if(z < depth[i]) {
+				depth[i] = z;
+				ir[i] = irValue;
+			}
+		}
+	}
+}
+
+/* Frames with the given number of arms reaching in from the top and bottom edges, each with a hand and four
+   fingers touching the surface, swaying from frame to frame */
+static ofPtr<IRDepthRecording> synthesizeArms(const BackgroundUpdaterThread &model, int arms, int frames) {
+	const ofFloatPixels &bg = model.getBackgroundMean();
+	const int w = bg.getWidth(), h = bg.getHeight();
+	const float *bgmean = bg.getPixels();
+
+	ofPtr<IRDepthRecording> recording(new IRDepthRecording());
+	for(int f=0; f<frames; f++) {
+		vector<uint16_t> depth(w * h), ir(w * h, 2000);
+		for(int i=0; i<w*h; i++) {
+			depth[i] = (uint16_t)bgmean[i];
+		}
+
+		const float sway = 10 * sinf(f * 0.2f);
+		for(int k=0; k<arms; k++) {
+			/* Up to four arms per edge; arms from the bottom edge point up */
+			const float dir = (k % 2 == 0) ? 1 : -1;
+			const float x = w * ((k / 2) + 0.5f) / 4 + sway * dir;
+			const float edge = (dir > 0) ? 0 : h - 1;
+			const float wrist = edge + dir * h * 0.2f, palm = wrist + dir * 30; // tips end well short of the middle
+			stampCapsule(depth, ir, bgmean, w, h, x, edge, x, wrist, 22, 85, 6000); // arm
+			stampCapsule(depth, ir, bgmean, w, h, x, wrist, x, palm, 18, 40, 5500); // hand
+			for(int j=0; j<4; j++) {
+				const float fx = x - 15 + j*10, fy = palm + dir * 5;
+				const float tx = fx + (j - 1.5f) * 3, ty = fy + dir * 30;
+				stampCapsule(depth, ir, bgmean, w, h, fx, fy - dir * 10, fx, fy, 5, 20, 5200); // knuckle
+				stampCapsule(depth, ir, bgmean, w, h, fx, fy, tx, ty, 3.5f, 8, 5000); // finger
+				stampCapsule(depth, ir, bgmean, w, h, tx, ty, tx, ty + dir * 6, 3, 1.5f, 4800); // tip
+			}
+		}
+		recording->depth.push_back(depth);
+		recording->ir.push_back(ir);
+	}
+	return recording;
+}
+
+PipelineBenchmark::PipelineBenchmark(ofxKinect2::DepthStream &depthStream, ofxKinect2::IrStream &irStream, BackgroundUpdaterThread &background)
+: depthStream(depthStream), irStream(irStream), background(background) {
+	recording = ofPtr<IRDepthRecording>(new IRDepthRecording());
+	lastDepthTimestamp = 0;
+	curRun = -1;
+	tracker = NULL;
+	runEnd = 0;
+	curPass = 0;
+	backgroundPassTime = 0;
+	failed = false;
+}
+
+PipelineBenchmark::~PipelineBenchmark() {
+	delete tracker;
+}
+
+bool PipelineBenchmark::isDone() const {
+	return curRun >= NUM_RUNS;
+}
+
+/* Replay the recording through a copy of the model as the background thread would, one pass per frame */
+void PipelineBenchmark::timeBackgroundPass() {
+	runBackground->copyModel(*model);
+	const int numTiles = runBackground->getTileCols() * runBackground->getTileRows();
+	double sum = 0;
+	int passes = 0;
+	for(const vector<uint16_t> &depth : recording->depth) {
+		if(!runBackground->beginExternalFrame(&depth[0]))
+			continue;
+		for(int t=0; t<numTiles; t++) {
+			runBackground->updateTile(t);
+		}
+		runBackground->endExternalFrame();
+		sum += runBackground->getLastPassTime();
+		passes++;
+	}
+	backgroundPassTime = (passes > 0) ? (float)(sum / passes) : 0;
+}
+
+void PipelineBenchmark::startRun() {
+	const Run &run = RUNS[curRun];
+
+	BackgroundUpdaterThread *runModel = model.get();
+	if(run.fused) {
+		runBackground = ofPtr<BackgroundUpdaterThread>(new BackgroundUpdaterThread(depthStream));
+		runBackground->governor.setEnabled(false); // same pixel subset as the background thread's full rate
+		runBackground->setExternalUpdate(true);
+		timeBackgroundPass();
+		runBackground->copyModel(*model);
+		runModel = runBackground.get();
+	}
+
+	replayed = (run.arms > 0) ? synthesizeArms(*model, run.arms, ARM_FRAMES) : recording;
+
+	tracker = new IRDepthTouchTracker(depthStream, irStream, *runModel);
+	tracker->setPipelined(run.pipelined);
+	tracker->setCascade(run.cascade);
+	tracker->setFused(run.fused);
+	tracker->setReferenceFloods(run.referenceFloods);
+	tracker->setIncremental(run.incremental);
+	tracker->governor.setEnabled(false); // compare the modes at the same quality
+	tracker->startThread();
+	tracker->resetStats();
+	tracker->startReplay(replayed, run.rate);
+	curPass = 0;
+	runEnd = 0;
+}
+
+/* Also how early and how reliably the touch merging anticipates touch-downs in the recording */
+void PipelineBenchmark::reportReference(const Run &run, const IRDepthPipelineStats &stats, const vector<IRDepthReplayFrame> &results, string &result) {
+	reference = results;
+	IRDepthAnticipationStats anticipation = evaluateTouchAnticipation(reference, run.rate);
+	result += ofVAArgsToString(", %d/%d touch-downs anticipated by %.0f ms, %d/%d anticipations false",
+		anticipation.anticipated, anticipation.touchDowns, anticipation.meanLead, anticipation.cancelled, anticipation.anticipations);
+}
+
+/* The share of the frame the cascade kept from the full tracker, and the reference detections it still found */
+void PipelineBenchmark::reportCascade(const Run &run, const IRDepthPipelineStats &stats, const vector<IRDepthReplayFrame> &results, string &result) {
+	result += ofVAArgsToString(", %.1f%% of tiles avoided, %.1f%% recall", stats.workAvoided * 100, computeRecall(reference, results) * 100);
+}
+
+/* The background update folded into the diff, against the background thread's own pass over the same frames */
+void PipelineBenchmark::reportFused(const Run &run, const IRDepthPipelineStats &stats, const vector<IRDepthReplayFrame> &results, string &result) {
+	result += ofVAArgsToString(" + background %.2f ms (%.2f ms on its own thread)", stats.meanBackgroundTime, backgroundPassTime);
+}
+
+void PipelineBenchmark::reportReferenceFloods(const Run &run, const IRDepthPipelineStats &stats, const vector<IRDepthReplayFrame> &results, string &result) {
+	int identical, total;
+	compareDetections(reference, results, identical, total);
+	result += ofVAArgsToString(", breadth-first floods: %d/%d frames with the same detections as the run-based floods", identical, total);
+}
+
+/* How closely incremental processing matches full processing */
+void PipelineBenchmark::reportIncremental(const Run &run, const IRDepthPipelineStats &stats, const vector<IRDepthReplayFrame> &results, string &result) {
+	int identical, total;
+	compareDetections(reference, results, identical, total);
+	result += ofVAArgsToString(", incremental: %d/%d frames with the same detections as full processing, %.1f%% recall",
+		identical, total, computeRecall(reference, results) * 100);
+}
+
+/* By the last pass every buffer has grown to what these frames need, so none of them may touch the heap again.
+   Any that does fails the benchmark. */
+void PipelineBenchmark::reportSteadyState(const Run &run, const IRDepthPipelineStats &stats, const vector<IRDepthReplayFrame> &results, string &result) {
+	if(!AllocationCounter::isEnabled()) {
+		result += ", steady state: allocations not counted in this build";
+		return;
+	}
+	int allocating = 0;
+	for(const IRDepthReplayFrame &frame : results) {
+		if(frame.allocations > 0)
+			allocating++;
+	}
+	result += ofVAArgsToString(", steady state: %d/%d frames allocated on pass %d", allocating, (int)results.size(), run.passes);
+	if(allocating > 0) {
+		ofLogError("PipelineBenchmark") << "steady-state frames made heap allocations";
+		result = "FAILED " + result;
+		failed = true;
+	}
+}
+
+/* How latency scales with the number of arms */
+void PipelineBenchmark::reportArms(const Run &run, const IRDepthPipelineStats &stats, const vector<IRDepthReplayFrame> &results, string &result) {
+	int published = 0, detections = 0;
+	for(const IRDepthReplayFrame &frame : results) {
+		if(frame.published) {
+			published++;
+			detections += frame.detections.size();
+		}
+	}
+	result = ofVAArgsToString("%d synthetic arm%s, ", run.arms, (run.arms > 1) ? "s" : "") + result
+		+ ofVAArgsToString(", %.1f touches per frame", (published > 0) ? (double)detections / published : 0.0);
+}
+
+void PipelineBenchmark::finishRun() {
+	const Run &run = RUNS[curRun];
+
+	IRDepthPipelineStats stats = tracker->getStats();
+	string result = ofVAArgsToString("%s @ %3.0f Hz: %5.1f fps, %d/%d frames dropped, latency mean %.1f p50 %.1f p99 %.1f max %.1f ms, diff %.2f ms",
+		run.fused ? "fused    " : run.cascade ? "cascade  " : run.pipelined ? "pipelined" : "serial   ", run.rate, stats.throughput, stats.framesDropped, (int)replayed->depth.size(),
+		stats.meanLatency, stats.p50Latency, stats.p99Latency, stats.maxLatency, stats.meanDiffTime);
+	if(run.report)
+		(this->*run.report)(run, stats, tracker->getReplayResults(), result);
+	if(AllocationCounter::isEnabled())
+		result += ofVAArgsToString(", %d frames allocated after warm-up", stats.allocatingFrames);
+	ofLogNotice("PipelineBenchmark") << result;
+	results.push_back(result);
+
+	delete tracker;
+	tracker = NULL;
+	replayed.reset();
+}
+
+void PipelineBenchmark::update() {
+	if(isDone())
+		return;
+
+	if(curRun < 0) {
+		/* Record */
+		uint64_t curDepthTimestamp = depthStream.getFrameTimestamp();
+		if(lastDepthTimestamp == curDepthTimestamp)
+			return;
+		lastDepthTimestamp = curDepthTimestamp;
+
+		const int n = depthStream.getWidth() * depthStream.getHeight();
+		const uint16_t *depthPx = depthStream.getPixelsRef().getPixels();
+		const uint16_t *irPx = irStream.getPixelsRef().getPixels();
+		recording->depth.push_back(vector<uint16_t>(depthPx, depthPx + n));
+		recording->ir.push_back(vector<uint16_t>(irPx, irPx + n));
+		if(recording->depth.size() < RECORD_FRAMES)
+			return;
+
+		model = ofPtr<BackgroundUpdaterThread>(new BackgroundUpdaterThread(depthStream));
+		model->copyModel(background);
+		curRun = 0;
+		startRun();
+		return;
+	}
+
+	if(tracker->isReplaying())
+		return;
+	if(runEnd == 0) {
+		runEnd = ofGetElapsedTimeMillis();
+		return;
+	}
+	if(ofGetElapsedTimeMillis() - runEnd < DRAIN_MILLIS)
+		return;
+	if(++curPass < RUNS[curRun].passes) {
+		tracker->resetStats();
+		tracker->startReplay(replayed, RUNS[curRun].rate);
+		runEnd = 0;
+		return;
+	}
+
+	finishRun();
+	curRun = failed ? NUM_RUNS : curRun + 1;
+	if(!isDone())
+		startRun();
+}
+
+void PipelineBenchmark::draw(float x, float y) {
+	const int lh = 13;
+	setTextAlign(HAlign::left, VAlign::top);
+	if(curRun < 0) {
+		drawText(ofVAArgsToString("Pipeline benchmark: recording frame %d/%d", (int)recording->depth.size(), RECORD_FRAMES), x, y);
+	} else if(!isDone()) {
+		drawText(ofVAArgsToString("Pipeline benchmark: run %d/%d", curRun + 1, NUM_RUNS), x, y);
+	} else if(failed) {
+		drawText("Pipeline benchmark: FAILED, steady-state frames allocated", x, y);
+	} else {
+		drawText("Pipeline benchmark: done", x, y);
+	}
+	for(int i=0; i<results.size(); i++) {
+		drawText(results[i], x, y + lh*(i+1));
+	}
+}
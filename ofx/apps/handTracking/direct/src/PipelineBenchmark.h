@@ -0,0 +1,86 @@
+//
+//  PipelineBenchmark.h
+//  Serial vs. pipelined vs. cascaded vs. fused IRDepth tracker benchmark on replayed sensor frames.
+//
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxKinect2.h"
+
+#include "IRDepthTouchTracker.h"
+
+/* Records a stretch of live sensor frames, then replays it through a fresh IRDepthTouchTracker for each entry of
+   a table of runs, reporting latency and throughput plus whatever that run's report adds (recall, equivalence,
+   background cost, steady-state allocations, ...). The runs replay against a copy of the background model taken
+   when the recording ends, so the live model is left alone. Drive it by calling update() from the app's update(). */
+class PipelineBenchmark {
+private:
+	struct Run;
+	typedef void (PipelineBenchmark::*ReportFn)(const Run &run, const IRDepthPipelineStats &stats,
+		const vector<IRDepthReplayFrame> &results, string &result);
+
+	/* One replay: how the tracker is set up for it, and what it reports beyond latency and throughput */
+	struct Run {
+		bool pipelined;
+		bool cascade;
+		bool fused;
+		float rate; // Hz
+		int arms; // synthetic arms drawn over the background; 0 to replay the recording
+		bool referenceFloods;
+		bool incremental;
+		int passes; // times the recording is replayed; only the last pass is reported
+		ReportFn report; // may be NULL
+	};
+	static const Run RUNS[];
+	static const int NUM_RUNS;
+
+	ofxKinect2::DepthStream &depthStream;
+	ofxKinect2::IrStream &irStream;
+	BackgroundUpdaterThread &background;
+
+	ofPtr<IRDepthRecording> recording;
+	ofPtr<IRDepthRecording> replayed; // frames of the run in progress: the recording, or synthetic arms
+	uint64_t lastDepthTimestamp;
+	ofPtr<BackgroundUpdaterThread> model; // background as of the end of the recording
+	ofPtr<BackgroundUpdaterThread> runBackground; // copy of the model for a run which updates it
+	float backgroundPassTime; // ms per frame for the background thread's pass over the recording
+
+	int curRun; // index of the run in progress; -1 while recording
+	IRDepthTouchTracker *tracker;
+	int curPass; // replays of the recording finished in the run in progress
+	uint64_t runEnd; // ms; when the replay finished, to let the pipeline drain
+	vector<IRDepthReplayFrame> reference; // detections of the reference run, for recall and equivalence
+
+	vector<string> results;
+	bool failed; // a frame of the steady-state run touched the heap
+
+	void startRun();
+	void finishRun();
+	void timeBackgroundPass();
+
+	/* Run reports */
+	void reportReference(const Run &run, const IRDepthPipelineStats &stats, const vector<IRDepthReplayFrame> &results, string &result);
+	void reportCascade(const Run &run, const IRDepthPipelineStats &stats, const vector<IRDepthReplayFrame> &results, string &result);
+	void reportFused(const Run &run, const IRDepthPipelineStats &stats, const vector<IRDepthReplayFrame> &results, string &result);
+	void reportReferenceFloods(const Run &run, const IRDepthPipelineStats &stats, const vector<IRDepthReplayFrame> &results, string &result);
+	void reportIncremental(const Run &run, const IRDepthPipelineStats &stats, const vector<IRDepthReplayFrame> &results, string &result);
+	void reportSteadyState(const Run &run, const IRDepthPipelineStats &stats, const vector<IRDepthReplayFrame> &results, string &result);
+	void reportArms(const Run &run, const IRDepthPipelineStats &stats, const vector<IRDepthReplayFrame> &results, string &result);
+
+	/* Forbid copying */
+	PipelineBenchmark &operator=(const PipelineBenchmark &);
+	PipelineBenchmark(const PipelineBenchmark &);
+
+public:
+	PipelineBenchmark(ofxKinect2::DepthStream &depthStream, ofxKinect2::IrStream &irStream, BackgroundUpdaterThread &background);
+	~PipelineBenchmark();
+
+	void update();
+	bool isDone() const;
+	bool hasFailed() const { return failed; }
+	const vector<string> &getResults() const { return results; }
+
+	void draw(float x, float y);
+};
@@ -0,0 +1,540 @@
+//
+//  PixelKernels.cpp
+//  Per-pixel background-subtraction kernels, dispatched on the CPU's instruction set.
+//
+//
+
+#include "PixelKernels.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define PIXEL_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+/* MSVC emits any intrinsic regardless of /arch; GCC and Clang need each function marked with its target */
+#if defined(__GNUC__)
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE41
+#define TARGET_AVX2
+#endif
+
+#pragma region WorldKit constants
+// InteractorGeometry constants
+static const int DIFF_INVALID = 0 << 8; // either background or depth pixel was 0
+static const int DIFF_SUBNOISE = 128 << 8; // diff value is below noise threshold
+static const int DIFF_THRES_NEAR = 120 << 8; // bg-thres <= depth <= bg-noise
+static const int DIFF_THRES_FAR = 135 << 8; // bg+noise <= depth <= bg+thres
+static const int DIFF_SENSE_NEAR = 100 << 8; // bg-sensemax <= depth <= bg-thres
+static const int DIFF_SENSE_FAR = 150 << 8; // bg+thres <= depth <= bg+sensemax
+static const int DIFF_NEAR = 50 << 8; // depth < bg-sensemax
+static const int DIFF_FAR = 200 << 8; // depth > bg+sensemax
+
+/** Minimum relative distance to consider above noise */
+const static float RELNOISEZ = 6.0f; // z
+/** Minimum relative distance to even consider a difference */
+const static float RELMINZ = 3.0f; // z
+/** Minimum error distance */
+const static float SENSEMINZ = 1.0f; // mm
+/** Maximum distance to consider a touch */
+const static int SENSEMAXZ = 30; // mm
+
+static int constrain(int x, int lo, int hi) {
+	if(x < lo) return lo;
+	if(x > hi) return hi;
+	return x;
+}
+#pragma endregion
+
+#pragma region Scalar
+/* The reference implementations: the loops the trackers used to run */
+static void bandThresholdScalar(const uint16_t *bg, const uint16_t *depth, uint8_t *out, int n, int tlow, int thigh) {
+	for(int i=0; i<n; i++) {
+		int diff = bg[i] - depth[i];
+		out[i] = (diff >= tlow && diff <= thigh) ? 0xff : 0;
+	}
+}
+
+static void zScoreThresholdScalar(const float *bgmean, const float *bgstdev, const uint16_t *depth, uint8_t *out, int n,
+	float znoise, float zlow, float diffhigh) {
+	for(int i=0; i<n; i++) {
+		float diff = bgmean[i] - depth[i];
+		float z = diff / bgstdev[i];
+		if(z < znoise) {
+			out[i] = 0;
+		} else if(z < zlow) {
+			out[i] = 0x80;
+		} else if(diff < diffhigh) {
+			out[i] = 0xff;
+		} else {
+			out[i] = 0;
+		}
+	}
+}
+
+static void zScoreDiffScalar(const float *bgmean, const float *bgstdev, const uint16_t *depth, uint32_t *out, int n,
+	float noiseZ, float maxDiff) {
+	for(int i=0; i<n; i++) {
+		float diff;
+		float z;
+		if(depth[i]) {
+			diff = bgmean[i] - depth[i];
+			z = diff / bgstdev[i];
+		} else {
+			diff = 0;
+			z = 0;
+		}
+		if(bgmean[i] == 0) out[i] = 0;
+		else if(z < noiseZ) out[i] = 0xff000000;
+		else if(diff < maxDiff) out[i] = 0xff7f0000 | (uint16_t)(int)diff; // via int, as the vector kernels truncate
+		else out[i] = 0xffff0000 | (uint16_t)(int)diff;
+	}
+}
+
+static void worldKitClassifyScalar(const float *bgmean, const float *bgstdev, const uint16_t *depth, uint32_t *out, int n) {
+	for(int i=0; i<n; i++) {
+		out[i] = 0xff000000;
+		int diffValue = bgmean[i] - depth[i];
+		if(bgmean[i] == 0 || depth[i] == 0) {
+			out[i] |= DIFF_INVALID;
+			continue;
+		}
+
+		float absDiff = abs(diffValue);
+		// changed: clamp negative values to avoid halo silliness
+		if(diffValue < 0) absDiff = 0;
+
+		float diffRelative = absDiff / (bgstdev[i] + SENSEMINZ);
+		out[i] |= constrain(diffRelative/5, 0, 255);
+		if(diffRelative < RELMINZ) {
+			out[i] += DIFF_SUBNOISE;
+		} else if(absDiff > SENSEMAXZ) {
+			if (diffValue < 0) {
+				out[i] += DIFF_FAR;
+			} else {
+				out[i] += DIFF_NEAR;
+			}
+		} else if (diffRelative < RELNOISEZ) {
+			/*
+			* non-zero, but non-black value: include this in connected
+			* components only if the component would also include
+			* pixels with high diffs
+			*/
+			if (diffValue < 0) {
+				out[i] += DIFF_THRES_FAR;
+			} else {
+				out[i] += DIFF_THRES_NEAR;
+			}
+			out[i] += 2 << 16;
+		} else {
+			if (diffValue < 0) {
+				out[i] += DIFF_SENSE_FAR;
+			} else {
+				out[i] += DIFF_SENSE_NEAR;
+			}
+			out[i] += constrain(diffValue * 4, 0, 255) << 16;
+		}
+	}
+}
+
+static const PixelKernels scalarKernels = {
+	"scalar",
+	bandThresholdScalar,
+	zScoreThresholdScalar,
+	zScoreDiffScalar,
+	worldKitClassifyScalar
+};
+#pragma endregion
+
+#ifdef PIXEL_KERNELS_X86
+#pragma region SSE4.1
+/* 4 pixels per vector; each loop handles 16, and leaves the rest to the scalar loop. Comparisons give all-ones
+   lanes, which select between results with blendv; bytes are packed with unsigned saturation from 0-255 lanes. */
+
+/* Depth pixels 4k..4k+3 of 16, as floats */
+TARGET_SSE41 static inline __m128 loadDepth4(const uint16_t *depth, int k) {
+	return _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)(depth + 4*k))));
+}
+
+TARGET_SSE41 static inline void storeBytes16(uint8_t *out, const __m128i v[4]) {
+	_mm_storeu_si128((__m128i *)out, _mm_packus_epi16(_mm_packus_epi32(v[0], v[1]), _mm_packus_epi32(v[2], v[3])));
+}
+
+TARGET_SSE41 static void bandThresholdSSE41(const uint16_t *bg, const uint16_t *depth, uint8_t *out, int n, int tlow, int thigh) {
+	const __m128i low = _mm_set1_epi32(tlow), high = _mm_set1_epi32(thigh);
+	const __m128i byte = _mm_set1_epi32(0xff);
+	int i = 0;
+	for(; i+16<=n; i+=16) {
+		__m128i v[4];
+		for(int k=0; k<4; k++) {
+			__m128i b = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)(bg + i + 4*k)));
+			__m128i d = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)(depth + i + 4*k)));
+			__m128i diff = _mm_sub_epi32(b, d);
+			__m128i outside = _mm_or_si128(_mm_cmplt_epi32(diff, low), _mm_cmpgt_epi32(diff, high));
+			v[k] = _mm_andnot_si128(outside, byte);
+		}
+		storeBytes16(out + i, v);
+	}
+	bandThresholdScalar(bg + i, depth + i, out + i, n - i, tlow, thigh);
+}
+
+TARGET_SSE41 static void zScoreThresholdSSE41(const float *bgmean, const float *bgstdev, const uint16_t *depth, uint8_t *out, int n,
+	float znoise, float zlow, float diffhigh) {
+	const __m128 noise = _mm_set1_ps(znoise), low = _mm_set1_ps(zlow), high = _mm_set1_ps(diffhigh);
+	const __m128i half = _mm_set1_epi32(0x80), byte = _mm_set1_epi32(0xff);
+	int i = 0;
+	for(; i+16<=n; i+=16) {
+		__m128i v[4];
+		for(int k=0; k<4; k++) {
+			__m128 diff = _mm_sub_ps(_mm_loadu_ps(bgmean + i + 4*k), loadDepth4(depth + i, k));
+			__m128 z = _mm_div_ps(diff, _mm_loadu_ps(bgstdev + i + 4*k));
+			__m128i r = _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(diff, high)), byte);
+			r = _mm_blendv_epi8(r, half, _mm_castps_si128(_mm_cmplt_ps(z, low)));
+			v[k] = _mm_andnot_si128(_mm_castps_si128(_mm_cmplt_ps(z, noise)), r);
+		}
+		storeBytes16(out + i, v);
+	}
+	zScoreThresholdScalar(bgmean + i, bgstdev + i, depth + i, out + i, n - i, znoise, zlow, diffhigh);
+}
+
+TARGET_SSE41 static void zScoreDiffSSE41(const float *bgmean, const float *bgstdev, const uint16_t *depth, uint32_t *out, int n,
+	float noiseZ, float maxDiff) {
+	const __m128 zero = _mm_setzero_ps(), noise = _mm_set1_ps(noiseZ), maxd = _mm_set1_ps(maxDiff);
+	const __m128i low16 = _mm_set1_epi32(0xffff);
+	const __m128i noisy = _mm_set1_epi32(0xff000000), near = _mm_set1_epi32(0xff7f0000), far = _mm_set1_epi32(0xffff0000);
+	int i = 0;
+	for(; i+4<=n; i+=4) {
+		__m128 mean = _mm_loadu_ps(bgmean + i);
+		__m128 d = _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)(depth + i))));
+		__m128 valid = _mm_cmpneq_ps(d, zero);
+		__m128 diff = _mm_and_ps(valid, _mm_sub_ps(mean, d));
+		__m128 z = _mm_and_ps(valid, _mm_div_ps(diff, _mm_loadu_ps(bgstdev + i)));
+		__m128i r = _mm_blendv_epi8(far, near, _mm_castps_si128(_mm_cmplt_ps(diff, maxd)));
+		r = _mm_or_si128(r, _mm_and_si128(_mm_cvttps_epi32(diff), low16));
+		r = _mm_blendv_epi8(r, noisy, _mm_castps_si128(_mm_cmplt_ps(z, noise)));
+		r = _mm_andnot_si128(_mm_castps_si128(_mm_cmpeq_ps(mean, zero)), r);
+		_mm_storeu_si128((__m128i *)(out + i), r);
+	}
+	zScoreDiffScalar(bgmean + i, bgstdev + i, depth + i, out + i, n - i, noiseZ, maxDiff);
+}
+
+TARGET_SSE41 static void worldKitClassifySSE41(const float *bgmean, const float *bgstdev, const uint16_t *depth, uint32_t *out, int n) {
+	const __m128 zero = _mm_setzero_ps(), five = _mm_set1_ps(5);
+	const __m128 senseMin = _mm_set1_ps(SENSEMINZ), relMin = _mm_set1_ps(RELMINZ), relNoise = _mm_set1_ps(RELNOISEZ);
+	const __m128 senseMax = _mm_set1_ps((float)SENSEMAXZ);
+	const __m128i izero = _mm_setzero_si128(), byte = _mm_set1_epi32(0xff), alpha = _mm_set1_epi32(0xff000000);
+	const __m128i subnoise = _mm_set1_epi32(DIFF_SUBNOISE);
+	const __m128i nearType = _mm_set1_epi32(DIFF_NEAR), farType = _mm_set1_epi32(DIFF_FAR);
+	const __m128i thresNear = _mm_set1_epi32(DIFF_THRES_NEAR + (2 << 16)), thresFar = _mm_set1_epi32(DIFF_THRES_FAR + (2 << 16));
+	const __m128i senseNear = _mm_set1_epi32(DIFF_SENSE_NEAR), senseFar = _mm_set1_epi32(DIFF_SENSE_FAR);
+	int i = 0;
+	for(; i+4<=n; i+=4) {
+		__m128 mean = _mm_loadu_ps(bgmean + i);
+		__m128 d = _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)(depth + i))));
+		__m128i invalid = _mm_castps_si128(_mm_or_ps(_mm_cmpeq_ps(mean, zero), _mm_cmpeq_ps(d, zero)));
+
+		__m128i diffValue = _mm_cvttps_epi32(_mm_sub_ps(mean, d));
+		__m128i negative = _mm_cmplt_epi32(diffValue, izero);
+		__m128 absDiff = _mm_cvtepi32_ps(_mm_max_epi32(diffValue, izero));
+		__m128 diffRelative = _mm_div_ps(absDiff, _mm_add_ps(_mm_loadu_ps(bgstdev + i), senseMin));
+		__m128i rel = _mm_min_epi32(_mm_max_epi32(_mm_cvttps_epi32(_mm_div_ps(diffRelative, five)), izero), byte);
+
+		/* The type chain, from its last case back to its first */
+		__m128i sense = _mm_min_epi32(_mm_max_epi32(_mm_slli_epi32(diffValue, 2), izero), byte);
+		__m128i type = _mm_add_epi32(_mm_blendv_epi8(senseNear, senseFar, negative), _mm_slli_epi32(sense, 16));
+		type = _mm_blendv_epi8(type, _mm_blendv_epi8(thresNear, thresFar, negative), _mm_castps_si128(_mm_cmplt_ps(diffRelative, relNoise)));
+		type = _mm_blendv_epi8(type, _mm_blendv_epi8(nearType, farType, negative), _mm_castps_si128(_mm_cmpgt_ps(absDiff, senseMax)));
+		type = _mm_blendv_epi8(type, subnoise, _mm_castps_si128(_mm_cmplt_ps(diffRelative, relMin)));
+
+		__m128i r = _mm_andnot_si128(invalid, _mm_add_epi32(rel, type));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_or_si128(r, alpha));
+	}
+	worldKitClassifyScalar(bgmean + i, bgstdev + i, depth + i, out + i, n - i);
+}
+
+static const PixelKernels sse41Kernels = {
+	"SSE4.1",
+	bandThresholdSSE41,
+	zScoreThresholdSSE41,
+	zScoreDiffSSE41,
+	worldKitClassifySSE41
+};
+#pragma endregion
+
+#pragma region AVX2
+/* The SSE4.1 kernels at 8 pixels per vector. AVX2 packs work within 128-bit halves, so packed bytes are put
+   back in order with a 64-bit permute. Each kernel clears the upper halves of the YMM registers before its scalar
+   tail, which (like its callers) is built for SSE2: legacy SSE code after dirty upper halves stalls, or on
+   Skylake and later runs with a false dependency on them. */
+
+TARGET_AVX2 static inline __m256 loadDepth8(const uint16_t *depth) {
+	return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)depth)));
+}
+
+/* Pack two vectors of 0-255 lanes into 16 bytes, in order */
+TARGET_AVX2 static inline void storeBytes16(uint8_t *out, __m256i a, __m256i b) {
+	__m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+	__m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), _MM_SHUFFLE(3, 1, 2, 0));
+	_mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(bytes));
+}
+
+TARGET_AVX2 static void bandThresholdAVX2(const uint16_t *bg, const uint16_t *depth, uint8_t *out, int n, int tlow, int thigh) {
+	const __m256i low = _mm256_set1_epi32(tlow), high = _mm256_set1_epi32(thigh);
+	const __m256i byte = _mm256_set1_epi32(0xff);
+	int i = 0;
+	for(; i+16<=n; i+=16) {
+		__m256i v[2];
+		for(int k=0; k<2; k++) {
+			__m256i b = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(bg + i + 8*k)));
+			__m256i d = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(depth + i + 8*k)));
+			__m256i diff = _mm256_sub_epi32(b, d);
+			__m256i outside = _mm256_or_si256(_mm256_cmpgt_epi32(low, diff), _mm256_cmpgt_epi32(diff, high));
+			v[k] = _mm256_andnot_si256(outside, byte);
+		}
+		storeBytes16(out + i, v[0], v[1]);
+	}
+	_mm256_zeroupper();
+	bandThresholdScalar(bg + i, depth + i, out + i, n - i, tlow, thigh);
+}
+
+TARGET_AVX2 static void zScoreThresholdAVX2(const float *bgmean, const float *bgstdev, const uint16_t *depth, uint8_t *out, int n,
+	float znoise, float zlow, float diffhigh) {
+	const __m256 noise = _mm256_set1_ps(znoise), low = _mm256_set1_ps(zlow), high = _mm256_set1_ps(diffhigh);
+	const __m256i half = _mm256_set1_epi32(0x80), byte = _mm256_set1_epi32(0xff);
+	int i = 0;
+	for(; i+16<=n; i+=16) {
+		__m256i v[2];
+		for(int k=0; k<2; k++) {
+			__m256 diff = _mm256_sub_ps(_mm256_loadu_ps(bgmean + i + 8*k), loadDepth8(depth + i + 8*k));
+			__m256 z = _mm256_div_ps(diff, _mm256_loadu_ps(bgstdev + i + 8*k));
+			__m256i r = _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(diff, high, _CMP_LT_OQ)), byte);
+			r = _mm256_blendv_epi8(r, half, _mm256_castps_si256(_mm256_cmp_ps(z, low, _CMP_LT_OQ)));
+			v[k] = _mm256_andnot_si256(_mm256_castps_si256(_mm256_cmp_ps(z, noise, _CMP_LT_OQ)), r);
+		}
+		storeBytes16(out + i, v[0], v[1]);
+	}
+	_mm256_zeroupper();
+	zScoreThresholdScalar(bgmean + i, bgstdev + i, depth + i, out + i, n - i, znoise, zlow, diffhigh);
+}
+
+TARGET_AVX2 static void zScoreDiffAVX2(const float *bgmean, const float *bgstdev, const uint16_t *depth, uint32_t *out, int n,
+	float noiseZ, float maxDiff) {
+	const __m256 zero = _mm256_setzero_ps(), noise = _mm256_set1_ps(noiseZ), maxd = _mm256_set1_ps(maxDiff);
+	const __m256i low16 = _mm256_set1_epi32(0xffff);
+	const __m256i noisy = _mm256_set1_epi32(0xff000000), near = _mm256_set1_epi32(0xff7f0000), far = _mm256_set1_epi32(0xffff0000);
+	int i = 0;
+	for(; i+8<=n; i+=8) {
+		__m256 mean = _mm256_loadu_ps(bgmean + i);
+		__m256 d = loadDepth8(depth + i);
+		__m256 valid = _mm256_cmp_ps(d, zero, _CMP_NEQ_UQ);
+		__m256 diff = _mm256_and_ps(valid, _mm256_sub_ps(mean, d));
+		__m256 z = _mm256_and_ps(valid, _mm256_div_ps(diff, _mm256_loadu_ps(bgstdev + i)));
+		__m256i r = _mm256_blendv_epi8(far, near, _mm256_castps_si256(_mm256_cmp_ps(diff, maxd, _CMP_LT_OQ)));
+		r = _mm256_or_si256(r, _mm256_and_si256(_mm256_cvttps_epi32(diff), low16));
+		r = _mm256_blendv_epi8(r, noisy, _mm256_castps_si256(_mm256_cmp_ps(z, noise, _CMP_LT_OQ)));
+		r = _mm256_andnot_si256(_mm256_castps_si256(_mm256_cmp_ps(mean, zero, _CMP_EQ_OQ)), r);
+		_mm256_storeu_si256((__m256i *)(out + i), r);
+	}
+	_mm256_zeroupper();
+	zScoreDiffScalar(bgmean + i, bgstdev + i, depth + i, out + i, n - i, noiseZ, maxDiff);
+}
+
+TARGET_AVX2 static void worldKitClassifyAVX2(const float *bgmean, const float *bgstdev, const uint16_t *depth, uint32_t *out, int n) {
+	const __m256 zero = _mm256_setzero_ps(), five = _mm256_set1_ps(5);
+	const __m256 senseMin = _mm256_set1_ps(SENSEMINZ), relMin = _mm256_set1_ps(RELMINZ), relNoise = _mm256_set1_ps(RELNOISEZ);
+	const __m256 senseMax = _mm256_set1_ps((float)SENSEMAXZ);
+	const __m256i izero = _mm256_setzero_si256(), byte = _mm256_set1_epi32(0xff), alpha = _mm256_set1_epi32(0xff000000);
+	const __m256i subnoise = _mm256_set1_epi32(DIFF_SUBNOISE);
+	const __m256i nearType = _mm256_set1_epi32(DIFF_NEAR), farType = _mm256_set1_epi32(DIFF_FAR);
+	const __m256i thresNear = _mm256_set1_epi32(DIFF_THRES_NEAR + (2 << 16)), thresFar = _mm256_set1_epi32(DIFF_THRES_FAR + (2 << 16));
+	const __m256i senseNear = _mm256_set1_epi32(DIFF_SENSE_NEAR), senseFar = _mm256_set1_epi32(DIFF_SENSE_FAR);
+	int i = 0;
+	for(; i+8<=n; i+=8) {
+		__m256 mean = _mm256_loadu_ps(bgmean + i);
+		__m256 d = loadDepth8(depth + i);
+		__m256i invalid = _mm256_castps_si256(_mm256_or_ps(_mm256_cmp_ps(mean, zero, _CMP_EQ_OQ), _mm256_cmp_ps(d, zero, _CMP_EQ_OQ)));
+
+		__m256i diffValue = _mm256_cvttps_epi32(_mm256_sub_ps(mean, d));
+		__m256i negative = _mm256_cmpgt_epi32(izero, diffValue);
+		__m256 absDiff = _mm256_cvtepi32_ps(_mm256_max_epi32(diffValue, izero));
+		__m256 diffRelative = _mm256_div_ps(absDiff, _mm256_add_ps(_mm256_loadu_ps(bgstdev + i), senseMin));
+		__m256i rel = _mm256_min_epi32(_mm256_max_epi32(_mm256_cvttps_epi32(_mm256_div_ps(diffRelative, five)), izero), byte);
+
+		/* The type chain, from its last case back to its first */
+		__m256i sense = _mm256_min_epi32(_mm256_max_epi32(_mm256_slli_epi32(diffValue, 2), izero), byte);
+		__m256i type = _mm256_add_epi32(_mm256_blendv_epi8(senseNear, senseFar, negative), _mm256_slli_epi32(sense, 16));
+		type = _mm256_blendv_epi8(type, _mm256_blendv_epi8(thresNear, thresFar, negative), _mm256_castps_si256(_mm256_cmp_ps(diffRelative, relNoise, _CMP_LT_OQ)));
+		type = _mm256_blendv_epi8(type, _mm256_blendv_epi8(nearType, farType, negative), _mm256_castps_si256(_mm256_cmp_ps(absDiff, senseMax, _CMP_GT_OQ)));
+		type = _mm256_blendv_epi8(type, subnoise, _mm256_castps_si256(_mm256_cmp_ps(diffRelative, relMin, _CMP_LT_OQ)));
+
+		__m256i r = _mm256_andnot_si256(invalid, _mm256_add_epi32(rel, type));
+		_mm256_storeu_si256((__m256i *)(out + i), _mm256_or_si256(r, alpha));
+	}
+	_mm256_zeroupper();
+	worldKitClassifyScalar(bgmean + i, bgstdev + i, depth + i, out + i, n - i);
+}
+
+static const PixelKernels avx2Kernels = {
+	"AVX2",
+	bandThresholdAVX2,
+	zScoreThresholdAVX2,
+	zScoreDiffAVX2,
+	worldKitClassifyAVX2
+};
+#pragma endregion
+
+#pragma region CPU detection
+static void cpuid(int leaf, int regs[4]) {
+#ifdef _MSC_VER
+	__cpuidex(regs, leaf, 0);
+#else
+	__cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+/* XCR0: which register states the OS saves on context switches */
+static uint64_t xgetbv0() {
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned eax, edx;
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+static bool hasSSE41() {
+	int regs[4];
+	cpuid(1, regs);
+	return (regs[2] & (1 << 19)) != 0;
+}
+
+/* AVX2 needs the CPU to have it and the OS to save the YMM registers */
+static bool hasAVX2() {
+	int regs[4];
+	cpuid(0, regs);
+	if(regs[0] < 7)
+		return false;
+	cpuid(1, regs);
+	const bool osxsave = (regs[2] & (1 << 27)) != 0, avx = (regs[2] & (1 << 28)) != 0;
+	if(!osxsave || !avx || (xgetbv0() & 6) != 6)
+		return false;
+	cpuid(7, regs);
+	return (regs[1] & (1 << 5)) != 0;
+}
+#pragma endregion
+#endif
+
+vector<const PixelKernels *> supportedPixelKernels() {
+	vector<const PixelKernels *> kernels;
+	kernels.push_back(&scalarKernels);
+#ifdef PIXEL_KERNELS_X86
+	if(hasSSE41())
+		kernels.push_back(&sse41Kernels);
+	if(hasAVX2())
+		kernels.push_back(&avx2Kernels);
+#endif
+	return kernels;
+}
+
+/* Chosen during static initialization, before any tracker thread can ask */
+static const PixelKernels *bestKernels = supportedPixelKernels().back();
+
+const PixelKernels &pixelKernels() {
+	return *bestKernels;
+}
+
+#pragma region Test mode
+struct KernelTestInput {
+	vector<uint16_t> bg, depth;
+	vector<float> bgmean, bgstdev;
+
+	/* A mix of ordinary pixels around the thresholds, and the cases the trackers special-case */
+	KernelTestInput(int n) : bg(n), depth(n), bgmean(n), bgstdev(n) {
+		uint32_t seed = 12345;
+		for(int i=0; i<n; i++) {
+			seed = seed * 1664525 + 1013904223;
+			const uint32_t r = seed >> 8;
+			bg[i] = 500 + r % 3000;
+			depth[i] = (r % 7 == 0) ? 0 : bg[i] - 40 + (int)((r >> 4) % 80);
+			bgmean[i] = (r % 11 == 0) ? 0 : bg[i] + ((r >> 6) % 100) / 64.0f;
+			bgstdev[i] = (r % 13 == 0) ? 0 : ((r >> 10) % 400) / 40.0f;
+			if(r % 17 == 0)
+				depth[i] = 65535;
+		}
+	}
+};
+
+template<typename T>
+static int countDifferences(const vector<T> &a, const vector<T> &b) {
+	int count = 0;
+	for(int i=0; i<a.size(); i++) {
+		if(a[i] != b[i])
+			count++;
+	}
+	return count;
+}
+
+int testPixelKernels() {
+	/* Ragged lengths and offsets exercise the scalar tails and unaligned loads */
+	static const int LENGTHS[] = {1, 7, 16, 37, 512, 4099};
+	static const int OFFSETS[] = {0, 1, 3};
+	const int maxN = 4099 + 3;
+	const KernelTestInput in(maxN);
+	const vector<const PixelKernels *> kernels = supportedPixelKernels();
+	const PixelKernels &ref = scalarKernels;
+
+	int failures = 0;
+	for(int k=1; k<kernels.size(); k++) {
+		const PixelKernels &test = *kernels[k];
+		int diffs[4] = {0, 0, 0, 0};
+
+		for(int l=0; l<sizeof(LENGTHS)/sizeof(LENGTHS[0]); l++) {
+			for(int o=0; o<sizeof(OFFSETS)/sizeof(OFFSETS[0]); o++) {
+				const int n = LENGTHS[l], off = OFFSETS[o];
+				const uint16_t *bg = &in.bg[off], *depth = &in.depth[off];
+				const float *mean = &in.bgmean[off], *stdev = &in.bgstdev[off];
+				vector<uint8_t> out8a(n), out8b(n);
+				vector<uint32_t> out32a(n), out32b(n);
+
+				ref.bandThreshold(bg, depth, &out8a[0], n, 6, 12);
+				test.bandThreshold(bg, depth, &out8b[0], n, 6, 12);
+				diffs[0] += countDifferences(out8a, out8b);
+				ref.bandThreshold(bg, depth, &out8a[0], n, -20, 0);
+				test.bandThreshold(bg, depth, &out8b[0], n, -20, 0);
+				diffs[0] += countDifferences(out8a, out8b);
+
+				ref.zScoreThreshold(mean, stdev, depth, &out8a[0], n, 2.0f, 4.0f, 20);
+				test.zScoreThreshold(mean, stdev, depth, &out8b[0], n, 2.0f, 4.0f, 20);
+				diffs[1] += countDifferences(out8a, out8b);
+
+				ref.zScoreDiff(mean, stdev, depth, &out32a[0], n, 1.0f, 100);
+				test.zScoreDiff(mean, stdev, depth, &out32b[0], n, 1.0f, 100);
+				diffs[2] += countDifferences(out32a, out32b);
+
+				ref.worldKitClassify(mean, stdev, depth, &out32a[0], n);
+				test.worldKitClassify(mean, stdev, depth, &out32b[0], n);
+				diffs[3] += countDifferences(out32a, out32b);
+			}
+		}
+
+		static const char *NAMES[] = {"bandThreshold", "zScoreThreshold", "zScoreDiff", "worldKitClassify"};
+		for(int i=0; i<4; i++) {
+			if(diffs[i]) {
+				ofLogError("PixelKernels") << test.name << " " << NAMES[i] << ": " << diffs[i] << " pixels differ from scalar";
+				failures++;
+			} else {
+				ofLogNotice("PixelKernels") << test.name << " " << NAMES[i] << ": ok";
+			}
+		}
+	}
+	ofLogNotice("PixelKernels") << kernels.size() << " variants supported, using " << pixelKernels().name;
+	return failures;
+}
+#pragma endregion
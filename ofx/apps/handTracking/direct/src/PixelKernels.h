@@ -0,0 +1,42 @@
+//
+//  PixelKernels.h
+//  Per-pixel background-subtraction kernels, dispatched on the CPU's instruction set.
+//
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+/* One implementation of each kernel. Every variant produces exactly the scalar variant's output; they only
+   differ in how many pixels they handle per instruction. All buffers hold n pixels and need no alignment. */
+struct PixelKernels {
+	const char *name;
+
+	/* Wilson band threshold: out = 0xff where tlow <= bg - depth <= thigh, 0 elsewhere */
+	void (*bandThreshold)(const uint16_t *bg, const uint16_t *depth, uint8_t *out, int n, int tlow, int thigh);
+
+	/* Wilson statistical threshold, with diff = bgmean - depth and z = diff / bgstdev:
+	   out = 0 if z < znoise, else 0x80 if z < zlow, else 0xff if diff < diffhigh, else 0 */
+	void (*zScoreThreshold)(const float *bgmean, const float *bgstdev, const uint16_t *depth, uint8_t *out, int n,
+		float znoise, float zlow, float diffhigh);
+
+	/* Old IRDepth diff image, A=valid B=zone GR=diff: 0 without background; 0xff000000 if z < noiseZ (or no depth);
+	   else 0xff7f0000 | diff if diff < maxDiff; else 0xffff0000 | diff */
+	void (*zScoreDiff)(const float *bgmean, const float *bgstdev, const uint16_t *depth, uint32_t *out, int n,
+		float noiseZ, float maxDiff);
+
+	/* WorldKit diff image, B=absdiff G=type R=reldiff (see the DIFF_* types in PixelKernels.cpp) */
+	void (*worldKitClassify)(const float *bgmean, const float *bgstdev, const uint16_t *depth, uint32_t *out, int n);
+};
+
+/* The fastest variant this CPU supports; chosen once, at startup */
+const PixelKernels &pixelKernels();
+
+/* Every variant this CPU supports, scalar first */
+vector<const PixelKernels *> supportedPixelKernels();
+
+/* Test mode: run every supported variant against the scalar one on generated inputs, including the edge cases
+   (missing depth or background, zero deviation, ragged lengths), and log the results. Returns the number of
+   kernels whose output differed. */
+int testPixelKernels();
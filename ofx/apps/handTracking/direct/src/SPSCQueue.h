@@ -0,0 +1,56 @@
+//
+//  SPSCQueue.h
+//  Bounded lock-free single-producer single-consumer queue.
+//
+//
+
+#pragma once
+
+#include <atomic>
+
+/* Fixed-capacity ring buffer for passing values from one thread to another without locking.
+   Exactly one thread may push and exactly one thread may pop (they may be the same thread).
+   N must be a power of two; the queue holds at most N values. */
+template <typename T, unsigned N> class SPSCQueue {
+private:
+	T vals[N];
+	std::atomic<unsigned> rpos; // written by the consumer only
+	std::atomic<unsigned> wpos; // written by the producer only
+
+	/* Forbid copying */
+	SPSCQueue &operator=(const SPSCQueue &);
+	SPSCQueue(const SPSCQueue &);
+
+public:
+	SPSCQueue() : rpos(0), wpos(0) {
+	}
+
+	/* Approximate when called from neither end */
+	unsigned size() const {
+		return wpos.load(std::memory_order_acquire) - rpos.load(std::memory_order_acquire);
+	}
+
+	bool empty() const {
+		return size() == 0;
+	}
+
+	/* Producer only. Returns false if the queue is full. */
+	bool push(const T &val) {
+		unsigned w = wpos.load(std::memory_order_relaxed);
+		if(w - rpos.load(std::memory_order_acquire) == N)
+			return false;
+		vals[w % N] = val;
+		wpos.store(w + 1, std::memory_order_release);
+		return true;
+	}
+
+	/* Consumer only. Returns false if the queue is empty. */
+	bool pop(T &val) {
+		unsigned r = rpos.load(std::memory_order_relaxed);
+		if(wpos.load(std::memory_order_acquire) == r)
+			return false;
+		val = vals[r % N];
+		rpos.store(r + 1, std::memory_order_release);
+		return true;
+	}
+};
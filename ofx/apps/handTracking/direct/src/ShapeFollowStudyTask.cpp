@@ -101,7 +101,11 @@ void ShapeFollowStudyTask::drawDebug() {
 }
 
 void ShapeFollowStudyTask::update() {
-	if(getCurrentTrial() >= getNumTrials())
+}
+
+/* Follow the touch on every tracker frame, so that no point of the path is lost between app frames */
+void ShapeFollowStudyTask::onTouchFrame(int tracker) {
+	if(tracker != 0 || getCurrentTrial() >= getNumTrials())
 		return;
 
 	auto &trial = trials[getCurrentTrial()];
@@ -123,7 +127,7 @@ void ShapeFollowStudyTask::update() {
 			if(!i->second.missing) {
 				Point pt;
 				pt.pt = i->second.tip;
-				pt.timestamp = GetTimestamp();
+				pt.timestamp = trackers[0].touchTime;
 				points.push_back(pt);
 			}
 		} else {
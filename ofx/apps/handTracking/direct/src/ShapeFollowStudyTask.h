@@ -47,5 +47,6 @@ public:
 	virtual void drawDebug();
 	virtual void update();
 	virtual int getNumTrials();
+	virtual void onTouchFrame(int tracker);
 	virtual bool undoTrial();
 };
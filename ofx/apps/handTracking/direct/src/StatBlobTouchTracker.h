@@ -0,0 +1,14 @@
+//
+//  StatBlobTouchTracker.h
+//  Hybrid touch tracker: Wilson's statistical threshold, segmented into WorldKit's peak-checked blobs.
+//
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "TouchStages.h"
+
+/* Wilson's z-score mask, without the low-pass filter: its confident (0xff) pixels count as peaks, so a blob
+   needs a core of confident pixels rather than a dense neighbourhood */
+typedef TouchPipeline<ZScoreThreshold<20, 40, 20>, PeakBlobSegmenter, CentroidTips, AlwaysTouched> StatBlobTouchTracker;
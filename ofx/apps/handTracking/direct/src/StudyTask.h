@@ -17,7 +17,9 @@
 struct StudyTouchTracker {
 	string name;
 	map<int, FingerTouch> touches;
+	double touchTime; // GetTimestamp() time of the sensor frame the touches came from
 	class TouchTracker *tracker;
+	class TouchChannel *channel;
 };
 
 class StudyTask {
@@ -51,6 +53,9 @@ public:
 	virtual void update() = 0;
 	virtual int getNumTrials() = 0;
 
+	/* Called for every touch frame from trackers[tracker], after its touches have been updated */
+	virtual void onTouchFrame(int tracker) {}
+
 	virtual void onKeyPressed(int key) {}
 	virtual bool undoTrial() { return unrecordTrial(); }
 };
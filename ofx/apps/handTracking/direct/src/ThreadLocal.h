@@ -0,0 +1,14 @@
+//
+//  ThreadLocal.h
+//  Portable thread-local storage qualifier.
+//
+//
+
+#pragma once
+
+/* Storage qualifier for plain-old-data thread-locals. VS2012 has no C++11 thread_local. */
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
@@ -23,8 +23,15 @@ struct FingerTouch {
     /// Number of frames since the touch first appeared
     int touchAge;
 
+    /// Is this touch about to contact the surface? Provisional: confirmed when the touch becomes touched,
+    /// cancelled when this clears without it. Only set by trackers which anticipate touch-down.
+    bool imminent;
+
+    /// Estimated seconds from this frame's capture until contact, while imminent
+    float contactTime;
+
     FingerTouch() : id(-1), tip(), touched(false),
-    statusAge(0), touchAge(0), touchZ(0), missing(false), missingAge(0) {
+    statusAge(0), touchAge(0), imminent(false), contactTime(0), touchZ(0), touchZVelocity(0), missing(false), missingAge(0) {
 
     }
 public:
@@ -32,6 +39,9 @@ public:
 	/// Touch Z height
 	float touchZ;
 
+	/// Smoothed rate of change of touchZ, per second
+	float touchZVelocity;
+
     /// Did this touch recently go missing?
     bool missing;
 
@@ -0,0 +1,388 @@
+//
+//  TouchAssociator.cpp
+//  Frame-to-frame touch association: gated grid lookup, greedy or optimal matching.
+//
+//
+
+#include "TouchAssociator.h"
+
+#include <cfloat>
+#include <random>
+
+/* Most detections per cluster side solved optimally; the solver's work grows as 2^n */
+static const int MAX_OPTIMAL_CLUSTER = 8;
+/* Below this many previous x new pairs, trying them all is cheaper than building the grid */
+static const int MAX_ALL_PAIRS = 128;
+
+/* A candidate pair packed as distance:32 cur:16 det:16. Non-negative floats order as their bit patterns, so
+   sorting the packed pairs sorts them by distance, then by index. */
+static inline uint64_t packCandidate(float dist, int cur, int det) {
+	uint32_t bits;
+	memcpy(&bits, &dist, sizeof(bits));
+	return ((uint64_t)bits << 32) | ((uint64_t)cur << 16) | (uint64_t)det;
+}
+static inline int candidateCur(uint64_t c) { return (int)((c >> 16) & 0xffff); }
+static inline int candidateDet(uint64_t c) { return (int)(c & 0xffff); }
+
+TouchAssociator::TouchAssociator(float gate, int maxMissingAge)
+: gate(max(gate, 1.0f)), maxMissingAge(maxMissingAge), optimalClusterSize(0) {
+}
+
+void TouchAssociator::setOptimalClusterSize(int n) {
+	optimalClusterSize = max(0, min(n, MAX_OPTIMAL_CLUSTER));
+}
+
+int TouchAssociator::findCluster(int i) {
+	while(parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+void TouchAssociator::match(const FingerTouch *cur, int nCur, const FingerTouch *det, int nDet) {
+	curMatch.assign(nCur, -1);
+	detMatch.assign(nDet, -1);
+	candidates.clear();
+	if(nCur == 0 || nDet == 0)
+		return;
+
+	if(nCur * nDet <= MAX_ALL_PAIRS) {
+		for(int i=0; i<nCur; i++) {
+			for(int j=0; j<nDet; j++) {
+				const float d = cur[i].tip.distance(det[j].tip);
+				if(d <= gate)
+					candidates.push_back(packCandidate(d, i, j));
+			}
+		}
+	} else {
+		/* Bucket the detections into a grid over their bounding box. Cells are at least as wide as the gate, so the
+		   detections within the gate of a point are all in the 3x3 cells around it. Cells are widened if need be to
+		   keep their number in proportion to the detections. */
+		float minX = det[0].tip.x, maxX = minX, minY = det[0].tip.y, maxY = minY;
+		for(int j=1; j<nDet; j++) {
+			minX = min(minX, det[j].tip.x);
+			maxX = max(maxX, det[j].tip.x);
+			minY = min(minY, det[j].tip.y);
+			maxY = max(maxY, det[j].tip.y);
+		}
+		float cell = gate;
+		int cols, rows;
+		while(1) {
+			cols = (int)((maxX - minX) / cell) + 1;
+			rows = (int)((maxY - minY) / cell) + 1;
+			if(cols * rows <= 4 * nDet + 16)
+				break;
+			cell *= 2;
+		}
+
+		cellStart.assign(cols * rows + 1, 0);
+		cellDets.resize(nDet);
+		for(int j=0; j<nDet; j++) {
+			const int c = (int)((det[j].tip.y - minY) / cell) * cols + (int)((det[j].tip.x - minX) / cell);
+			cellStart[c + 1]++;
+		}
+		for(int c=0; c<cols*rows; c++)
+			cellStart[c + 1] += cellStart[c];
+		for(int j=0; j<nDet; j++) {
+			const int c = (int)((det[j].tip.y - minY) / cell) * cols + (int)((det[j].tip.x - minX) / cell);
+			cellDets[cellStart[c]++] = j;
+		}
+		/* cellStart[c] now holds the end of cell c, i.e. the start of cell c+1 */
+		for(int c=cols*rows; c>0; c--)
+			cellStart[c] = cellStart[c - 1];
+		cellStart[0] = 0;
+
+		/* Gated candidate pairs */
+		for(int i=0; i<nCur; i++) {
+			const float fx = (cur[i].tip.x - minX) / cell, fy = (cur[i].tip.y - minY) / cell;
+			if(!(fx >= -1 && fx < cols + 1 && fy >= -1 && fy < rows + 1))
+				continue;
+			const int cx = (int)floor(fx), cy = (int)floor(fy);
+			for(int y=max(cy-1, 0); y<=min(cy+1, rows-1); y++) {
+				for(int x=max(cx-1, 0); x<=min(cx+1, cols-1); x++) {
+					for(int k=cellStart[y*cols + x]; k<cellStart[y*cols + x + 1]; k++) {
+						const int j = cellDets[k];
+						const float d = cur[i].tip.distance(det[j].tip);
+						if(d <= gate)
+							candidates.push_back(packCandidate(d, i, j));
+					}
+				}
+			}
+		}
+	}
+	std::sort(candidates.begin(), candidates.end());
+
+	/* Clusters of touches and detections linked by candidate pairs; nodes are previous touches, then detections */
+	bool anyOptimal = false;
+	if(optimalClusterSize > 0) {
+		const int nodes = nCur + nDet;
+		parent.resize(nodes);
+		for(int k=0; k<nodes; k++)
+			parent[k] = k;
+		for(uint64_t c : candidates) {
+			const int a = findCluster(candidateCur(c)), b = findCluster(nCur + candidateDet(c));
+			if(a != b)
+				parent[max(a, b)] = min(a, b);
+		}
+		for(int k=0; k<nodes; k++)
+			parent[k] = findCluster(k);
+		/* Previous touches in each cluster, plus its detections << 16 */
+		clusterSize.assign(nodes, 0);
+		for(int k=0; k<nodes; k++)
+			clusterSize[parent[k]] += (k < nCur) ? 1 : 1 << 16;
+		/* A lone pair has nothing to decide */
+		clusterOptimal.assign(nodes, 0);
+		for(int k=0; k<nodes; k++) {
+			const int curs = clusterSize[k] & 0xffff, dets = clusterSize[k] >> 16;
+			if(curs + dets > 2 && min(curs, dets) <= optimalClusterSize) {
+				clusterOptimal[k] = 1;
+				anyOptimal = true;
+			}
+		}
+	}
+
+	/* Greedy: nearest pairs first */
+	for(uint64_t c : candidates) {
+		const int i = candidateCur(c), j = candidateDet(c);
+		if(anyOptimal && clusterOptimal[parent[i]])
+			continue;
+		if(curMatch[i] >= 0 || detMatch[j] >= 0)
+			continue;
+		curMatch[i] = j;
+		detMatch[j] = i;
+	}
+
+	if(!anyOptimal)
+		return;
+
+	/* Collect each optimal cluster's members, grouped by cluster */
+	clusterCurs.clear();
+	clusterDets.clear();
+	for(int i=0; i<nCur; i++) {
+		if(clusterOptimal[parent[i]])
+			clusterCurs.push_back(i);
+	}
+	for(int j=0; j<nDet; j++) {
+		if(clusterOptimal[parent[nCur + j]])
+			clusterDets.push_back(j);
+	}
+	const vector<int> &parentRef = parent;
+	std::sort(clusterCurs.begin(), clusterCurs.end(), [&](int a, int b) {
+		return parentRef[a] != parentRef[b] ? parentRef[a] < parentRef[b] : a < b;
+	});
+	std::sort(clusterDets.begin(), clusterDets.end(), [&](int a, int b) {
+		return parentRef[nCur + a] != parentRef[nCur + b] ? parentRef[nCur + a] < parentRef[nCur + b] : a < b;
+	});
+
+	int ci = 0, di = 0;
+	while(ci < clusterCurs.size()) {
+		const int root = parent[clusterCurs[ci]];
+		int ce = ci, de = di;
+		while(ce < clusterCurs.size() && parent[clusterCurs[ce]] == root)
+			ce++;
+		while(de < clusterDets.size() && parent[nCur + clusterDets[de]] == root)
+			de++;
+		matchOptimally(&clusterCurs[ci], ce - ci, &clusterDets[di], de - di, cur, det);
+		ci = ce;
+		di = de;
+	}
+}
+
+/* Exact matching of one cluster, by dynamic programming over the subsets of its smaller side: the large side's
+   members are taken in turn, each either matched to an unused member of the small side within the gate, or left
+   out. Leaving a member out costs the gate, so a match (which costs its distance, at most the gate) always beats
+   leaving both of its members out: the result has the most matches possible, and then the least distance. */
+void TouchAssociator::matchOptimally(const int *curs, int nCurs, const int *dets, int nDets, const FingerTouch *cur, const FingerTouch *det) {
+	const bool curSmall = nCurs <= nDets;
+	const int *small = curSmall ? curs : dets, *large = curSmall ? dets : curs;
+	const int s = curSmall ? nCurs : nDets, l = curSmall ? nDets : nCurs;
+	const int masks = 1 << s;
+
+	cost.assign((l + 1) * masks, FLT_MAX);
+	choice.resize(l * masks);
+	cost[0] = 0;
+	for(int k=0; k<l; k++) {
+		const float *prev = &cost[k * masks];
+		float *next = &cost[(k + 1) * masks];
+		signed char *pick = &choice[k * masks];
+		const ofPoint &largeTip = curSmall ? det[large[k]].tip : cur[large[k]].tip;
+		float dist[MAX_OPTIMAL_CLUSTER];
+		for(int a=0; a<s; a++) {
+			const ofPoint &smallTip = curSmall ? cur[small[a]].tip : det[small[a]].tip;
+			dist[a] = smallTip.distance(largeTip);
+		}
+
+		for(int mask=0; mask<masks; mask++) {
+			float best = (prev[mask] == FLT_MAX) ? FLT_MAX : prev[mask] + gate;
+			int bestPick = -1;
+			for(int a=0; a<s; a++) {
+				if(!(mask & (1 << a)) || dist[a] > gate || prev[mask ^ (1 << a)] == FLT_MAX)
+					continue;
+				const float c = prev[mask ^ (1 << a)] + dist[a];
+				if(c < best) {
+					best = c;
+					bestPick = a;
+				}
+			}
+			next[mask] = best;
+			pick[mask] = bestPick;
+		}
+	}
+
+	int bestMask = 0;
+	float best = FLT_MAX;
+	for(int mask=0; mask<masks; mask++) {
+		const float *last = &cost[l * masks];
+		if(last[mask] == FLT_MAX)
+			continue;
+		int unused = s;
+		for(int a=0; a<s; a++) {
+			if(mask & (1 << a))
+				unused--;
+		}
+		const float c = last[mask] + gate * unused;
+		if(c < best) {
+			best = c;
+			bestMask = mask;
+		}
+	}
+
+	for(int k=l-1, mask=bestMask; k>=0; k--) {
+		const int a = choice[k * masks + mask];
+		if(a < 0)
+			continue;
+		const int i = curSmall ? small[a] : large[k], j = curSmall ? large[k] : small[a];
+		curMatch[i] = j;
+		detMatch[j] = i;
+		mask ^= 1 << a;
+	}
+}
+
+#pragma region Benchmark
+/* The association every tracker used to run: all cur x new distances, sorted, matched greedily */
+static void matchAllPairs(const vector<FingerTouch> &cur, const vector<FingerTouch> &det, float gate, vector<int> &detMatch) {
+	struct touch_dist {
+		int cur_index, new_index;
+		float dist;
+		bool operator<(const struct touch_dist &other) const {
+			return dist < other.dist;
+		}
+	};
+
+	vector<touch_dist> distances;
+	for(int i=0; i<cur.size(); i++) {
+		for(int j=0; j<det.size(); j++) {
+			float d = cur[i].tip.distance(det[j].tip);
+			if(d > gate)
+				continue;
+			touch_dist dist = {i,j,d};
+			distances.push_back(dist);
+		}
+	}
+	std::sort(distances.begin(), distances.end());
+
+	vector<bool> curUsed(cur.size(), false);
+	detMatch.assign(det.size(), -1);
+	for(const auto &i : distances) {
+		if(curUsed[i.cur_index] || detMatch[i.new_index] >= 0)
+			continue;
+		curUsed[i.cur_index] = true;
+		detMatch[i.new_index] = i.cur_index;
+	}
+}
+
+/* Uniform in [lo, hi) from the benchmark's own generator, so that it neither reseeds nor draws from ofRandom's */
+static float uniform(std::mt19937 &rng, float lo, float hi) {
+	return std::uniform_real_distribution<float>(lo, hi)(rng);
+}
+
+/* Synthetic crowded frames: hands of five fingers 15-25 px apart, moving up to 12 px per frame with a few px of
+   jitter each; a few fingers drop out and a few spurious detections appear. truth holds the finger behind each
+   detection, or -1. */
+struct AssociationScene {
+	vector<FingerTouch> cur, det;
+	vector<int> truth;
+
+	AssociationScene(int touches, unsigned seed) {
+		std::mt19937 rng(seed);
+		ofVec2f hand, velocity;
+		for(int i=0; i<touches; i++) {
+			if(i % 5 == 0) {
+				hand.set(uniform(rng, 40, 472), uniform(rng, 40, 384));
+				velocity.set(uniform(rng, -10, 10), uniform(rng, -10, 10));
+			}
+			FingerTouch touch;
+			touch.id = i;
+			touch.tip.set(hand.x + (i % 5 - 2) * uniform(rng, 15, 25), hand.y + uniform(rng, -10, 10));
+			cur.push_back(touch);
+
+			if(uniform(rng, 0, 1) < 0.05f)
+				continue;
+			touch.id = -1;
+			touch.tip += ofPoint(velocity.x + uniform(rng, -3, 3), velocity.y + uniform(rng, -3, 3));
+			det.push_back(touch);
+			truth.push_back(i);
+		}
+		for(int i=0; i<touches / 20; i++) {
+			FingerTouch touch;
+			touch.tip.set(uniform(rng, 0, 512), uniform(rng, 0, 424));
+			det.push_back(touch);
+			truth.push_back(-1);
+		}
+	}
+};
+
+int benchmarkTouchAssociation() {
+	static const int SIZES[] = {10, 50, 200};
+	const int SCENES = 50, REPEATS = 20;
+	const float GATE = 50;
+
+	int disagreements = 0;
+	for(int n=0; n<sizeof(SIZES)/sizeof(SIZES[0]); n++) {
+		vector<AssociationScene> scenes;
+		for(int s=0; s<SCENES; s++)
+			scenes.push_back(AssociationScene(SIZES[n], 1000 * n + s));
+
+		TouchAssociator greedy(GATE), optimal(GATE);
+		optimal.setOptimalClusterSize(MAX_OPTIMAL_CLUSTER);
+		vector<int> reference;
+		uint64_t allPairsTime = 0, greedyTime = 0, optimalTime = 0;
+		int pairs = 0, greedyErrors = 0, optimalErrors = 0;
+		bool agree = true;
+
+		for(const AssociationScene &scene : scenes) {
+			uint64_t start = ofGetElapsedTimeMicros();
+			for(int r=0; r<REPEATS; r++)
+				matchAllPairs(scene.cur, scene.det, GATE, reference);
+			allPairsTime += ofGetElapsedTimeMicros() - start;
+
+			start = ofGetElapsedTimeMicros();
+			for(int r=0; r<REPEATS; r++)
+				greedy.match(&scene.cur[0], scene.cur.size(), &scene.det[0], scene.det.size());
+			greedyTime += ofGetElapsedTimeMicros() - start;
+
+			start = ofGetElapsedTimeMicros();
+			for(int r=0; r<REPEATS; r++)
+				optimal.match(&scene.cur[0], scene.cur.size(), &scene.det[0], scene.det.size());
+			optimalTime += ofGetElapsedTimeMicros() - start;
+
+			agree &= (greedy.detMatch == reference);
+			for(int j=0; j<scene.det.size(); j++) {
+				pairs++;
+				greedyErrors += (greedy.detMatch[j] != scene.truth[j]);
+				optimalErrors += (optimal.detMatch[j] != scene.truth[j]);
+			}
+		}
+
+		const float runs = SCENES * REPEATS;
+		ofLogNotice("TouchAssociator") << ofVAArgsToString("%3d touches: all pairs %7.1f us, grid %6.1f us, grid+optimal %6.1f us; "
+			"wrong matches %.2f%% greedy, %.2f%% optimal%s",
+			SIZES[n], allPairsTime / runs, greedyTime / runs, optimalTime / runs,
+			greedyErrors * 100.0f / pairs, optimalErrors * 100.0f / pairs, agree ? "" : "; GREEDY DIFFERS FROM ALL PAIRS");
+		if(!agree)
+			disagreements++;
+	}
+	return disagreements;
+}
+#pragma endregion
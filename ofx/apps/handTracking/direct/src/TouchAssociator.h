@@ -0,0 +1,96 @@
+//
+//  TouchAssociator.h
+//  Frame-to-frame touch association: gated grid lookup, greedy or optimal matching.
+//
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "Touch.h"
+
+/* Carries touch IDs from one frame's touches to the next frame's detections. Candidate pairs are the detections
+   within the gate of each previous touch, found through a uniform grid of gate-sized cells, so the work grows with
+   the number of nearby pairs rather than with previous x new. Pairs are then matched greedily, nearest first.
+   Up to 65536 touches and detections.
+
+   Optionally, small ambiguous clusters (connected groups of candidate pairs with several touches competing for
+   several detections) are matched optimally instead: as many pairs as possible, with the least total distance.
+   Greedy matching can hand a touch's detection to a neighbour and leave the touch to take a worse one, or none;
+   this mostly happens where fingers are close together.
+
+   Scratch space is kept between frames, so associating allocates nothing once the buffers have grown. */
+class TouchAssociator {
+private:
+	float gate;
+	int maxMissingAge;
+	int optimalClusterSize;
+
+	/* Scratch */
+	vector<int> cellStart, cellDets;
+	vector<uint64_t> candidates; // packed; see TouchAssociator.cpp
+	vector<int> curMatch, detMatch; // index matched on the other side, or -1
+	vector<int> parent, clusterSize, clusterCurs, clusterDets; // clusters are keyed by their root node
+	vector<char> clusterOptimal;
+	vector<float> cost;
+	vector<signed char> choice;
+
+	int findCluster(int i);
+	void matchOptimally(const int *curs, int nCurs, const int *dets, int nDets, const FingerTouch *cur, const FingerTouch *det);
+
+	/* Fill detMatch with the previous touch matched to each detection, and curMatch the other way round */
+	void match(const FingerTouch *cur, int nCur, const FingerTouch *det, int nDet);
+
+	friend int benchmarkTouchAssociation();
+
+public:
+	/* gate: px; the furthest a touch may move between frames. A touch without a detection is carried for up to
+	   maxMissingAge frames before it is dropped. */
+	TouchAssociator(float gate, int maxMissingAge=3);
+
+	/* Solve clusters with up to this many touches or detections (on the smaller side; at most 8) optimally;
+	   0 (the default) matches everything greedily */
+	void setOptimalClusterSize(int n);
+	int getOptimalClusterSize() const { return optimalClusterSize; }
+
+	/* Turn this frame's detections into this frame's touches, in place. Each detection matched to one of the
+	   previous frame's touches takes its ID and age, then update(const FingerTouch &cur, FingerTouch &det) applies
+	   the tracker's own state (smoothing, touch state). The unmatched previous touches still within maxMissingAge
+	   are appended as missing, and unmatched detections get new IDs from nextTouchId. */
+	template<typename CurVector, typename DetVector, typename Update>
+	void associate(const CurVector &cur, DetVector &det, int &nextTouchId, Update update) {
+		const int nCur = cur.size(), nDet = det.size();
+		match(nCur ? &cur[0] : NULL, nCur, nDet ? &det[0] : NULL, nDet);
+
+		for(int j=0; j<nDet; j++) {
+			FingerTouch &newTouch = det[j];
+			newTouch.missing = false;
+			newTouch.missingAge = 0;
+			if(detMatch[j] < 0) {
+				newTouch.id = nextTouchId++;
+				newTouch.statusAge = newTouch.touchAge = 0;
+				continue;
+			}
+			const FingerTouch &curTouch = cur[detMatch[j]];
+			newTouch.id = curTouch.id;
+			newTouch.touchAge = curTouch.touchAge + 1;
+			update(curTouch, newTouch);
+		}
+
+		/* Add 'missing' touches back */
+		for(int i=0; i<nCur; i++) {
+			if(curMatch[i] >= 0 || (cur[i].missing && cur[i].missingAge >= maxMissingAge))
+				continue;
+			det.push_back(cur[i]);
+			FingerTouch &missingTouch = det.back();
+			missingTouch.missingAge = missingTouch.missing ? missingTouch.missingAge + 1 : 0;
+			missingTouch.missing = true;
+			missingTouch.statusAge++;
+			missingTouch.touchAge++;
+		}
+	}
+};
+
+/* Time association at 10, 50 and 200 touches against the all-pairs reference, greedy and optimal, and log
+   the results. Returns the number of sizes at which greedy matching disagreed with the reference. */
+int benchmarkTouchAssociation();
@@ -0,0 +1,56 @@
+//
+//  TouchChannel.cpp
+//  Lock-free channel carrying every touch frame from a tracker to one consumer.
+//
+//
+
+#include "TouchChannel.h"
+
+#include <chrono>
+
+static unsigned roundUpPow2(int n) {
+	unsigned p = 1;
+	while(p < (unsigned)n)
+		p <<= 1;
+	return p;
+}
+
+TouchChannel::TouchChannel(int capacity, int maxTouches)
+: slots(roundUpPow2(max(capacity, 1))), mask(roundUpPow2(max(capacity, 1)) - 1), rpos(0), wpos(0), dropped(0), waiting(false) {
+	for(auto &slot : slots) {
+		slot.touches.reserve(maxTouches);
+	}
+}
+
+void TouchChannel::wakeConsumer() {
+	std::lock_guard<std::mutex> lock(waitMutex);
+	waitCond.notify_one();
+}
+
+bool TouchChannel::pop(TouchFrame &frame) {
+	unsigned r = rpos.load(std::memory_order_relaxed);
+	if(wpos.load(std::memory_order_acquire) == r)
+		return false;
+	const TouchFrame &slot = slots[r & mask];
+	frame.sequence = slot.sequence;
+	frame.sensorTimestamp = slot.sensorTimestamp;
+	frame.captureTime = slot.captureTime;
+	frame.touches.assign(slot.touches.begin(), slot.touches.end());
+	rpos.store(r + 1, std::memory_order_release);
+	return true;
+}
+
+bool TouchChannel::wait(TouchFrame &frame, int timeoutMillis) {
+	if(pop(frame))
+		return true;
+
+	/* The producer stores wpos and then checks waiting; we set waiting and then check wpos. Both sequentially
+	   consistent, so at least one of us sees the other: either we find the frame, or the producer wakes us. */
+	{
+		std::unique_lock<std::mutex> lock(waitMutex);
+		waiting = true;
+		waitCond.wait_for(lock, std::chrono::milliseconds(timeoutMillis), [this] { return wpos.load() != rpos.load(std::memory_order_relaxed); });
+		waiting = false;
+	}
+	return pop(frame);
+}
@@ -0,0 +1,97 @@
+//
+//  TouchChannel.h
+//  Lock-free channel carrying every touch frame from a tracker to one consumer.
+//
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "Touch.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+/* One tracker frame's worth of touches */
+struct TouchFrame {
+	uint64_t sequence; // tracker frame number, from 1; a gap means the channel was full
+	uint64_t sensorTimestamp; // depth frame timestamp as reported by the depth stream; 0 for replayed frames
+	uint64_t captureTime; // ofGetElapsedTimeMicros() when the tracker picked up the sensor frame
+	vector<FingerTouch> touches;
+
+	TouchFrame() : sequence(0), sensorTimestamp(0), captureTime(0) {}
+};
+
+/* Bounded single-producer single-consumer ring of touch frames. The slots are allocated up front and reused,
+   so that delivering a frame of up to maxTouches touches takes neither a lock nor an allocation; consumers
+   that pop into their own TouchFrame reuse its buffer the same way. When the ring is full, new frames are
+   dropped (and counted) rather than overwriting frames the consumer may be reading.
+
+   The producer is the tracker thread. The consumer either drains the ring without blocking (e.g. once per
+   app frame) or waits for frames; only a waiting consumer makes the producer take a lock, to wake it up. */
+class TouchChannel {
+private:
+	vector<TouchFrame> slots;
+	const unsigned mask;
+	std::atomic<unsigned> rpos; // written by the consumer only
+	std::atomic<unsigned> wpos; // written by the producer only
+	std::atomic<int> dropped;
+
+	/* Blocking consumers */
+	std::atomic<bool> waiting;
+	std::mutex waitMutex;
+	std::condition_variable waitCond;
+
+	void wakeConsumer();
+
+	/* Forbid copying */
+	TouchChannel &operator=(const TouchChannel &);
+	TouchChannel(const TouchChannel &);
+
+public:
+	/* capacity is rounded up to a power of two */
+	TouchChannel(int capacity, int maxTouches);
+
+	/* Producer only. Returns false, dropping the frame, if the channel is full. */
+	template <typename It> bool publish(uint64_t sequence, uint64_t sensorTimestamp, uint64_t captureTime, It begin, It end) {
+		unsigned w = wpos.load(std::memory_order_relaxed);
+		if(w - rpos.load(std::memory_order_acquire) == slots.size()) {
+			dropped++;
+			return false;
+		}
+		TouchFrame &slot = slots[w & mask];
+		slot.sequence = sequence;
+		slot.sensorTimestamp = sensorTimestamp;
+		slot.captureTime = captureTime;
+		slot.touches.assign(begin, end);
+		wpos.store(w + 1); // sequentially consistent, to pair with waiting (see wait())
+		if(waiting)
+			wakeConsumer();
+		return true;
+	}
+
+	/* Consumer only. Call fn(const TouchFrame &) on each frame available, oldest first, without blocking;
+	   the frame is only valid during the call. Returns the number of frames drained. */
+	template <typename F> int drain(F fn) {
+		unsigned r = rpos.load(std::memory_order_relaxed);
+		unsigned w = wpos.load(std::memory_order_acquire);
+		for(unsigned i=r; i!=w; i++) {
+			fn(const_cast<const TouchFrame &>(slots[i & mask]));
+			rpos.store(i + 1, std::memory_order_release);
+		}
+		return (int)(w - r);
+	}
+
+	/* Consumer only. Copy the oldest frame out; returns false if there is none. */
+	bool pop(TouchFrame &frame);
+
+	/* Consumer only. Like pop(), but waits up to timeoutMillis for a frame to arrive. */
+	bool wait(TouchFrame &frame, int timeoutMillis);
+
+	/* Approximate when called from neither end */
+	int size() const { return (int)(wpos.load(std::memory_order_acquire) - rpos.load(std::memory_order_acquire)); }
+	int capacity() const { return (int)slots.size(); }
+	/* Frames dropped because the consumer fell behind */
+	int getDropped() const { return dropped; }
+};
@@ -0,0 +1,146 @@
+//
+//  TouchPipeline.h
+//  Touch tracker assembled at compile time from stage policies.
+//
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxKinect2.h"
+#include "ofxOpenCv.h"
+
+#include "TouchTracker.h"
+#include "TouchAssociator.h"
+
+/* What the stages of a TouchPipeline see of their tracker */
+struct TouchStageContext {
+	const int w, h;
+	ofxKinect2::DepthStream &depthStream;
+	ofxKinect2::IrStream &irStream;
+	BackgroundUpdaterThread &background;
+	const TouchTracker &tracker; // for zones
+
+	TouchStageContext(int w, int h, ofxKinect2::DepthStream &depthStream, ofxKinect2::IrStream &irStream,
+		BackgroundUpdaterThread &background, const TouchTracker &tracker)
+		: w(w), h(h), depthStream(depthStream), irStream(irStream), background(background), tracker(tracker) {}
+
+private:
+	TouchStageContext &operator=(const TouchStageContext &);
+};
+
+/* A touch tracker built from one policy class per stage. The pipeline owns one object of each and calls them
+   directly, so a stage is compiled against the next one's concrete type: the segmenter reads the diff's
+   per-pixel results through inline calls rather than through an interface. Stages are duck-typed:
+
+   Diff: classifies the depth frame against the background.
+     Diff(const TouchStageContext &ctx);
+     void run(const TouchStageContext &ctx, int front);
+     bool foreground(int i) const; bool peak(int i) const; // for segmenters which label pixels
+     float drawDebug(int back, float x, float y); // draws the last frame's images; returns the y below them
+   Segmenter: groups the classified pixels into finger blobs.
+     Segmenter(const TouchStageContext &ctx);
+     template<typename Diff> void run(const TouchStageContext &ctx, const Diff &diff, int front);
+     const vector<ComponentStats> &getBlobs() const; // accepted blobs, in blob order
+     float drawDebug(int back, float x, float y);
+   Extractor: turns the blobs into touches.
+     template<typename Segmenter> void run(const TouchStageContext &ctx, const Segmenter &segmenter, vector<FingerTouch> &touches);
+   Merge: carries touches over from one frame to the next (see TouchAssociator).
+     float gate() const;
+     void operator()(const FingerTouch &curTouch, FingerTouch &newTouch) const;
+
+   Stages may need more of each other than this, or other things instead (e.g. a low-pass segmenter wants the
+   diff's mask plane, and OmniTouch's stages pass gradient planes and fingers rather than classes and blobs); a
+   mismatch fails to compile. The stages live in TouchStages.h. The IRDepth trackers don't decompose into
+   these stages (their segmentation works on their own tiled planes), so they stay classes of their own. */
+template<typename Diff, typename Segmenter, typename Extractor, typename Merge>
+class TouchPipeline : public TouchTracker {
+protected:
+	const TouchStageContext ctx;
+	Diff diff;
+	Segmenter segmenter;
+	Extractor extractor;
+	Merge merge;
+	TouchAssociator associator;
+
+	/* Double-buffered stage images for display's sake */
+	int front;
+
+	template<typename Pipeline> friend struct TouchPipelineBenchmark;
+
+	vector<FingerTouch> findTouches() {
+		vector<FingerTouch> touches;
+		diff.run(ctx, front);
+		segmenter.run(ctx, diff, front);
+		extractor.run(ctx, segmenter, touches);
+		return touches;
+	}
+
+	/* Associate this frame's detections with the current touches, in place */
+	void mergeTouches(vector<FingerTouch> &newTouches) {
+		associator.associate(touches, newTouches, nextTouchId, merge);
+	}
+
+	void threadedFunction() {
+		uint64_t lastDepthTimestamp = 0;
+		int curDepthFrame = 0;
+		fps.fps = 30; // estimated fps
+
+		while(isThreadRunning()) {
+			// Check if the depth frame is new
+			uint64_t curDepthTimestamp = depthStream.getFrameTimestamp();
+			if(lastDepthTimestamp == curDepthTimestamp) {
+				ofSleepMillis(5);
+				continue;
+			}
+			lastDepthTimestamp = curDepthTimestamp;
+			uint64_t captureTime = ofGetElapsedTimeMicros();
+			curDepthFrame++;
+			fps.update();
+
+			updateZoneTiles();
+			vector<FingerTouch> newTouches = findTouches();
+			mergeTouches(newTouches);
+			{
+				ofScopedLock lock(touchLock);
+				touches.swap(newTouches);
+				touchesUpdated = true;
+			}
+			deliverTouches(curDepthTimestamp, captureTime);
+
+			front = !front;
+		}
+	}
+
+public:
+	TouchPipeline(ofxKinect2::DepthStream &depthStream, ofxKinect2::IrStream &irStream, BackgroundUpdaterThread &background)
+	: TouchTracker(depthStream, irStream, background), ctx(w, h, depthStream, irStream, background, *this),
+	  diff(ctx), segmenter(ctx), associator(merge.gate()) {
+		front = 0;
+	}
+
+	virtual ~TouchPipeline() {
+		stopThread();
+		waitForThread();
+	}
+
+	virtual void drawDebug(float x, float y) {
+		int back = !front;
+		y = diff.drawDebug(back, x, y);
+		segmenter.drawDebug(back, x, y);
+	}
+
+	/* update() function called from the main thread */
+	virtual bool update(vector<FingerTouch> &retTouches) {
+		fps.tick();
+
+		ofScopedLock lock(touchLock);
+		if(touchesUpdated) {
+			retTouches = touches;
+			touchesUpdated = false;
+			return true;
+		} else {
+			return false;
+		}
+	}
+};
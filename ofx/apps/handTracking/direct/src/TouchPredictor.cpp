@@ -0,0 +1,233 @@
+//
+//  TouchPredictor.cpp
+//  Latency-compensating touch position prediction.
+//
+//
+
+#include "TouchPredictor.h"
+
+#include <cfloat>
+#include <random>
+
+static const float INITIAL_VELOCITY_NOISE = 1000; // px/s: standard deviation of a new touch's velocity
+static const float RESTART_GAP = 0.2f; // s: a touch unseen for this long starts afresh
+
+TouchPredictor::TouchPredictor(const Params &params)
+: params(params), frames(0) {
+}
+
+void TouchPredictor::startAxis(Axis &axis, float pos) {
+	axis.pos = pos;
+	axis.vel = 0;
+	axis.p00 = params.measurementNoise * params.measurementNoise;
+	axis.p01 = 0;
+	axis.p11 = INITIAL_VELOCITY_NOISE * INITIAL_VELOCITY_NOISE;
+}
+
+/* One Kalman step: move the state dt seconds ahead under random acceleration, then correct it by the measured
+   position */
+void TouchPredictor::updateAxis(Axis &axis, float pos, float dt) {
+	const float a2 = params.accelerationNoise * params.accelerationNoise;
+	const float dt2 = dt * dt;
+	axis.pos += axis.vel * dt;
+	axis.p00 += dt * (2 * axis.p01 + dt * axis.p11) + a2 * dt2 * dt2 / 4;
+	axis.p01 += dt * axis.p11 + a2 * dt2 * dt / 2;
+	axis.p11 += a2 * dt2;
+
+	const float s = axis.p00 + params.measurementNoise * params.measurementNoise;
+	const float k0 = axis.p00 / s, k1 = axis.p01 / s;
+	const float innovation = pos - axis.pos;
+	axis.pos += k0 * innovation;
+	axis.vel += k1 * innovation;
+	axis.p11 -= k1 * axis.p01;
+	axis.p00 -= k0 * axis.p00;
+	axis.p01 -= k0 * axis.p01;
+}
+
+void TouchPredictor::update(const vector<FingerTouch> &touches, uint64_t captureTime) {
+	frames++;
+	for(const FingerTouch &touch : touches) {
+		auto it = states.find(touch.id);
+		if(it == states.end()) {
+			TouchState state;
+			startAxis(state.x, touch.tip.x);
+			startAxis(state.y, touch.tip.y);
+			state.time = captureTime;
+			it = states.insert(make_pair(touch.id, state)).first;
+		} else if(!touch.missing) {
+			TouchState &state = it->second;
+			const float dt = (captureTime > state.time) ? (captureTime - state.time) / 1e6f : 0;
+			if(dt > RESTART_GAP) {
+				startAxis(state.x, touch.tip.x);
+				startAxis(state.y, touch.tip.y);
+			} else {
+				updateAxis(state.x, touch.tip.x, dt);
+				updateAxis(state.y, touch.tip.y, dt);
+			}
+			state.time = captureTime;
+		}
+		it->second.seen = frames;
+	}
+
+	for(auto it = states.begin(); it != states.end(); ) {
+		if(it->second.seen != frames)
+			states.erase(it++);
+		else
+			++it;
+	}
+}
+
+ofPoint TouchPredictor::predict(const FingerTouch &touch, uint64_t displayTime) const {
+	auto it = states.find(touch.id);
+	if(it == states.end())
+		return touch.tip;
+	const TouchState &state = it->second;
+	const float horizon = (displayTime > state.time) ? min((displayTime - state.time) / 1e6f, params.maxHorizon) : 0;
+	return ofPoint(state.x.pos + state.x.vel * horizon, state.y.pos + state.y.vel * horizon, touch.tip.z);
+}
+
+ofVec2f TouchPredictor::getVelocity(int id) const {
+	auto it = states.find(id);
+	if(it == states.end())
+		return ofVec2f(0, 0);
+	return ofVec2f(it->second.x.vel, it->second.y.vel);
+}
+
+void TouchPredictor::clear() {
+	states.clear();
+}
+
+#pragma region Evaluation
+/* Uniform in [lo, hi) from the evaluation's own generator, so that it neither reseeds nor draws from ofRandom's */
+static float uniform(std::mt19937 &rng, float lo, float hi) {
+	return std::uniform_real_distribution<float>(lo, hi)(rng);
+}
+
+/* Synthetic finger motion: a stroke of the given kind, as position at time t (s) */
+struct SyntheticStroke {
+	enum Kind { LINE, ARC, FLICK, HOLD, NUM_KINDS };
+	Kind kind;
+	ofVec2f start, dir;
+	float length, duration; // px, s: of the moving part
+	float radius, phase;
+
+	SyntheticStroke(Kind kind, std::mt19937 &rng) : kind(kind) {
+		start.set(uniform(rng, 100, 412), uniform(rng, 100, 324));
+		const float angle = uniform(rng, 0, TWO_PI);
+		dir.set(cos(angle), sin(angle));
+		const float speed = uniform(rng, 100, 1500); // px/s, average
+		duration = (kind == FLICK) ? uniform(rng, 0.15f, 0.3f) : uniform(rng, 0.5f, 1.0f);
+		length = speed * duration;
+		radius = uniform(rng, 40, 150);
+		phase = angle;
+	}
+
+	/* Minimum-jerk progress from 0 to 1, as a finger starts and stops */
+	static float ease(float u) {
+		u = ofClamp(u, 0, 1);
+		return u * u * u * (10 + u * (-15 + u * 6));
+	}
+
+	ofVec2f at(float t) const {
+		const float s = length * ease(t / duration);
+		switch(kind) {
+		case LINE:
+		case FLICK:
+			return start + dir * s;
+		case ARC:
+			return start + ofVec2f(cos(phase + s / radius) - cos(phase), sin(phase + s / radius) - sin(phase)) * radius;
+		default:
+			return start;
+		}
+	}
+};
+
+static float gaussian(std::mt19937 &rng, float sigma) {
+	float u = max(uniform(rng, 0, 1), 1e-6f), v = uniform(rng, 0, 1);
+	return sigma * sqrt(-2 * log(u)) * cos(TWO_PI * v);
+}
+
+/* Mean distance between the displayed positions and the true path tau seconds before they were displayed */
+static float meanLagError(const vector<ofVec2f> &shown, const vector<const SyntheticStroke *> &strokes, const vector<float> &times, float tau) {
+	double sum = 0;
+	for(int i=0; i<shown.size(); i++)
+		sum += shown[i].distance(strokes[i]->at(times[i] - tau));
+	return sum / shown.size();
+}
+
+static float perceivedLatency(const vector<ofVec2f> &shown, const vector<const SyntheticStroke *> &strokes, const vector<float> &times) {
+	float best = 0, bestError = FLT_MAX;
+	for(int ms=-50; ms<=200; ms++) {
+		const float error = meanLagError(shown, strokes, times, ms / 1000.0f);
+		if(error < bestError) {
+			bestError = error;
+			best = ms;
+		}
+	}
+	return best;
+}
+
+static void errorStats(const vector<ofVec2f> &shown, const vector<ofVec2f> &truth, float &mean, float &p95) {
+	vector<float> errors(shown.size());
+	double sum = 0;
+	for(int i=0; i<shown.size(); i++) {
+		errors[i] = shown[i].distance(truth[i]);
+		sum += errors[i];
+	}
+	sort(errors.begin(), errors.end());
+	mean = sum / errors.size();
+	p95 = errors[errors.size() * 95 / 100];
+}
+
+float evaluateTouchPrediction(float latencyMillis, const TouchPredictor::Params &params) {
+	const int STROKES = 400;
+	const float SAMPLE_HZ = 30, TIP_NOISE = 1.0f, TAIL = 0.3f; // TAIL: s of rest after each stroke
+	const uint64_t latency = (uint64_t)(latencyMillis * 1000);
+
+	std::mt19937 rng(1);
+	vector<SyntheticStroke> strokes;
+	for(int i=0; i<STROKES; i++)
+		strokes.push_back(SyntheticStroke((SyntheticStroke::Kind)(i % SyntheticStroke::NUM_KINDS), rng));
+
+	/* Every sample's response, as displayed: the last tip, and the prediction */
+	vector<ofVec2f> lastTips, predicted, truth;
+	vector<const SyntheticStroke *> sources;
+	vector<float> displayTimes;
+	for(int i=0; i<STROKES; i++) {
+		const SyntheticStroke &stroke = strokes[i];
+		TouchPredictor predictor(params);
+		FingerTouch touch;
+		touch.id = 1;
+		vector<FingerTouch> frame(1);
+		const int samples = (int)((stroke.duration + TAIL) * SAMPLE_HZ);
+		for(int k=0; k<samples; k++) {
+			const float t = k / SAMPLE_HZ;
+			const uint64_t captureTime = (uint64_t)(t * 1e6);
+			const ofVec2f pos = stroke.at(t);
+			touch.tip.set(pos.x + gaussian(rng, TIP_NOISE), pos.y + gaussian(rng, TIP_NOISE));
+			frame[0] = touch;
+			predictor.update(frame, captureTime);
+
+			const ofPoint p = predictor.predict(touch, captureTime + latency);
+			lastTips.push_back(ofVec2f(touch.tip.x, touch.tip.y));
+			predicted.push_back(ofVec2f(p.x, p.y));
+			const float displayTime = t + latencyMillis / 1000;
+			truth.push_back(stroke.at(displayTime));
+			sources.push_back(&stroke);
+			displayTimes.push_back(displayTime);
+		}
+	}
+
+	float lastMean, lastP95, predMean, predP95;
+	errorStats(lastTips, truth, lastMean, lastP95);
+	errorStats(predicted, truth, predMean, predP95);
+	const float lastLatency = perceivedLatency(lastTips, sources, displayTimes);
+	const float predLatency = perceivedLatency(predicted, sources, displayTimes);
+
+	ofLogNotice("TouchPredictor") << ofVAArgsToString("%.0f ms capture-to-display, %d strokes: last tip error mean %.1f p95 %.1f px, perceived latency %.0f ms",
+		latencyMillis, STROKES, lastMean, lastP95, lastLatency);
+	ofLogNotice("TouchPredictor") << ofVAArgsToString("%.0f ms capture-to-display, %d strokes: predicted error mean %.1f p95 %.1f px, perceived latency %.0f ms",
+		latencyMillis, STROKES, predMean, predP95, predLatency);
+	return predLatency;
+}
+#pragma endregion
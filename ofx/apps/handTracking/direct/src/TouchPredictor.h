@@ -0,0 +1,69 @@
+//
+//  TouchPredictor.h
+//  Latency-compensating touch position prediction.
+//
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "Touch.h"
+
+/* Predicts where touches will be when the response to them is drawn. Between the sensor capturing a finger and
+   the projector showing the result lie at least a sensor frame and a render frame, so a moving finger is always
+   drawn behind where it is. Each touch gets a constant-velocity Kalman filter per axis, fed with the tracker's
+   tips and capture times; the prediction extrapolates the filtered position and velocity to the display time.
+
+   The state lives here, keyed by touch ID, next to the consumer's own touches. Feed every tracker frame (e.g.
+   from a TouchChannel) to update(); touches which leave the frame are forgotten. Consumer-side only: not
+   thread-safe. */
+class TouchPredictor {
+public:
+	struct Params {
+		float measurementNoise; // px: standard deviation of the tracker's tips
+		float accelerationNoise; // px/s^2: how hard fingers change velocity
+		float maxHorizon; // s: furthest ahead to extrapolate; beyond this a prediction overshoots more than it helps
+		Params() : measurementNoise(1.5f), accelerationNoise(8000.0f), maxHorizon(0.08f) {}
+	};
+
+private:
+	struct Axis {
+		float pos, vel; // px, px/s
+		float p00, p01, p11; // covariance
+	};
+	struct TouchState {
+		Axis x, y;
+		uint64_t time; // us: capture time of the last update
+		uint64_t seen; // frame number of the last update, to find touches which left
+	};
+
+	Params params;
+	map<int, TouchState> states;
+	uint64_t frames;
+
+	void startAxis(Axis &axis, float pos);
+	void updateAxis(Axis &axis, float pos, float dt);
+
+public:
+	TouchPredictor(const Params &params=Params());
+
+	const Params &getParams() const { return params; }
+
+	/* Feed one tracker frame, captured at captureTime (us, ofGetElapsedTimeMicros() time). Missing touches (which
+	   the tracker carries on without a new detection) keep their state without updating it. */
+	void update(const vector<FingerTouch> &touches, uint64_t captureTime);
+
+	/* Predicted tip of touch at displayTime (us); its own tip if the touch is unknown */
+	ofPoint predict(const FingerTouch &touch, uint64_t displayTime) const;
+
+	/* Filtered velocity of touch, px/s; 0 if unknown */
+	ofVec2f getVelocity(int id) const;
+
+	void clear();
+};
+
+/* Offline evaluation on synthetic strokes (lines, arcs, flicks and holds at 100-1500 px/s) with tracker noise,
+   sampled at 30 Hz and displayed latencyMillis after capture. Logs the mean and 95th percentile error of the
+   last tip and of the prediction against the true position at display time, and the perceived latency of each:
+   the lag at which the displayed path best matches the true one. Returns the perceived latency with prediction, ms. */
+float evaluateTouchPrediction(float latencyMillis=50, const TouchPredictor::Params &params=TouchPredictor::Params());
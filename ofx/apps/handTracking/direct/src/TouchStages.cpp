@@ -0,0 +1,1116 @@
+//
+//  TouchStages.cpp
+//  Stage policies for TouchPipeline: background diffs, blob segmenters, tip extractors and merge rules.
+//
+//
+
+#include "TouchStages.h"
+#include "PixelKernels.h"
+#include "GuardBand.h"
+#include "TextUtils.h"
+
+#include "WilsonSingleTouchTracker.h"
+#include "WilsonMaxTouchTracker.h"
+#include "WilsonStatTouchTracker.h"
+#include "WorldKitTouchTracker.h"
+#include "StatBlobTouchTracker.h"
+
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define STAGES_SSE2
+#include <emmintrin.h>
+#endif
+
+#pragma region Diff stages
+BandThresholdDiff::BandThresholdDiff(const TouchStageContext &ctx, Capture capture, int tlow, int thigh)
+: capture(capture), tlow(tlow), thigh(thigh), frameNumber(0) {
+	bg.allocate(ctx.w, ctx.h, OF_IMAGE_COLOR_ALPHA);
+	maskPlane.resize(ctx.w * ctx.h);
+}
+
+void BandThresholdDiff::run(const TouchStageContext &ctx, int front) {
+	const int n = ctx.w * ctx.h;
+	uint16_t *depthPx = ctx.depthStream.getPixelsRef().getPixels();
+	uint16_t *bgPx = bg.getPixels();
+
+	/* Magic numbers for capturing the frame */
+	if(capture == CAPTURE_SINGLE) {
+		if(frameNumber++ == 30)
+			memcpy(bgPx, depthPx, n*sizeof(uint16_t));
+	} else {
+		if(frameNumber++ <= 15) {
+			for(int i=0; i<n; i++) {
+				if(bgPx[i] < depthPx[i])
+					bgPx[i] = depthPx[i];
+			}
+		}
+	}
+
+	pixelKernels().bandThreshold(bgPx, depthPx, &maskPlane[0], n, tlow, thigh);
+}
+
+ZScoreThresholdDiff::ZScoreThresholdDiff(const TouchStageContext &ctx, float znoise, float zlow, float diffhigh)
+: znoise(znoise), zlow(zlow), diffhigh(diffhigh) {
+	maskPlane.resize(ctx.w * ctx.h);
+}
+
+void ZScoreThresholdDiff::run(const TouchStageContext &ctx, int front) {
+	const float *bgmean = ctx.background.getBackgroundMean().getPixels();
+	const float *bgstdev = ctx.background.getBackgroundStdev().getPixels();
+	const uint16_t *depthPx = ctx.depthStream.getPixelsRef().getPixels();
+
+	pixelKernels().zScoreThreshold(bgmean, bgstdev, depthPx, &maskPlane[0], ctx.w * ctx.h, znoise, zlow, diffhigh);
+}
+
+WorldKitDiff::WorldKitDiff(const TouchStageContext &ctx) {
+	for(int i=0; i<2; i++) {
+		diffIm[i].allocate(ctx.w, ctx.h, OF_IMAGE_COLOR_ALPHA);
+	}
+	diffPx = (const uint32_t *)diffIm[0].getPixels();
+}
+
+void WorldKitDiff::run(const TouchStageContext &ctx, int front) {
+	const int w = ctx.w, h = ctx.h;
+	const uint16_t *depthPx = ctx.depthStream.getPixelsRef().getPixels();
+	uint32_t *outPx = (uint32_t *)diffIm[front].getPixels();
+	diffPx = outPx;
+
+	const float *bgmean = ctx.background.getBackgroundMean().getPixels();
+	const float *bgstdev = ctx.background.getBackgroundStdev().getPixels();
+
+	/* Tiles outside the tracker's zone are left invalid, so no blob starts or grows there. Runs of tiles inside
+	   it are classified in one call. */
+	const int tileSize = BackgroundUpdaterThread::tileSize;
+	const PixelKernels &kernels = pixelKernels();
+
+	for(int y=0; y<h; y++) {
+		int x0 = 0;
+		while(x0 < w) {
+			const bool inZone = ctx.tracker.isInZone(x0, y);
+			int x1 = x0;
+			while(x1 < w && ctx.tracker.isInZone(x1, y) == inZone)
+				x1 = min(x1 + tileSize, w);
+
+			const int i = y*w + x0;
+			if(inZone)
+				kernels.worldKitClassify(bgmean + i, bgstdev + i, depthPx + i, outPx + i, x1 - x0);
+			else
+				fill_n(outPx + i, x1 - x0, 0xff000000);
+			x0 = x1;
+		}
+	}
+}
+
+float WorldKitDiff::drawDebug(int back, float x, float y) {
+	diffIm[back].reloadTexture();
+	diffIm[back].draw(x, y);
+	drawText("Diff", x, y, HAlign::left, VAlign::top);
+	return y + diffIm[back].getHeight();
+}
+#pragma endregion
+
+#pragma region Low-pass segmentation
+/* Horizontal box filter of each row: the mean of the 2*filtersz+1 pixels around each pixel, rounded down.
+   Pixels within filtersz+1 of either end are 0. */
+static void boxcarFilterH(const uint8_t *src, uint8_t *dst, int w, int h, int filtersz) {
+	const int div = filtersz * 2 + 1;
+	const int x0 = filtersz + 1, x1 = max(w - filtersz, x0);
+
+	for(int y=0; y<h; y++) {
+		const uint8_t *in = src + y*w;
+		uint8_t *out = dst + y*w;
+
+		fill(out, out + min(x0, w), 0);
+		if(x0 < x1) {
+			int sum = 0;
+			for(int x=x0-filtersz; x<=x0+filtersz; x++)
+				sum += in[x];
+			for(int x=x0; x<x1; x++) {
+				out[x] = sum / div;
+				if(x+filtersz+1 < w)
+					sum += in[x+filtersz+1] - in[x-filtersz];
+			}
+		}
+		fill(out + x1, out + w, 0);
+	}
+}
+
+/* Exact division of the vertical box sums (at most 255*div) by div, as a 16-bit multiply-high and a shift:
+   q = (x*mul >> 16) >> shift, where mul = ceil(2^(16+shift) / div) and 2^shift < div < 2^(shift+1). The
+   rounding error stays below one part in div as long as 255*div*div < 2^(16+shift), i.e. for odd divisors
+   from 3 to 127 (box sizes up to 63). */
+struct BoxDivisor {
+	int div, mul, shift;
+	bool exact;
+
+	BoxDivisor(int div) : div(div), mul(0), shift(0) {
+		while((2 << shift) <= div)
+			shift++;
+		exact = (div % 2 == 1) && div >= 3 && div < 128;
+		if(exact)
+			mul = ((1 << (16 + shift)) + div - 1) / div;
+	}
+};
+
+/* sums += enter - leave, for one row of column sums */
+static void updateColSums(uint16_t *sums, const uint8_t *enter, const uint8_t *leave, int w) {
+	int x = 0;
+#ifdef STAGES_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for(; x+16<=w; x+=16) {
+		__m128i in = _mm_loadu_si128((const __m128i *)(enter + x));
+		__m128i out = _mm_loadu_si128((const __m128i *)(leave + x));
+		__m128i lo = _mm_loadu_si128((const __m128i *)(sums + x));
+		__m128i hi = _mm_loadu_si128((const __m128i *)(sums + x + 8));
+		lo = _mm_sub_epi16(_mm_add_epi16(lo, _mm_unpacklo_epi8(in, zero)), _mm_unpacklo_epi8(out, zero));
+		hi = _mm_sub_epi16(_mm_add_epi16(hi, _mm_unpackhi_epi8(in, zero)), _mm_unpackhi_epi8(out, zero));
+		_mm_storeu_si128((__m128i *)(sums + x), lo);
+		_mm_storeu_si128((__m128i *)(sums + x + 8), hi);
+	}
+#endif
+	for(; x<w; x++) {
+		sums[x] += enter[x] - leave[x];
+	}
+}
+
+/* Assemble one row of the blob image: B=thresholded G=smoothed (sums / div, or 0 if sums is NULL)
+   R=0xff where smoothed > thresh (0-255) */
+static void writeBlobRow(uint32_t *out, const uint8_t *threshRow, const uint16_t *sums, int w, const BoxDivisor &divisor, int thresh) {
+	int x = 0;
+#ifdef STAGES_SSE2
+	if(divisor.exact || !sums) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i alpha = _mm_cmpeq_epi8(zero, zero);
+		const __m128i mul = _mm_set1_epi16((short)divisor.mul);
+		const __m128i shift = _mm_cvtsi32_si128(divisor.shift);
+		const __m128i limit = _mm_set1_epi8((char)thresh);
+		for(; x+16<=w; x+=16) {
+			__m128i smooth = zero;
+			if(sums) {
+				__m128i lo = _mm_srl_epi16(_mm_mulhi_epu16(_mm_loadu_si128((const __m128i *)(sums + x)), mul), shift);
+				__m128i hi = _mm_srl_epi16(_mm_mulhi_epu16(_mm_loadu_si128((const __m128i *)(sums + x + 8)), mul), shift);
+				smooth = _mm_packus_epi16(lo, hi);
+			}
+			/* smooth > limit, unsigned */
+			__m128i sel = _mm_xor_si128(_mm_cmpeq_epi8(_mm_subs_epu8(smooth, limit), zero), alpha);
+			__m128i th = _mm_loadu_si128((const __m128i *)(threshRow + x));
+			__m128i rg_lo = _mm_unpacklo_epi8(sel, smooth), rg_hi = _mm_unpackhi_epi8(sel, smooth);
+			__m128i ba_lo = _mm_unpacklo_epi8(th, alpha), ba_hi = _mm_unpackhi_epi8(th, alpha);
+			_mm_storeu_si128((__m128i *)(out + x), _mm_unpacklo_epi16(rg_lo, ba_lo));
+			_mm_storeu_si128((__m128i *)(out + x + 4), _mm_unpackhi_epi16(rg_lo, ba_lo));
+			_mm_storeu_si128((__m128i *)(out + x + 8), _mm_unpacklo_epi16(rg_hi, ba_hi));
+			_mm_storeu_si128((__m128i *)(out + x + 12), _mm_unpackhi_epi16(rg_hi, ba_hi));
+		}
+	}
+#endif
+	for(; x<w; x++) {
+		int smooth = sums ? sums[x] / divisor.div : 0;
+		out[x] = 0xff000000 | (threshRow[x] << 16) | (smooth << 8) | ((smooth > thresh) ? 0xff : 0);
+	}
+}
+
+LowpassBlobSegmenter::LowpassBlobSegmenter(const TouchStageContext &ctx, int filtersz, int thresh, int minsize)
+: filtersz(ofClamp(filtersz, 0, 128)), thresh(ofClamp(thresh, 0, 255)), minsize(minsize), labeler(ctx.w, ctx.h) {
+	for(int i=0; i<2; i++) {
+		blobIm[i].allocate(ctx.w, ctx.h, OF_IMAGE_COLOR_ALPHA);
+	}
+	boxPlane.resize(ctx.w * ctx.h);
+	colSums.resize(ctx.w);
+}
+
+/* Box filter the mask, separably, and select the pixels whose mean exceeds thresh. The vertical pass keeps a
+   running sum per column, so each row costs one add and one subtract per pixel whatever the filter size.
+   Pixels within filtersz+1 of the border are never selected. The column sums are 16-bit, which holds filtersz
+   up to 128. */
+void LowpassBlobSegmenter::filter(const uint8_t *threshPx, int front) {
+	const int w = blobIm[front].getWidth(), h = blobIm[front].getHeight();
+	uint32_t *blobPx = (uint32_t *)blobIm[front].getPixels();
+	const uint8_t *boxPx = &boxPlane[0];
+	uint16_t *sums = &colSums[0];
+
+	boxcarFilterH(threshPx, &boxPlane[0], w, h, filtersz);
+
+	const BoxDivisor divisor(filtersz * 2 + 1);
+	const int y0 = filtersz + 1, y1 = max(h - filtersz, y0);
+
+	if(y0 < y1) {
+		fill(colSums.begin(), colSums.end(), 0);
+		for(int y=y0-filtersz; y<=y0+filtersz; y++) {
+			for(int x=0; x<w; x++)
+				sums[x] += boxPx[y*w + x];
+		}
+	}
+	int y = 0;
+	for(; y<min(y0, h); y++) {
+		writeBlobRow(blobPx + y*w, threshPx + y*w, NULL, w, divisor, thresh);
+	}
+	for(; y<y1; y++) {
+		writeBlobRow(blobPx + y*w, threshPx + y*w, sums, w, divisor, thresh);
+		if(y+filtersz+1 < h)
+			updateColSums(sums, boxPx + (y+filtersz+1)*w, boxPx + (y-filtersz)*w, w);
+	}
+	for(; y<h; y++) {
+		writeBlobRow(blobPx + y*w, threshPx + y*w, NULL, w, divisor, thresh);
+	}
+}
+
+/* Pixels selected by the low-pass filter */
+struct SelectedPixels : ComponentPixels {
+	const uint32_t *blobPx;
+	SelectedPixels(const uint32_t *blobPx) : blobPx(blobPx) {}
+	bool foreground(int i) const { return (blobPx[i] & 0xff) == 0xff; }
+};
+
+void LowpassBlobSegmenter::findBlobs(int front) {
+	const int w = blobIm[front].getWidth(), h = blobIm[front].getHeight();
+	uint32_t *blobPx = (uint32_t *)blobIm[front].getPixels();
+	blobs.clear();
+
+	/* The lowpass filter already clears the border; make sure nothing there is selected */
+	fillGuardBand<uint32_t>(blobPx, w, h, 0xff000000);
+
+	/* four-way connectivity */
+	const vector<ComponentStats> &components = labeler.label(ComponentLabeler::CONNECT_4, SelectedPixels(blobPx));
+	vector<bool> accepted(components.size() + 1, false);
+	for(int c=0; c<components.size(); c++) {
+		if(components[c].count < minsize) {
+			/* Not enough pixels */
+			continue;
+		}
+		/* Enough pixels for the finger */
+		accepted[c+1] = true;
+		blobs.push_back(components[c]);
+	}
+
+	/* R: 0x01 for selected pixels, 0x81 in accepted blobs */
+	labeler.forEachRun([&](const ComponentRun &run) {
+		const uint32_t flags = accepted[run.label] ? 0x80 : 0;
+		for(int i=run.y*w+run.x0; i<run.y*w+run.x1; i++)
+			blobPx[i] = (blobPx[i] & ~0xfe) | flags;
+	});
+}
+
+float LowpassBlobSegmenter::drawDebug(int back, float x, float y) {
+	blobIm[back].reloadTexture();
+	blobIm[back].draw(x, y);
+	drawText("Blob", x, y, HAlign::left, VAlign::top);
+	return y + blobIm[back].getHeight();
+}
+#pragma endregion
+
+#pragma region Peak blob segmentation
+static const int MINBLOBSIZE = 10;
+static const int MINPEAKSIZE = 5;
+
+static int colorForBlobIndex(int blobId) {
+	/* Reverse the bits of the blob ID to make adjacent blob IDs more obvious */
+
+	// https://graphics.stanford.edu/~seander/bithacks.html#ReverseByteWith64Bits
+	unsigned char b = (unsigned char)blobId;
+	b = ((b * 0x80200802ULL) & 0x0884422110ULL) * 0x0101010101ULL >> 32;
+	return b;
+}
+
+PeakBlobSegmenter::PeakBlobSegmenter(const TouchStageContext &ctx) : labeler(ctx.w, ctx.h) {
+	for(int i=0; i<2; i++) {
+		blobIm[i].allocate(ctx.w, ctx.h, OF_IMAGE_COLOR_ALPHA);
+	}
+}
+
+uint32_t *PeakBlobSegmenter::startBlobImage(int front) {
+	const int w = blobIm[front].getWidth(), h = blobIm[front].getHeight();
+	uint32_t *blobPx = (uint32_t *)blobIm[front].getPixels();
+
+	fill_n(blobPx, w*h, 0x00000000);
+	/* Nothing is tracked on the image border */
+	fillGuardBand<uint32_t>(blobPx, w, h, 0x00000002);
+	return blobPx;
+}
+
+void PeakBlobSegmenter::acceptBlobs(const vector<ComponentStats> &components, uint32_t *blobPx) {
+	const int w = blobIm[0].getWidth();
+	blobs.clear();
+
+	/* Blob pixel of each component: rejected, or accepted with its blob index */
+	vector<uint32_t> marks(components.size() + 1);
+	for(int c=0; c<components.size(); c++) {
+		const ComponentStats &blob = components[c];
+		if(blob.count < MINBLOBSIZE || blob.peakCount < MINPEAKSIZE) {
+			/* Not enough pixels */
+			marks[c+1] = 0xff000003; // rejected
+			continue;
+		}
+
+		/* Enough pixels for the finger */
+		unsigned char label = blobs.size()+1;
+		marks[c+1] = 0xff000005 | (label << 16) | (colorForBlobIndex(label) << 8);
+		blobs.push_back(blob);
+	}
+
+	labeler.forEachRun([&](const ComponentRun &run) {
+		fill(blobPx + run.y*w + run.x0, blobPx + run.y*w + run.x1, marks[run.label]);
+	});
+}
+
+float PeakBlobSegmenter::drawDebug(int back, float x, float y) {
+	blobIm[back].reloadTexture();
+	blobIm[back].draw(x, y);
+	drawText("Blob", x, y, HAlign::left, VAlign::top);
+	return y + blobIm[back].getHeight();
+}
+#pragma endregion
+
+#pragma region Sausage segmentation
+static uint8_t clamp(int val) {
+    if(val < 0) return 0;
+    if(val > 255) return 255;
+    return val;
+}
+
+
+#ifdef STAGES_SSE2
+static inline __m128i select_epi16(__m128i mask, __m128i a, __m128i b) {
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/* Each lane takes the value of the last lane at or before it whose keep mask is set, or else carry;
+   carry becomes the last lane's result, broadcast. Log-step scan over the 8 lanes. */
+static inline __m128i forward_fill_epi16(__m128i val, __m128i keep, __m128i &carry) {
+	val = select_epi16(keep, val, _mm_slli_si128(val, 2));
+	keep = _mm_or_si128(keep, _mm_slli_si128(keep, 2));
+	val = select_epi16(keep, val, _mm_slli_si128(val, 4));
+	keep = _mm_or_si128(keep, _mm_slli_si128(keep, 4));
+	val = select_epi16(keep, val, _mm_slli_si128(val, 8));
+	keep = _mm_or_si128(keep, _mm_slli_si128(keep, 8));
+	val = select_epi16(keep, val, carry);
+	carry = _mm_shufflehi_epi16(val, _MM_SHUFFLE(3, 3, 3, 3));
+	carry = _mm_unpackhi_epi64(carry, carry);
+	return val;
+}
+#endif
+
+static const int DIFF_DIST = 3; // px between the depths a gradient compares
+static const int MAX_CUTOFF = 1800; // mm
+static const int BAND_SIZE = 32; // rows or columns per parallel job
+
+/* Gradient of one row: out[x] = front[x] - back[x] + 127, clamped, or 0 where there's no valid depth.
+   Where only one of back and front is valid, the other carries over from the previous pixel; where neither is,
+   the raw values carry over instead (and still yield 0 if they are zero). */
+static void calc_gradient_row(unsigned char *out, const unsigned short *back, const unsigned short *front, int n) {
+	int prevback = 0, prevfront = 0;
+	int x = 0;
+
+#ifdef STAGES_SSE2
+	/* The carry is a forward fill: each pixel takes the value of the last pixel at or before it which keeps
+	   its own (valid, or both invalid), so 8 pixels at a time can be filled with a scan */
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_cmpeq_epi16(zero, zero);
+	const __m128i cutoff = _mm_set1_epi16(MAX_CUTOFF);
+	const __m128i bias = _mm_set1_epi16(127);
+	const __m128i max8 = _mm_set1_epi16(255);
+	__m128i carryback = zero, carryfront = zero; // last filled value, in every lane
+
+	__m128i result[2];
+	for(; x+16 <= n; x += 16) {
+		for(int half=0; half<2; half++) {
+			__m128i b = _mm_loadu_si128((const __m128i *)(back + x + half*8));
+			__m128i f = _mm_loadu_si128((const __m128i *)(front + x + half*8));
+			/* valid: nonzero and <= MAX_CUTOFF */
+			__m128i bvalid = _mm_andnot_si128(_mm_cmpeq_epi16(b, zero), _mm_cmpeq_epi16(_mm_subs_epu16(b, cutoff), zero));
+			__m128i fvalid = _mm_andnot_si128(_mm_cmpeq_epi16(f, zero), _mm_cmpeq_epi16(_mm_subs_epu16(f, cutoff), zero));
+			__m128i neither = _mm_andnot_si128(_mm_or_si128(bvalid, fvalid), ones);
+
+			b = forward_fill_epi16(b, _mm_or_si128(bvalid, neither), carryback);
+			f = forward_fill_epi16(f, _mm_or_si128(fvalid, neither), carryfront);
+
+			/* clamp(f - b + 127) without overflowing 16 bits */
+			__m128i up = _mm_subs_epu16(f, b), down = _mm_subs_epu16(b, f);
+			__m128i r = _mm_subs_epu16(_mm_adds_epu16(up, bias), down);
+			r = _mm_sub_epi16(r, _mm_subs_epu16(r, max8)); // min(r, 255)
+			__m128i invalid = _mm_or_si128(neither, _mm_or_si128(_mm_cmpeq_epi16(b, zero), _mm_cmpeq_epi16(f, zero)));
+			result[half] = _mm_andnot_si128(invalid, r);
+		}
+		_mm_storeu_si128((__m128i *)(out + x), _mm_packus_epi16(result[0], result[1]));
+	}
+	prevback = _mm_cvtsi128_si32(carryback) & 0xffff;
+	prevfront = _mm_cvtsi128_si32(carryfront) & 0xffff;
+#endif
+
+	for(; x<n; x++) {
+		int b = back[x];
+		int f = front[x];
+		if((!b || b > MAX_CUTOFF) && (!f || f > MAX_CUTOFF)) {
+			out[x] = 0;
+		} else {
+			if(!b || b > MAX_CUTOFF)
+				b = prevback;
+			if(!f || f > MAX_CUTOFF)
+				f = prevfront;
+
+			if(b == 0 || f == 0)
+				out[x] = 0;
+			else
+				out[x] = clamp((f - b) + 127);
+		}
+		prevback = b;
+		prevfront = f;
+	}
+}
+
+/* Rows [y0, y1) of the planar gradients; the first diff_dist columns (dx) or rows (dy) have none, and read 127 */
+static void calc_depth_dx(int W, int y0, int y1, unsigned char *dxpx, const unsigned short *depthpx, const int diff_dist) {
+	for(int y=y0; y<y1; y++) {
+		fill_n(dxpx + y*W, diff_dist, 127);
+		calc_gradient_row(dxpx + y*W + diff_dist, depthpx + y*W, depthpx + y*W + diff_dist, W - diff_dist);
+	}
+}
+
+static void calc_depth_dy(int W, int y0, int y1, unsigned char *dypx, const unsigned short *depthpx, const int diff_dist) {
+	for(int y=y0; y<y1; y++) {
+		if(y < diff_dist)
+			fill_n(dypx + y*W, W, 127);
+		else
+			calc_gradient_row(dypx + y*W, depthpx + (y-diff_dist)*W, depthpx + y*W, W);
+	}
+}
+
+struct SausageFinder {
+    const static uint8_t FLAG_VISITED_X = 1; // flag for visited x
+    const static uint8_t FLAG_VISITED_Y = 2; // flag for visited y
+    
+    const static int ssx_shift = 16; // blue channel
+    const static int ssf_shift = 8; // green channel
+    const static int ssy_shift = 0;  // red channel
+    
+    int SEARCH_GAP; // allowed pixel gap between adjacent slices
+    int MIN_SLICES; // minimum number of slices
+    
+    /* Slice search parameters */
+    int X_ENTER_MIN;
+    int X_ENTER_MAX;
+    int X_EXIT_MIN;
+    int X_EXIT_MAX;
+    int X_WIDTH_MIN;
+    int X_WIDTH_MAX;
+    
+    int Y_ENTER_MIN;
+    int Y_ENTER_MAX;
+    int Y_EXIT_MIN;
+    int Y_EXIT_MAX;
+    int Y_WIDTH_MIN;
+    int Y_WIDTH_MAX;
+    
+    int W, H;
+
+    uint32_t *sspx_start, *sspx_end;
+    /* Slice codes, kept in separate planes so that x and y slices can be searched concurrently; combine_slices
+       then writes them into the sausage image */
+    uint8_t *ssx_plane, *ssy_plane;
+    /* Rows at which each column's y slices start, in order; lets find_y_fingers skip the column walk */
+    vector<vector<uint16_t>> &y_starts;
+    SausageFinder(int W, int H, uint32_t *sspx, uint8_t *ssx_plane, uint8_t *ssy_plane, vector<vector<uint16_t>> &y_starts)
+    : W(W), H(H), ssx_plane(ssx_plane), ssy_plane(ssy_plane), y_starts(y_starts) {
+
+		SEARCH_GAP = 3; // allowed pixel gap between adjacent slices
+		MIN_SLICES = 8; // minimum number of slices
+    
+		/* Slice search parameters */
+		X_ENTER_MIN = 127 - 57;
+		X_ENTER_MAX = 127 - 5;
+		X_EXIT_MIN = 127 + 5;
+		X_EXIT_MAX = 127 + 57;
+		X_WIDTH_MIN = 3;
+		X_WIDTH_MAX = 6; // wide enough for 45-degree angles
+    
+		Y_ENTER_MIN = 127 - 30;
+		Y_ENTER_MAX = 127 - 5;
+		Y_EXIT_MIN = 127 + 5;
+		Y_EXIT_MAX = 127 + 57;
+		Y_WIDTH_MIN = 3;
+		Y_WIDTH_MAX = 6; // wide enough for 45-degree angles
+  
+        sspx_start = sspx;
+        sspx_end = sspx_start + W*H;
+    }
+    
+    /* Rows [y0, y1) */
+    void find_x_slices(const unsigned char *dxpx, int y0, int y1) const {
+        for(int y=y0; y<y1; y++) {
+            const unsigned char *dxrow = dxpx + y*W;
+            uint8_t *ssx = ssx_plane + y*W;
+            fill_n(ssx, W, 0);
+            for(int x=0; x<W; x++) {
+                uint8_t dx_enter = dxrow[x];
+                if(dx_enter < X_ENTER_MIN || dx_enter > X_ENTER_MAX)
+                    continue;
+                
+                for(int dx = X_WIDTH_MIN; dx < X_WIDTH_MAX && x+dx < W; dx++) {
+                    uint8_t dx_exit = dxrow[x+dx];
+                    if(dx_exit == 0 || dxrow[x+dx/2] == 0)
+                        break;
+                    if(dx_exit < X_EXIT_MIN || dx_exit > X_EXIT_MAX)
+                        continue;
+                    
+                    /* Found enter + exit pair */
+                    /* Pixel format: [dx] [256-1] [256-2] [256-3] ... [256-dx+1] */
+                    ssx[x] = dx;
+                    for(int i=1; i<dx; i++) {
+                        ssx[x+i] = 256-i;
+                    }
+                    x += dx;
+                    break;
+                }
+            }
+        }
+    }
+    
+    /* Columns [x0, x1), in strips one cache line wide, a row at a time, rather than one column at a time (which
+       strides a whole image row per step). Each column keeps its own place, so the slices are the same. */
+    static const int Y_STRIP = 16;
+    void find_y_slices(const unsigned char *dypx, int x0, int x1) const {
+        int next_y[Y_STRIP]; // first row each column of the strip may start a slice at
+        
+        for(int sx0=x0; sx0<x1; sx0+=Y_STRIP) {
+            const int sx1 = min(sx0 + Y_STRIP, x1);
+            fill_n(next_y, Y_STRIP, 0);
+            for(int x=sx0; x<sx1; x++) {
+                y_starts[x].clear();
+            }
+            for(int y=0; y<H; y++) {
+                fill(ssy_plane + y*W + sx0, ssy_plane + y*W + sx1, 0);
+            }
+            
+            for(int y=0; y<H; y++) {
+                const unsigned char *dyrow = dypx + y*W;
+                for(int x=sx0; x<sx1; x++) {
+                    uint8_t dy_enter = dyrow[x];
+                    if(dy_enter < Y_ENTER_MIN || dy_enter > Y_ENTER_MAX || y < next_y[x-sx0])
+                        continue;
+                    const unsigned char *dycol = dypx + x;
+                    
+                    for(int dy = Y_WIDTH_MIN; dy < Y_WIDTH_MAX && y+dy < H; dy++) {
+                        uint8_t dy_exit = dycol[(y+dy)*W];
+                        if(dy_exit == 0 || dycol[(y+dy/2)*W] == 0)
+                            break;
+                        if(dy_exit < Y_EXIT_MIN || dy_exit > Y_EXIT_MAX)
+                            continue;
+                        
+                        /* Found enter + exit pair */
+                        /* Pixel format: [dy] [256-1] [256-2] [256-3] ... [256-dy+1] */
+                        uint8_t *ssy = ssy_plane + y*W + x;
+                        ssy[0] = dy;
+                        for(int i=1; i<dy; i++) {
+                            ssy[i*W] = 256-i;
+                        }
+                        y_starts[x].push_back(y);
+                        next_y[x-sx0] = y + dy + 1;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    
+    /* Rows [y0, y1) of the sausage image, from the slice planes */
+    void combine_slices(int y0, int y1) const {
+        for(int i=y0*W; i<y1*W; i++) {
+            uint32_t ss = (ssx_plane[i] << ssx_shift) | (ssy_plane[i] << ssy_shift);
+            sspx_start[i] = ss ? 0xff000000 | ss : 0;
+        }
+    }
+    
+private:
+    uint32_t *midpt_x(uint32_t *sspx) const {
+        uint8_t ssx = *sspx >> ssx_shift;
+        if(ssx > 127) {
+            sspx -= (256 - ssx);
+            ssx = *sspx >> ssx_shift;
+        }
+        return sspx + ssx/2;
+    }
+    
+    uint32_t *midpt_y(uint32_t *sspx) const {
+        uint8_t ssy = *sspx >> ssy_shift;
+        if(ssy > 127) {
+            sspx -= (256 - ssy) * W;
+            ssy = *sspx >> ssy_shift;
+        }
+        return sspx + ssy/2*W;
+    }
+    
+    /* Find a finger composed of x-slices, starting from sspx (which must be a midpt point).
+     sspx is assumed to have already been pushed onto points. */
+    void find_x_finger(uint32_t *sspx, vector<uint32_t *> &points, bool can_switch, bool reverse=false) const {
+        uint32_t *initial_sspx = sspx;
+        
+        while(1) {
+            if(can_switch)
+                *sspx |= FLAG_VISITED_X << ssf_shift;
+            
+            /* Look for next x slice */
+            int found_x = 0;
+            if(reverse) {
+                for(int i=-1; i>-SEARCH_GAP && sspx+i*W >= sspx_start; i--) {
+                    if((uint8_t)(sspx[i*W] >> ssx_shift)) {
+                        found_x = i;
+                        break;
+                    }
+                }
+            } else {
+                for(int i=1; i<SEARCH_GAP && sspx+i*W < sspx_end; i++) {
+                    if((uint8_t)(sspx[i*W] >> ssx_shift)) {
+                        found_x = i;
+                        break;
+                    }
+                }
+            }
+            
+            if(found_x) {
+                /* Push on the newfound x */
+                sspx = midpt_x(sspx + found_x*W);
+                points.push_back(sspx);
+                continue;
+            } else if(can_switch) {
+                /* Try switching. */
+                int initial_x = (initial_sspx - sspx_start) % W;
+                int current_x = (sspx - sspx_start) % W;
+                find_y_finger(sspx, points, false, initial_x > current_x);
+                break;
+            } else {
+                /* We're done here */
+                break;
+            }
+        } // while(1)
+    }
+    
+    /* Find a finger composed of y-slices, starting from sspx (which must be a midpt point).
+     sspx is assumed to have already been pushed onto points. */
+    void find_y_finger(uint32_t *sspx, vector<uint32_t *> &points, bool can_switch, bool reverse=false) const {
+        uint32_t *initial_sspx = sspx;
+        
+        while(1) {
+            if(can_switch)
+                *sspx |= FLAG_VISITED_Y << ssf_shift;
+            
+            /* Look for next x slice */
+            int found_y = 0;
+            if(reverse) {
+                /* Look for next x/y slice. */
+                for(int i=-1; i>-SEARCH_GAP && sspx+i >= sspx_start; i--) {
+                    if((uint8_t)(sspx[i] >> ssy_shift)) {
+                        found_y = i;
+                        break;
+                    }
+                }
+            } else {
+                for(int i=1; i<SEARCH_GAP && sspx+i < sspx_end; i++) {
+                    if((uint8_t)(sspx[i] >> ssy_shift)) {
+                        found_y = i;
+                        break;
+                    }
+                }
+            }
+            
+            if(found_y) {
+                /* Push on the newfound y */
+                sspx = midpt_y(sspx + found_y);
+                points.push_back(sspx);
+                continue;
+            } else if(can_switch) {
+                /* Try switching directions */
+                int initial_y = (initial_sspx - sspx_start) / W;
+                int current_y = (sspx - sspx_start) / W;
+                find_x_finger(sspx, points, false, initial_y > current_y);
+                break;
+            } else {
+                /* We're done here */
+                break;
+            }
+        } // while(1)
+    }
+    
+    void find_x_fingers(vector<vector<uint32_t *>> &fingers) const {
+        vector<uint32_t *> points;
+        
+        for(int y=0; y<H; y++) {
+            uint32_t *sspx_row = sspx_start + y*W;
+            for(int x=0; x<W;) {
+                uint32_t *sspx = sspx_row + x;
+                if(!*sspx) {
+                    x++;
+                    continue;
+                }
+                
+                uint8_t slicelen = *sspx >> ssx_shift;
+                if(!slicelen) {
+                    x++;
+                    continue;
+                }
+                
+                // sspx should always be the start of a slice
+                assert(slicelen < 127);
+                
+                uint32_t *midpt = midpt_x(sspx);
+                /* Going to move past this slice when we're done */
+                x += slicelen;
+                
+                uint8_t ssf = *midpt >> ssf_shift;
+                if(ssf & FLAG_VISITED_X) {
+                    /* skip the slice */
+                    continue;
+                }
+                
+                points.clear();
+                points.push_back(midpt);
+                find_x_finger(midpt, points, true);
+                
+                /* See if the segment is valid */
+                if(points.size() < MIN_SLICES)
+                    continue; /* REJECT */
+                
+                fingers.push_back(points);
+            }
+        }
+    }
+    
+    void find_y_fingers(vector<vector<uint32_t *>> &fingers) const {
+        vector<uint32_t *> points;
+        
+        for(int x=0; x<W; x++) {
+            /* Same order as walking down the column from slice to slice */
+            for(int y : y_starts[x]) {
+                uint32_t *sspx = sspx_start + y*W + x;
+                
+                // sspx should always be the start of a slice
+                assert((uint8_t)(*sspx >> ssy_shift) < 127);
+                
+                uint32_t *midpt = midpt_y(sspx);
+                
+                uint8_t ssf = *midpt >> ssf_shift;
+                if(ssf & FLAG_VISITED_Y) {
+                    /* skip the slice */
+                    continue;
+                }
+                
+                points.clear();
+                points.push_back(midpt);
+                find_y_finger(midpt, points, true);
+                
+                /* See if the segment is valid */
+                if(points.size() < MIN_SLICES)
+                    continue; /* REJECT */
+                
+                fingers.push_back(points);
+            }
+        }
+    }
+    
+public:
+    vector<vector<int>> find_fingers() const {
+        vector<vector<int>> ret;
+        vector<vector<uint32_t *>> fingers;
+        
+        find_x_fingers(fingers);
+        find_y_fingers(fingers);
+        
+        for(const auto &points : fingers) {
+            /* It's good! Mark the centers. */
+            vector<int> point_ints;
+            for(uint32_t *ss : points) {
+                *ss |= 0xff << ssf_shift;
+                point_ints.push_back(ss - sspx_start);
+            }
+            ret.push_back(point_ints);
+        }
+        
+        return ret;
+    }
+};
+
+DepthGradientDiff::DepthGradientDiff(const TouchStageContext &ctx) : pool(WorkerPool::shared()) {
+	for(int i=0; i<2; i++) {
+		diffIm[i].allocate(ctx.w, ctx.h, OF_IMAGE_COLOR_ALPHA);
+		dxPlane[i].resize(ctx.w * ctx.h);
+		dyPlane[i].resize(ctx.w * ctx.h);
+	}
+	cur = 0;
+}
+
+void DepthGradientDiff::run(const TouchStageContext &ctx, int front) {
+	const int w = ctx.w, h = ctx.h;
+	const uint16_t *depthPx = ctx.depthStream.getPixelsRef().getPixels();
+	unsigned char *const dxpx_start = &dxPlane[front][0];
+	unsigned char *const dypx_start = &dyPlane[front][0];
+	cur = front;
+
+	/* Row bands; every job writes its own rows, so the result doesn't depend on the split */
+	const int rowBands = (h + BAND_SIZE - 1) / BAND_SIZE;
+	pool.parallelFor(rowBands, [&](int band) {
+		const int y0 = band * BAND_SIZE, y1 = min(y0 + BAND_SIZE, h);
+		calc_depth_dx(w, y0, y1, dxpx_start, depthPx, DIFF_DIST);
+		calc_depth_dy(w, y0, y1, dypx_start, depthPx, DIFF_DIST);
+	});
+}
+
+float DepthGradientDiff::drawDebug(int back, float x, float y) {
+	const int n = diffIm[back].getWidth() * diffIm[back].getHeight();
+
+	/* Only the display needs the gradients interleaved */
+	uint8_t *diffPx = diffIm[back].getPixels();
+	for(int i=0; i<n; i++) {
+		diffPx[i*4+0] = dyPlane[back][i];
+		diffPx[i*4+1] = 0;
+		diffPx[i*4+2] = dxPlane[back][i];
+		diffPx[i*4+3] = 0xff;
+	}
+	diffIm[back].reloadTexture();
+	diffIm[back].draw(x, y);
+	drawText("Diff", x, y, HAlign::left, VAlign::top);
+	return y + diffIm[back].getHeight();
+}
+
+SausageSegmenter::SausageSegmenter(const TouchStageContext &ctx) : pool(WorkerPool::shared()) {
+	for(int i=0; i<2; i++) {
+		sausageIm[i].allocate(ctx.w, ctx.h, OF_IMAGE_COLOR_ALPHA);
+	}
+	ssxPlane.resize(ctx.w * ctx.h);
+	ssyPlane.resize(ctx.w * ctx.h);
+	ySliceStarts.resize(ctx.w);
+}
+
+void SausageSegmenter::findFingers(const TouchStageContext &ctx, const uint8_t *dxpx_start, const uint8_t *dypx_start, int front) {
+	const int w = ctx.w, h = ctx.h;
+	uint32_t *sausagePx = (uint32_t *)sausageIm[front].getPixels();
+	SausageFinder finger_finder(w, h, sausagePx, &ssxPlane[0], &ssyPlane[0], ySliceStarts);
+
+	/* x slices by row bands alongside y slices by column bands; then the sausage image by row bands. Every job
+	   writes its own part of the planes, so the result doesn't depend on the split. */
+	const int rowBands = (h + BAND_SIZE - 1) / BAND_SIZE;
+	const int colBands = (w + BAND_SIZE - 1) / BAND_SIZE;
+	pool.parallelFor(rowBands + colBands, [&](int job) {
+		if(job < rowBands) {
+			finger_finder.find_x_slices(dxpx_start, job * BAND_SIZE, min((job + 1) * BAND_SIZE, h));
+		} else {
+			const int x0 = (job - rowBands) * BAND_SIZE;
+			finger_finder.find_y_slices(dypx_start, x0, min(x0 + BAND_SIZE, w));
+		}
+	});
+	pool.parallelFor(rowBands, [&](int band) {
+		finger_finder.combine_slices(band * BAND_SIZE, min((band + 1) * BAND_SIZE, h));
+	});
+
+	/* Tracing fingers follows slices across bands and switches between x and y as it goes, with the visited
+	   flags deciding what later searches skip; it stays serial so that the fingers match a serial search */
+	fingers = finger_finder.find_fingers();
+}
+
+float SausageSegmenter::drawDebug(int back, float x, float y) {
+	sausageIm[back].reloadTexture();
+	sausageIm[back].draw(x, y);
+	drawText("Sausage", x, y, HAlign::left, VAlign::top);
+	return y + sausageIm[back].getHeight();
+}
+
+/* Drop redundant/noisy touches: those whose tip lies within a longer finger */
+static void filterTouches(const vector<FingerTouch> &touches, vector<FingerTouch> &filtered_touches) {
+    for(const auto &ft : touches) {
+        bool should_be_added = true;
+
+        /* Check if touch is near any other touches */
+        for(const auto &other : touches) {
+            if(!should_be_added)
+                break;
+
+            if(&ft == &other)
+                continue;
+            
+            int violations = 0;
+            // Note: right now this checks only the tip
+            for(int i=0; i<1; i++) {
+                ofPoint pt = (i == 0) ? ft.tip : ft.base;
+                
+                ofVec2f pv = pt - other.base;
+                ofVec2f tv = other.tip - other.base;
+                ofVec2f tvn = tv.normalized();
+                float r = pv.dot(tvn);
+                if(r < -10 || r >= tv.length()+10) {
+                    // OK: point lies outside the segment joining other.tip and other.base.
+                    continue;
+                }
+                pv -= r*tvn;
+                if(pv.length() > 9) {
+                    // OK: point is perpendicularly more than 8 units away from the other segment.
+                    continue;
+                }
+                // Not OK: point is inside the other finger's personal space.
+                violations++;
+            }
+            
+            if(violations == 0) {
+                continue;
+            } else if(violations == 1) {
+                /* One violation. Pick the longer one. */
+                float mylen = ft.tip.distance(ft.base);
+                float otherlen = other.tip.distance(other.base);
+                if(mylen < otherlen) {
+                    should_be_added = false;
+                } else if(mylen == otherlen && ft.id > other.id) {
+                    // Same length: remove one of them
+                    should_be_added = false;
+                }
+            } else {
+                should_be_added = false;
+            }
+        }
+        
+        if(should_be_added) {
+			/* Forward project the tip a few mm. */
+			ofVec3f dir = ft.tip - ft.base;
+			dir.normalize();
+			FingerTouch newTouch = ft;
+			newTouch.tip += dir * 4;
+            filtered_touches.push_back(newTouch);
+        }
+    }
+}
+
+void SausageTips::extract(const TouchStageContext &ctx, const vector<vector<int>> &fingers, vector<FingerTouch> &touches) {
+	const int w = ctx.w;
+	const uint16_t *depthPx = ctx.depthStream.getPixelsRef().getPixels();
+	const float *bgmean = ctx.background.getBackgroundMean().getPixels();
+
+	/* Construct candidate touches from fingers */
+	candidates.clear();
+	for(const auto &finger : fingers) {
+		int idxTip = finger[2];
+		int idxBase = finger[finger.size()-2];
+		ofPoint tip(idxTip % w, idxTip / w);
+		ofPoint base(idxBase % w, idxBase / w);
+
+		if(depthPx[idxTip] < depthPx[idxBase]) {
+			swap(tip, base);
+			swap(idxTip, idxBase);
+		}
+
+		if(bgmean[idxTip] - depthPx[idxTip] < 7) {
+			FingerTouch ft;
+			ft.id = candidates.size();
+			ft.tip = tip;
+			ft.base = base;
+			ft.touched = true;
+			candidates.push_back(ft);
+		}
+	}
+
+	filterTouches(candidates, touches);
+}
+#pragma endregion
+
+#pragma region Benchmark
+/* A diff's per-pixel results behind a virtual interface, as a segmenter would see them if the stages were a
+   class hierarchy */
+struct PixelSource {
+	virtual ~PixelSource() {}
+	virtual bool foreground(int i) const = 0;
+	virtual bool peak(int i) const = 0;
+};
+
+template<typename Diff>
+struct DiffPixelSource : PixelSource {
+	const Diff &diff;
+	DiffPixelSource(const Diff &diff) : diff(diff) {}
+	bool foreground(int i) const { return diff.foreground(i); }
+	bool peak(int i) const { return diff.peak(i); }
+};
+
+struct VirtualDiff {
+	const PixelSource *source;
+	VirtualDiff(const PixelSource *source) : source(source) {}
+	bool foreground(int i) const { return source->foreground(i); }
+	bool peak(int i) const { return source->peak(i); }
+};
+
+static bool sameBlobs(const vector<ComponentStats> &a, const vector<ComponentStats> &b) {
+	if(a.size() != b.size())
+		return false;
+	for(int i=0; i<a.size(); i++) {
+		if(a[i].count != b[i].count || a[i].sumX != b[i].sumX || a[i].sumY != b[i].sumY || a[i].peakCount != b[i].peakCount)
+			return false;
+	}
+	return true;
+}
+
+template<typename Pipeline>
+struct TouchPipelineBenchmark {
+	static const int REPS = 50;
+
+	/* ms per run of the segmenter, with the diff behind a virtual interface; -1 if the segmenter doesn't read
+	   the diff per pixel */
+	static double timeVirtualSegment(Pipeline &p, bool &same, std::false_type) {
+		return -1;
+	}
+	static double timeVirtualSegment(Pipeline &p, bool &same, std::true_type) {
+		const vector<ComponentStats> reference = p.segmenter.getBlobs();
+		DiffPixelSource<decltype(p.diff)> source(p.diff);
+		uint64_t start = ofGetElapsedTimeMicros();
+		for(int r=0; r<REPS; r++)
+			p.segmenter.run(p.ctx, VirtualDiff(&source), p.front);
+		const double time = (ofGetElapsedTimeMicros() - start) / 1000.0 / REPS;
+		same = sameBlobs(reference, p.segmenter.getBlobs());
+		return time;
+	}
+
+	template<bool PerPixel>
+	static bool run(const string &name, Pipeline &p) {
+		double times[4] = {0, 0, 0, 0}; // ms: diff, segment, extract, merge
+		for(int r=0; r<REPS; r++) {
+			vector<FingerTouch> touches;
+			uint64_t t0 = ofGetElapsedTimeMicros();
+			p.diff.run(p.ctx, p.front);
+			uint64_t t1 = ofGetElapsedTimeMicros();
+			p.segmenter.run(p.ctx, p.diff, p.front);
+			uint64_t t2 = ofGetElapsedTimeMicros();
+			p.extractor.run(p.ctx, p.segmenter, touches);
+			uint64_t t3 = ofGetElapsedTimeMicros();
+			p.mergeTouches(touches);
+			uint64_t t4 = ofGetElapsedTimeMicros();
+			times[0] += t1 - t0;
+			times[1] += t2 - t1;
+			times[2] += t3 - t2;
+			times[3] += t4 - t3;
+		}
+		for(int i=0; i<4; i++)
+			times[i] /= 1000.0 * REPS;
+
+		bool same = true;
+		const double virtualTime = timeVirtualSegment(p, same, std::integral_constant<bool, PerPixel>());
+		string result = ofVAArgsToString("%s: %d blobs; diff %.3f, segment %.3f, extract %.3f, merge %.3f ms",
+			name.c_str(), (int)p.segmenter.getBlobs().size(), times[0], times[1], times[2], times[3]);
+		if(virtualTime >= 0) {
+			result += ofVAArgsToString("; segment through virtual calls %.3f ms (%.2fx)%s",
+				virtualTime, (times[1] > 0) ? virtualTime / times[1] : 0, same ? "" : ", DIFFERENT BLOBS");
+		} else {
+			result += "; the segmenter reads the diff's mask plane";
+		}
+		ofLogNotice("TouchPipeline") << result;
+		return same;
+	}
+};
+
+template<typename Pipeline, bool PerPixel>
+static bool benchmarkPipeline(const string &name, ofxKinect2::DepthStream &depthStream, ofxKinect2::IrStream &irStream, BackgroundUpdaterThread &background) {
+	Pipeline pipeline(depthStream, irStream, background);
+	return TouchPipelineBenchmark<Pipeline>::template run<PerPixel>(name, pipeline);
+}
+
+int benchmarkTouchPipelines(ofxKinect2::DepthStream &depthStream, ofxKinect2::IrStream &irStream, BackgroundUpdaterThread &background) {
+	int failures = 0;
+	failures += !benchmarkPipeline<WilsonSingleTouchTracker, false>("WilsonSingleTouchTracker", depthStream, irStream, background);
+	failures += !benchmarkPipeline<WilsonMaxTouchTracker, false>("WilsonMaxTouchTracker", depthStream, irStream, background);
+	failures += !benchmarkPipeline<WilsonStatTouchTracker, false>("WilsonStatTouchTracker", depthStream, irStream, background);
+	failures += !benchmarkPipeline<WorldKitTouchTracker, true>("WorldKitTouchTracker", depthStream, irStream, background);
+	failures += !benchmarkPipeline<StatBlobTouchTracker, true>("StatBlobTouchTracker", depthStream, irStream, background);
+	return failures;
+}
+#pragma endregion
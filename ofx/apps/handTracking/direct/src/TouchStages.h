@@ -0,0 +1,236 @@
+//
+//  TouchStages.h
+//  Stage policies for TouchPipeline: background diffs, blob segmenters, tip extractors and merge rules.
+//
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxKinect2.h"
+
+#include "TouchPipeline.h"
+#include "ComponentLabeler.h"
+#include "WorkerPool.h"
+
+#pragma region Diff stages
+/* Wilson's band threshold against a background frame of its own: mask = 0xff where tlow <= bg - depth <= thigh,
+   0 elsewhere. The background is either the 31st frame, or the furthest depth over the first 16 frames. */
+class BandThresholdDiff {
+public:
+	enum Capture {
+		CAPTURE_SINGLE,
+		CAPTURE_MAX
+	};
+
+private:
+	const Capture capture;
+	const int tlow, thigh;
+	ofShortPixels bg;
+	int frameNumber;
+	vector<uint8_t> maskPlane;
+
+public:
+	BandThresholdDiff(const TouchStageContext &ctx, Capture capture, int tlow, int thigh);
+
+	void run(const TouchStageContext &ctx, int front);
+	const uint8_t *mask() const { return &maskPlane[0]; }
+	bool foreground(int i) const { return maskPlane[i] != 0; }
+	bool peak(int i) const { return maskPlane[i] == 0xff; }
+	float drawDebug(int back, float x, float y) { return y; }
+};
+
+template<BandThresholdDiff::Capture C, int TLow, int THigh>
+struct BandThreshold : BandThresholdDiff {
+	BandThreshold(const TouchStageContext &ctx) : BandThresholdDiff(ctx, C, TLow, THigh) {}
+};
+
+/* Wilson's statistical threshold, with diff = bgmean - depth and z = diff / bgstdev: mask = 0 if z < znoise,
+   else 0x80 if z < zlow, else 0xff if diff < diffhigh, else 0 */
+class ZScoreThresholdDiff {
+	const float znoise, zlow, diffhigh;
+	vector<uint8_t> maskPlane;
+
+public:
+	ZScoreThresholdDiff(const TouchStageContext &ctx, float znoise, float zlow, float diffhigh);
+
+	void run(const TouchStageContext &ctx, int front);
+	const uint8_t *mask() const { return &maskPlane[0]; }
+	bool foreground(int i) const { return maskPlane[i] != 0; }
+	bool peak(int i) const { return maskPlane[i] == 0xff; }
+	float drawDebug(int back, float x, float y) { return y; }
+};
+
+/* Thresholds in tenths of a standard deviation, and mm */
+template<int ZNoiseTenths, int ZLowTenths, int DiffHigh>
+struct ZScoreThreshold : ZScoreThresholdDiff {
+	ZScoreThreshold(const TouchStageContext &ctx) : ZScoreThresholdDiff(ctx, ZNoiseTenths / 10.0f, ZLowTenths / 10.0f, (float)DiffHigh) {}
+};
+
+/* WorldKit's classification (B=absdiff G=type R=reldiff, see PixelKernels); tiles outside the tracker's zone are
+   left invalid. Foreground pixels differ from the background by at least 1 mm, peaks by at least 3 mm. */
+class WorldKitDiff {
+	ofImage diffIm[2];
+	const uint32_t *diffPx; // diff image of the frame being processed
+
+public:
+	WorldKitDiff(const TouchStageContext &ctx);
+
+	void run(const TouchStageContext &ctx, int front);
+	bool foreground(int i) const { return ((diffPx[i] >> 16) & 0xff) >= 1; }
+	bool peak(int i) const { return ((diffPx[i] >> 16) & 0xff) >= 3; }
+	float drawDebug(int back, float x, float y);
+};
+/* OmniTouch's depth gradients: dx and dy planes of depth[i] - depth[i - 3 px] + 127, clamped, with 0 where there's
+   no valid depth (up to 1800 mm) nearby. Computed by row bands across the shared pool. */
+class DepthGradientDiff {
+	vector<uint8_t> dxPlane[2], dyPlane[2];
+	ofImage diffIm[2]; // diff image; B=dx G=0 R=dy, built from the planes for display
+	int cur; // planes of the frame being processed
+	WorkerPool &pool;
+
+public:
+	DepthGradientDiff(const TouchStageContext &ctx);
+
+	void run(const TouchStageContext &ctx, int front);
+	const uint8_t *dx() const { return &dxPlane[cur][0]; }
+	const uint8_t *dy() const { return &dyPlane[cur][0]; }
+	float drawDebug(int back, float x, float y);
+};
+#pragma endregion
+
+#pragma region Segmenters
+/* Wilson's segmentation: box filter the diff's mask over (2*filtersz+1)^2 pixels, select the pixels whose mean
+   exceeds thresh (0-255), and keep the four-connected blobs of at least minsize of them. Needs the diff's
+   mask(). */
+class LowpassBlobSegmenter {
+	const int filtersz, thresh, minsize;
+
+	/* Planar stages of the low-pass filter: the mask's horizontal box filter, and the running vertical box
+	   sums. The blob image is only assembled by the last pass. */
+	vector<uint8_t> boxPlane;
+	vector<uint16_t> colSums;
+	ofImage blobIm[2]; // blob image; B=zone G=smoothed R=thresholded
+
+	ComponentLabeler labeler;
+	vector<ComponentStats> blobs;
+
+	void filter(const uint8_t *mask, int front);
+	void findBlobs(int front);
+
+public:
+	LowpassBlobSegmenter(const TouchStageContext &ctx, int filtersz, int thresh, int minsize);
+
+	template<typename Diff>
+	void run(const TouchStageContext &ctx, const Diff &diff, int front) {
+		filter(diff.mask(), front);
+		findBlobs(front);
+	}
+	const vector<ComponentStats> &getBlobs() const { return blobs; }
+	float drawDebug(int back, float x, float y);
+};
+
+template<int FilterSize, int Thresh, int MinSize>
+struct LowpassBlobs : LowpassBlobSegmenter {
+	LowpassBlobs(const TouchStageContext &ctx) : LowpassBlobSegmenter(ctx, FilterSize, Thresh, MinSize) {}
+};
+
+/* WorldKit's segmentation: the four-connected blobs of the diff's foreground pixels, away from the image border,
+   with at least 10 pixels of which at least 5 are peaks. Labels the diff's pixels directly. */
+class PeakBlobSegmenter {
+	ofImage blobIm[2]; // blob image; B=index G=indexcolor R=flags
+	ComponentLabeler labeler;
+	vector<ComponentStats> blobs;
+
+	template<typename Diff>
+	struct Pixels : ComponentPixels {
+		const Diff *diff;
+		const uint32_t *blobPx;
+		Pixels(const Diff *diff, const uint32_t *blobPx) : diff(diff), blobPx(blobPx) {}
+		bool foreground(int i) const { return blobPx[i] == 0 && diff->foreground(i); }
+		bool peak(int i) const { return diff->peak(i); }
+	};
+
+	uint32_t *startBlobImage(int front);
+	void acceptBlobs(const vector<ComponentStats> &components, uint32_t *blobPx);
+
+public:
+	PeakBlobSegmenter(const TouchStageContext &ctx);
+
+	template<typename Diff>
+	void run(const TouchStageContext &ctx, const Diff &diff, int front) {
+		uint32_t *blobPx = startBlobImage(front);
+		acceptBlobs(labeler.label(ComponentLabeler::CONNECT_4, Pixels<Diff>(&diff, blobPx)), blobPx);
+	}
+	const vector<ComponentStats> &getBlobs() const { return blobs; }
+	float drawDebug(int back, float x, float y);
+};
+/* OmniTouch's sausage search: x and y slices (a falling then a rising gradient, 3-5 px apart) chained into fingers
+   of at least 8 slices. Needs the diff's dx() and dy() planes. Yields fingers, as the pixel indices of their slice
+   midpoints, rather than blobs. */
+class SausageSegmenter {
+	ofImage sausageIm[2]; // sausage image; B=x G=flags R=y
+	vector<uint8_t> ssxPlane, ssyPlane; // x and y slice codes, before they are combined into the sausage image
+	vector<vector<uint16_t>> ySliceStarts; // per column, reused between frames
+	vector<vector<int>> fingers;
+
+	/* Slice searches are split into bands across the shared pool */
+	WorkerPool &pool;
+
+	void findFingers(const TouchStageContext &ctx, const uint8_t *dx, const uint8_t *dy, int front);
+
+public:
+	SausageSegmenter(const TouchStageContext &ctx);
+
+	template<typename Diff>
+	void run(const TouchStageContext &ctx, const Diff &diff, int front) {
+		findFingers(ctx, diff.dx(), diff.dy(), front);
+	}
+	const vector<vector<int>> &getFingers() const { return fingers; }
+	float drawDebug(int back, float x, float y);
+};
+#pragma endregion
+
+#pragma region Extractors and merge rules
+/* A touch at the centroid of each blob */
+struct CentroidTips {
+	template<typename Segmenter>
+	void run(const TouchStageContext &ctx, const Segmenter &segmenter, vector<FingerTouch> &touches) {
+		for(const ComponentStats &blob : segmenter.getBlobs()) {
+			const ofVec2f pt = blob.centroid();
+			FingerTouch touch;
+			touch.tip.set(pt.x, pt.y);
+			touch.touched = true;
+			touches.push_back(touch);
+		}
+	}
+};
+
+/* OmniTouch's tips: the end of each finger further from the sensor, if it is within 7 mm of the background.
+   A tip inside a longer finger is dropped; the rest are projected 4 px further along their fingers. */
+class SausageTips {
+	vector<FingerTouch> candidates;
+
+	void extract(const TouchStageContext &ctx, const vector<vector<int>> &fingers, vector<FingerTouch> &touches);
+
+public:
+	template<typename Segmenter>
+	void run(const TouchStageContext &ctx, const Segmenter &segmenter, vector<FingerTouch> &touches) {
+		extract(ctx, segmenter.getFingers(), touches);
+	}
+};
+
+/* Every touch is on the surface: these trackers only find fingers which touch it */
+struct AlwaysTouched {
+	float gate() const { return 100; } // px: furthest a touch may move between frames and keep its ID
+	void operator()(const FingerTouch &curTouch, FingerTouch &newTouch) const {
+		newTouch.touched = true;
+	}
+};
+#pragma endregion
+
+/* Time the stages of each pipeline on the current sensor frame and log the results. Where a segmenter reads
+   the diff per pixel, it is also timed with the diff behind a virtual interface, as a class hierarchy of
+   stages would have it, and the two must find the same blobs. Returns the number of pipelines where they
+   differed. */
+int benchmarkTouchPipelines(ofxKinect2::DepthStream &depthStream, ofxKinect2::IrStream &irStream, BackgroundUpdaterThread &background);
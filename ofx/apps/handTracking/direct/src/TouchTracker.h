@@ -9,6 +9,7 @@
 #include "FPSTracker.h"
 #include "BackgroundUpdaterThread.h"
 #include "Touch.h"
+#include "TouchChannel.h"
 
 class TouchTracker : public ofThread {
 private:
@@ -27,6 +28,36 @@ protected:
 	vector<FingerTouch> touches;
 	int nextTouchId;
 
+	/* Background tiles this tracker should process (see setZoneTiles); empty means all of them. Only the
+	   tracker's own threads use it: new zones wait in pendingZoneTiles until updateZoneTiles() takes them up. */
+	vector<uint8_t> zoneTiles;
+	ofMutex pendingZoneLock;
+	vector<uint8_t> pendingZoneTiles;
+	bool zonesPending;
+
+	/* Take up the zones set since the last call. Call from the tracker thread at the start of a frame, so that
+	   a frame sees one set of zones throughout. */
+	void updateZoneTiles() {
+		ofScopedLock lock(pendingZoneLock);
+		if(zonesPending) {
+			zoneTiles.swap(pendingZoneTiles); // the old buffer takes the next zones
+			zonesPending = false;
+		}
+	}
+
+	/* Touch frame channels (see openChannel); the list is fixed once the thread runs */
+	vector<ofPtr<TouchChannel> > channels;
+	uint64_t touchFrames; // touch frames published so far
+
+	/* Hand the current touches to every channel as the next touch frame. Call from the tracker thread, right
+	   after publishing the touches for update(). */
+	void deliverTouches(uint64_t sensorTimestamp, uint64_t captureTime) {
+		touchFrames++;
+		for(auto &channel : channels) {
+			channel->publish(touchFrames, sensorTimestamp, captureTime, touches.begin(), touches.end());
+		}
+	}
+
 public:
 	FPSTracker fps;
 
@@ -35,6 +66,8 @@ public:
         : w(depthStream.getWidth()), h(depthStream.getHeight()), depthStream(depthStream), irStream(irStream), background(background) {
 		touchesUpdated = false;
 		nextTouchId = 1;
+		touchFrames = 0;
+		zonesPending = false;
     }
 
 	/* The responsibility of stopping the thread is in the subclass: it must be the first thing the destructor does. */
@@ -42,4 +75,25 @@ public:
 
 	virtual void drawDebug(float x, float y) {}
 	virtual bool update(vector<FingerTouch> &retTouches) = 0;
+
+	/* Open a channel which receives every touch frame, with its timestamps, unlike update() which only returns
+	   the latest touches. Each consumer needs its own channel. Call before startThread(); the tracker owns it. */
+	TouchChannel *openChannel(int capacity=16, int maxTouches=64) {
+		channels.push_back(ofPtr<TouchChannel>(new TouchChannel(capacity, maxTouches)));
+		return channels.back().get();
+	}
+
+	/* Restrict processing to some of the background's tiles (nonzero entries, in BackgroundUpdaterThread tile
+	   order), e.g. to share the surface with other trackers. Trackers which can't restrict themselves ignore this.
+	   May be called from any thread, while the tracker runs; the tracker moves to the new zones at its next frame. */
+	void setZoneTiles(const vector<uint8_t> &tiles) {
+		ofScopedLock lock(pendingZoneLock);
+		pendingZoneTiles.assign(tiles.begin(), tiles.end());
+		zonesPending = true;
+	}
+	/* For the tracker's threads: whether the current frame's zones include the pixel */
+	bool isInZone(int x, int y) const {
+		const int tileSize = BackgroundUpdaterThread::tileSize;
+		return zoneTiles.empty() || zoneTiles[(y / tileSize) * background.getTileCols() + x / tileSize];
+	}
 };
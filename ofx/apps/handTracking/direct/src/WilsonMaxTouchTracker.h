@@ -9,22 +9,6 @@
 #pragma once
 
 #include "ofMain.h"
-#include "WilsonTouchTracker.h"
+#include "TouchStages.h"
 
-class WilsonMaxTouchTracker : public WilsonTouchTracker {
-protected:
-	/* Touch tracking */
-	vector<FingerTouch> findTouches();
-
-	ofShortPixels bg; // maximum BG frame
-
-public:
-	WilsonMaxTouchTracker(ofxKinect2::DepthStream &depthStream, ofxKinect2::IrStream &irStream, BackgroundUpdaterThread &background)
-		: WilsonTouchTracker(depthStream, irStream, background) {
-		bg.allocate(w, h, OF_IMAGE_COLOR_ALPHA);
-	}
-	virtual ~WilsonMaxTouchTracker() {
-		stopThread();
-		waitForThread();
-	}
-};
+typedef TouchPipeline<BandThreshold<BandThresholdDiff::CAPTURE_MAX, 8, 16>, LowpassBlobs<3, 50, 5>, CentroidTips, AlwaysTouched> WilsonMaxTouchTracker;
@@ -9,22 +9,6 @@
 #pragma once
 
 #include "ofMain.h"
-#include "WilsonTouchTracker.h"
+#include "TouchStages.h"
 
-class WilsonSingleTouchTracker : public WilsonTouchTracker {
-protected:
-	/* Touch tracking */
-	vector<FingerTouch> findTouches();
-
-	ofShortPixels bg; // single BG frame
-
-public:
-	WilsonSingleTouchTracker(ofxKinect2::DepthStream &depthStream, ofxKinect2::IrStream &irStream, BackgroundUpdaterThread &background)
-		: WilsonTouchTracker(depthStream, irStream, background) {
-		bg.allocate(w, h, OF_IMAGE_COLOR_ALPHA);
-	}
-	virtual ~WilsonSingleTouchTracker() {
-		stopThread();
-		waitForThread();
-	}
-};
+typedef TouchPipeline<BandThreshold<BandThresholdDiff::CAPTURE_SINGLE, 6, 12>, LowpassBlobs<3, 50, 5>, CentroidTips, AlwaysTouched> WilsonSingleTouchTracker;
@@ -9,18 +9,6 @@
 #pragma once
 
 #include "ofMain.h"
-#include "WilsonTouchTracker.h"
+#include "TouchStages.h"
 
-class WilsonStatTouchTracker : public WilsonTouchTracker {
-protected:
-	/* Touch tracking */
-	vector<FingerTouch> findTouches();
-	void doDepthThresh(float znoise, float zlow, float zhigh);
-public:
-	WilsonStatTouchTracker(ofxKinect2::DepthStream &depthStream, ofxKinect2::IrStream &irStream, BackgroundUpdaterThread &background)
-		: WilsonTouchTracker(depthStream, irStream, background) {}
-	virtual ~WilsonStatTouchTracker() {
-		stopThread();
-		waitForThread();
-	}
-};
+typedef TouchPipeline<ZScoreThreshold<20, 40, 20>, LowpassBlobs<3, 100, 5>, CentroidTips, AlwaysTouched> WilsonStatTouchTracker;
@@ -0,0 +1,114 @@
+//
+//  WorkerPool.cpp
+//  Fixed-size pool of worker threads for data-parallel loops.
+//
+//
+
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <thread>
+
+static std::mutex sharedMutex;
+static WorkerPool *sharedPool = NULL;
+
+void WorkerPool::runJobs(Batch &batch) {
+	while(1) {
+		int i = batch.next++;
+		if(i >= batch.count)
+			break;
+		(*batch.fn)(i);
+	}
+}
+
+void WorkerPool::Worker::threadedFunction() {
+	std::unique_lock<std::mutex> lock(pool.mutex);
+	while(1) {
+		Batch *batch = NULL;
+		for(auto b : pool.batches) {
+			if(b->next < b->count) {
+				batch = b;
+				break;
+			}
+		}
+		if(!batch) {
+			if(pool.stopping)
+				return;
+			pool.startCond.wait(lock);
+			continue;
+		}
+
+		/* The caller waits for its helpers, so the batch outlives this */
+		batch->helpers++;
+		lock.unlock();
+		runJobs(*batch);
+		lock.lock();
+		if(--batch->helpers == 0)
+			pool.doneCond.notify_all();
+	}
+}
+
+void WorkerPool::parallelFor(int count, const std::function<void(int)> &fn) {
+	if(count <= 0)
+		return;
+
+	if(count == 1 || workers.empty()) {
+		for(int i=0; i<count; i++)
+			fn(i);
+		return;
+	}
+
+	Batch batch;
+	batch.fn = &fn;
+	batch.count = count;
+	batch.next = 0;
+	batch.helpers = 0;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		batches.push_back(&batch);
+	}
+	startCond.notify_all();
+
+	runJobs(batch);
+
+	/* Every job is claimed; no more helpers can join once the batch is unlisted. Wait for the stragglers,
+	   as fn must stay alive until every worker is done with it. */
+	std::unique_lock<std::mutex> lock(mutex);
+	batches.erase(std::find(batches.begin(), batches.end(), &batch));
+	while(batch.helpers > 0)
+		doneCond.wait(lock);
+}
+
+WorkerPool::WorkerPool(int numThreads)
+: stopping(false) {
+	if(numThreads <= 0)
+		numThreads = max((int)std::thread::hardware_concurrency() - 1, 0);
+
+	batches.reserve(16); // listing a batch shouldn't allocate
+	for(int i=0; i<numThreads; i++) {
+		Worker *worker = new Worker(*this);
+		worker->startThread();
+		workers.push_back(worker);
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	startCond.notify_all();
+
+	for(auto worker : workers) {
+		worker->waitForThread();
+		delete worker;
+	}
+}
+
+WorkerPool &WorkerPool::shared() {
+	/* Not a function-local static: VS2012 doesn't make their initialization thread-safe */
+	std::lock_guard<std::mutex> lock(sharedMutex);
+	if(!sharedPool)
+		sharedPool = new WorkerPool();
+	return *sharedPool;
+}
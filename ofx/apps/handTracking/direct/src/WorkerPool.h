@@ -0,0 +1,63 @@
+//
+//  WorkerPool.h
+//  Fixed-size pool of worker threads for data-parallel loops.
+//
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+class WorkerPool {
+private:
+	class Worker : public ofThread {
+		WorkerPool &pool;
+	public:
+		Worker(WorkerPool &pool) : pool(pool) {}
+		void threadedFunction();
+	};
+	friend class Worker;
+
+	vector<Worker *> workers;
+
+	/* The jobs of one parallelFor call */
+	struct Batch {
+		const std::function<void(int)> *fn;
+		int count;
+		std::atomic<int> next; // first job not yet claimed
+		int helpers; // workers running jobs of this batch
+	};
+
+	std::mutex mutex;
+	std::condition_variable startCond, doneCond;
+	bool stopping;
+	vector<Batch *> batches; // batches with callers still in parallelFor, oldest first
+
+	static void runJobs(Batch &batch);
+
+	/* Forbid copying */
+	WorkerPool &operator=(const WorkerPool &);
+	WorkerPool(const WorkerPool &);
+
+public:
+	/* numThreads = 0 picks one worker per spare hardware thread */
+	WorkerPool(int numThreads=0);
+	~WorkerPool();
+
+	/* The process-wide pool, created on first use and kept until exit. Trackers share it rather than each
+	   starting a thread per core. */
+	static WorkerPool &shared();
+
+	/* Number of threads that execute jobs, including the caller */
+	int size() const { return workers.size() + 1; }
+
+	/* Call fn(i) for each i in [0, count) and wait for all calls to finish. The calling thread also runs jobs.
+	   Several threads may call at once, and jobs may call it themselves: idle workers help the oldest batch
+	   with jobs left, and each caller works through its own batch whether or not any worker joins in. */
+	void parallelFor(int count, const std::function<void(int)> &fn);
+};